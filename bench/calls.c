@@ -0,0 +1,21 @@
+#include <stdlib.h>
+
+/* A chain of depth calls, one frame per level */
+__attribute__ ((noinline)) static long
+chain (long depth)
+{
+	if (depth == 0)
+		return 0;
+	return chain (depth - 1) + 1;
+}
+
+/* argv[1] calls in total, in chains of argv[2] levels */
+int main (int argc, char *argv[])
+{
+	long n = (argc > 1) ? atol (argv[1]) : 1000000;
+	long depth = (argc > 2) ? atol (argv[2]) : 1000;
+	volatile long sum = 0;
+	for (long i = 0; i < n; i += depth)
+		sum += chain (depth);
+	return (int) (sum & 1);
+}
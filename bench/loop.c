@@ -0,0 +1,11 @@
+#include <stdlib.h>
+
+/* A tight loop of argv[1] iterations */
+int main (int argc, char *argv[])
+{
+	long n = (argc > 1) ? atol (argv[1]) : 1000000;
+	volatile long sum = 0;
+	for (long i = 0; i < n; i++)
+		sum += i & 7;
+	return (int) (sum & 1);
+}
@@ -0,0 +1,338 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+/* Microbenchmarks of the primitives of trace.o, on synthetic streams of
+ * addresses, without tracing anything. The allocations are counted through
+ * the wrappers of malloc() and co (linked with -Wl,--wrap) */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <trace.h>
+
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Number of distinct addresses of the collision stream */
+#define COLLISION_KEYS 1024
+
+/* Number of instructions of the body of the loop stream */
+#define LOOP_BODY 64
+
+/* Times the traces are compared */
+#define COMPARE_RUNS 10
+
+/* Opcodes of the instructions of the streams */
+static const uint8_t nop[] = { 0x90 };              /* nop */
+static const uint8_t jmp_back[] = { 0xEB, 0x00 };   /* jmp rel8 */
+static const uint8_t jmp_reg[] = { 0xFF, 0xE0 };    /* jmp *%rax */
+
+/* A step of a stream: the instruction run */
+typedef struct
+{
+  uintptr_t addr;
+  const uint8_t *opcodes;
+  uint8_t size;
+} step_t;
+
+/* Allocations made since the start */
+static size_t nb_allocs = 0;
+static size_t alloc_bytes = 0;
+
+void *__real_malloc (size_t size);
+void *__real_calloc (size_t nmemb, size_t size);
+void *__real_realloc (void *ptr, size_t size);
+void *__real_aligned_alloc (size_t alignment, size_t size);
+
+void *
+__wrap_malloc (size_t size)
+{
+  nb_allocs++;
+  alloc_bytes += size;
+  return __real_malloc (size);
+}
+
+void *
+__wrap_calloc (size_t nmemb, size_t size)
+{
+  nb_allocs++;
+  alloc_bytes += nmemb * size;
+  return __real_calloc (nmemb, size);
+}
+
+void *
+__wrap_realloc (void *ptr, size_t size)
+{
+  nb_allocs++;
+  alloc_bytes += size;
+  return __real_realloc (ptr, size);
+}
+
+void *
+__wrap_aligned_alloc (size_t alignment, size_t size)
+{
+  nb_allocs++;
+  alloc_bytes += size;
+  return __real_aligned_alloc (alignment, size);
+}
+
+/* Clock and allocation counters at the start of an operation */
+typedef struct
+{
+  struct timespec start;
+  size_t allocs;
+  size_t bytes;
+} probe_t;
+
+static void
+probe_start (probe_t *p)
+{
+  p->allocs = nb_allocs;
+  p->bytes = alloc_bytes;
+  clock_gettime (CLOCK_MONOTONIC, &(p->start));
+}
+
+/* Write the cost of the nb_ops operations started at p */
+static void
+probe_stop (probe_t *p, const char *stream, const char *op, size_t nb_ops)
+{
+  struct timespec end;
+  clock_gettime (CLOCK_MONOTONIC, &end);
+  double ns = (end.tv_sec - p->start.tv_sec) * 1e9
+    + (end.tv_nsec - p->start.tv_nsec);
+  if (nb_ops == 0)
+    nb_ops = 1;
+  printf ("%-10s %-14s %10zu %10.1f %10.3f %10.1f\n", stream, op, nb_ops,
+          ns / nb_ops, (double) (nb_allocs - p->allocs) / nb_ops,
+          (double) (alloc_bytes - p->bytes) / nb_ops);
+}
+
+/* A xorshift generator, the streams are the same from one run to another */
+static uint64_t
+next_random (uint64_t *state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+/* A straight line of n instructions */
+static void
+stream_sequential (step_t *steps, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    steps[i] = (step_t) { 0x400000 + i, nop, 1 };
+}
+
+/* A loop of LOOP_BODY instructions, run until n instructions are */
+static void
+stream_loop (step_t *steps, size_t n)
+{
+  for (size_t i = 0; i < n; i++)
+    {
+      size_t k = i % LOOP_BODY;
+      steps[i] = (k == LOOP_BODY - 1)
+        ? (step_t) { 0x400000 + k, jmp_back, sizeof (jmp_back) }
+        : (step_t) { 0x400000 + k, nop, 1 };
+    }
+}
+
+/* Indirect jumps to n addresses at random, some of them run several times */
+static void
+stream_random (step_t *steps, size_t n)
+{
+  uint64_t state = 0x9E3779B97F4A7C15ULL;
+  for (size_t i = 0; i < n; i++)
+    steps[i] = (step_t) { 0x400000 + next_random (&state) % (16 * n),
+                          jmp_reg, sizeof (jmp_reg) };
+}
+
+/* Indirect jumps among COLLISION_KEYS addresses whose hashes are in the
+ * same shard and start probing at the same group of slots */
+static void
+stream_collision (step_t *steps, size_t n)
+{
+  uintptr_t keys[COLLISION_KEYS];
+  uint64_t target = 0;
+  size_t nb_keys = 0;
+
+  for (uintptr_t addr = 0x400000; nb_keys < COLLISION_KEYS; addr++)
+    {
+      instr_t *ins = instr_new (addr, sizeof (jmp_reg), jmp_reg);
+      if (!ins)
+        err (EXIT_FAILURE, "error: cannot create instruction");
+      uint64_t hash = hash_instr (ins);
+      instr_delete (ins);
+
+      /* The shard is picked by the 6 high bits, the group by the bits
+       * above the 7 of the tag */
+      uint64_t key = (hash >> 58) << 8 | ((hash >> 7) & 0xFF);
+      if (nb_keys == 0)
+        target = key;
+      if (key == target)
+        keys[nb_keys++] = addr;
+    }
+
+  for (size_t i = 0; i < n; i++)
+    steps[i] = (step_t) { keys[i % COLLISION_KEYS], jmp_reg,
+                          sizeof (jmp_reg) };
+}
+
+/* Create the instructions of the n steps of a stream */
+static instr_t **
+make_instrs (const step_t *steps, size_t n)
+{
+  instr_t **instrs = malloc (n * sizeof (instr_t *));
+  if (!instrs)
+    err (EXIT_FAILURE, "error: cannot allocate instructions");
+  for (size_t i = 0; i < n; i++)
+    {
+      instrs[i] = instr_new (steps[i].addr, steps[i].size, steps[i].opcodes);
+      if (!instrs[i])
+        err (EXIT_FAILURE, "error: cannot create instruction");
+    }
+  return instrs;
+}
+
+/* Nodes of a cfg, collected by hashtable_foreach() */
+typedef struct
+{
+  cfg_t **nodes;
+  size_t nb_nodes;
+} nodes_t;
+
+static void
+collect_node (cfg_t *CFG, void *data)
+{
+  nodes_t *n = data;
+  n->nodes[n->nb_nodes++] = CFG;
+}
+
+/* Run the benchmarks on a stream of n steps */
+static void
+bench_stream (const char *name, const step_t *steps, size_t n)
+{
+  probe_t p;
+
+  /* Building the cfg, as the tracer does at each step */
+  hashtable_t *ht = hashtable_new (DEFAULT_HASHTABLE_SIZE);
+  callstack_t *stack = stack_new ();
+  if (!ht || !stack)
+    err (EXIT_FAILURE, "error: cannot create cfg");
+  instr_t **instrs = make_instrs (steps, n);
+
+  probe_start (&p);
+  cfg_t *CFG = cfg_new (ht, instrs[0]);
+  for (size_t i = 1; i < n && CFG; i++)
+    CFG = cfg_insert (ht, CFG, instrs[i], stack);
+  probe_stop (&p, name, "cfg_insert", n);
+  if (!CFG)
+    errx (EXIT_FAILURE, "error: cannot insert in cfg");
+  free (instrs);
+
+  /* Looking the steps up, all of them are found */
+  instrs = make_instrs (steps, n);
+  size_t found = 0;
+  probe_start (&p);
+  for (size_t i = 0; i < n; i++)
+    found += (hashtable_lookup (ht, instrs[i]) != NULL);
+  probe_stop (&p, name, "lookup", n);
+  if (found != n)
+    errx (EXIT_FAILURE, "error: %zu steps not found", n - found);
+
+  /* Inserting the nodes in a table growing from its smallest size */
+  size_t nb_nodes = hashtable_entries (ht);
+  nodes_t nodes = { malloc (nb_nodes * sizeof (cfg_t *)), 0 };
+  hashtable_t *copy = hashtable_new (1);
+  if (!nodes.nodes || !copy)
+    err (EXIT_FAILURE, "error: cannot copy cfg");
+  hashtable_foreach (ht, collect_node, &nodes);
+
+  probe_start (&p);
+  for (size_t i = 0; i < nodes.nb_nodes; i++)
+    if (!hashtable_insert (copy, nodes.nodes[i]))
+      err (EXIT_FAILURE, "error: cannot insert node");
+  probe_stop (&p, name, "insert", nodes.nb_nodes);
+
+  double mean;
+  size_t longest = hashtable_probe_length (copy, &mean);
+  hashtable_delete (copy);
+  free (nodes.nodes);
+
+  /* Comparing two traces of the stream differing by their last id */
+  trace_t *t1 = trace_new (), *t2 = trace_new ();
+  if (!t1 || !t2)
+    err (EXIT_FAILURE, "error: cannot create traces");
+  for (size_t i = 0; i < n; i++)
+    {
+      uint32_t id = cfg_get_id (hashtable_lookup (ht, instrs[i]));
+      if (!trace_append (t1, id)
+          || !trace_append (t2, (i == n - 1) ? id + 1 : id))
+        err (EXIT_FAILURE, "error: cannot append to traces");
+    }
+
+  size_t prefix = 0;
+  probe_start (&p);
+  for (int run = 0; run < COMPARE_RUNS; run++)
+    prefix += trace_compare (t1, t2);
+  probe_stop (&p, name, "trace_compare", COMPARE_RUNS * n);
+  if (prefix != COMPARE_RUNS * (n - 1))
+    errx (EXIT_FAILURE, "error: wrong common prefix");
+
+  printf ("%-10s %zu nodes, %zu slots, probe length %.2f groups (max %zu)\n",
+          "", nb_nodes, hashtable_size (ht), mean, longest);
+
+  for (size_t i = 0; i < n; i++)
+    instr_delete (instrs[i]);
+  free (instrs);
+  trace_delete (t1);
+  trace_delete (t2);
+  stack_delete (stack);
+  hashtable_delete (ht);
+}
+
+int
+main (int argc, char *argv[])
+{
+  size_t n = (argc > 1) ? strtoul (argv[1], NULL, 10) : 1000000;
+  if (n < 2)
+    errx (EXIT_FAILURE, "error: at least 2 steps are needed");
+
+  static const struct
+  {
+    const char *name;
+    void (*make) (step_t *, size_t);
+  } streams[] = {
+    { "sequential", stream_sequential },
+    { "loop", stream_loop },
+    { "random", stream_random },
+    { "collision", stream_collision }
+  };
+
+  step_t *steps = malloc (n * sizeof (step_t));
+  if (!steps)
+    err (EXIT_FAILURE, "error: cannot allocate streams");
+
+  printf ("%-10s %-14s %10s %10s %10s %10s\n", "stream", "operation", "ops",
+          "ns/op", "allocs/op", "bytes/op");
+  for (size_t i = 0; i < sizeof (streams) / sizeof (streams[0]); i++)
+    {
+      streams[i].make (steps, n);
+      bench_stream (streams[i].name, steps, n);
+    }
+
+  free (steps);
+  return EXIT_SUCCESS;
+}
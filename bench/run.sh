@@ -0,0 +1,86 @@
+#!/bin/sh
+#
+# Trace each workload with each backend, and report the throughput of the
+# tracker against the one stored in baseline.txt (if any).
+#
+# Usage: ./run.sh ITERS
+#
+# The results are written to results.txt, 'make bench-baseline' (or 'make
+# baseline' here) copies it to baseline.txt to make it the reference of the
+# next runs.
+
+ITERS=${1:-100000}
+DEPTH=1000
+
+# Workloads: a name, then the command line traced
+WORKLOADS="loop:./loop $ITERS
+calls:./calls $ITERS $DEPTH
+switch:./switch $ITERS
+true:/bin/true
+ls:/bin/ls -l /"
+
+# Backends: a name, then the options of the tracker
+BACKENDS="ptrace:-b ptrace
+block:-b ptrace -B
+perf:-b perf"
+
+# Get the value of a numeric field of the first JSON line of a file (the
+# run), out of the nested objects
+field ()
+{
+  head -n 1 "$2" | sed -n "s/^{[^{]*\"$1\": \([0-9.]*\).*/\1/p"
+}
+
+# Without a baseline, no regression can show up
+if [ ! -f baseline.txt ]; then
+  echo "run.sh: warning: no baseline.txt, nothing to compare to" \
+       "(run 'make bench-baseline' to store one)" >&2
+fi
+
+rm -f results.txt
+printf "%-8s %-7s %12s %12s %10s %10s %8s\n" \
+       "workload" "backend" "instrs/s" "nodes/s" "bytes/node" "export ms" \
+       "vs base"
+
+echo "$WORKLOADS" | while IFS=: read -r name command; do
+  # Real-world binaries may be missing
+  exec=${command%% *}
+  [ -x "$exec" ] || continue
+  echo "$command" > input_bench.txt
+
+  echo "$BACKENDS" | while IFS=: read -r backend options; do
+    # shellcheck disable=SC2086
+    ./tracker $options -o output_bench.txt -s stats_bench.json \
+              -g graph_bench.gv input_bench.txt >/dev/null 2>&1 || continue
+
+    instrs=$(field instructions stats_bench.json)
+    seconds=$(field seconds stats_bench.json)
+    rss=$(head -n 1 stats_bench.json \
+          | sed -n 's/.*"peak_rss_kib": \([0-9]*\).*/\1/p')
+    export=$(tail -n 1 stats_bench.json \
+             | sed -n 's/.*"export": {"calls": [0-9]*, "seconds": \([0-9.]*\)}.*/\1/p')
+    nodes=$(sed -n 's/^\* #unique instructions: *\([0-9]*\)/\1/p' \
+            output_bench.txt | tail -n 1)
+
+    line=$(awk -v n="$name" -v b="$backend" -v i="$instrs" -v s="$seconds" \
+               -v r="$rss" -v e="$export" -v k="$nodes" 'BEGIN {
+             printf "%-8s %-7s %12.0f %12.0f %10.0f %10.2f", n, b,
+                    (s > 0) ? i / s : 0, (s > 0) ? k / s : 0,
+                    (k > 0) ? r * 1024 / k : 0, e * 1000
+           }')
+    echo "$line" >> results.txt
+
+    # Instructions per second, compared to the baseline
+    base=$(grep "^$name  *$backend " baseline.txt 2>/dev/null \
+           | awk '{ print $3 }')
+    if [ -n "$base" ]; then
+      delta=$(echo "$line" | awk -v b="$base" \
+              '{ printf "%+.1f%%", (b > 0) ? ($3 - b) * 100 / b : 0 }')
+    else
+      delta="-"
+    fi
+    printf "%s %8s\n" "$line" "$delta"
+  done
+done
+
+rm -f input_bench.txt output_bench.txt stats_bench.json graph_bench.gv
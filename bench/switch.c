@@ -0,0 +1,25 @@
+#include <stdlib.h>
+
+/* A case of 256 consecutive ones, each with its own body */
+#define CASE(k) case (k): sum += (k) * 3 + 1; break;
+#define CASE4(k) CASE (k) CASE ((k) + 1) CASE ((k) + 2) CASE ((k) + 3)
+#define CASE16(k) CASE4 (k) CASE4 ((k) + 4) CASE4 ((k) + 8) CASE4 ((k) + 12)
+#define CASE64(k) \
+	CASE16 (k) CASE16 ((k) + 16) CASE16 ((k) + 32) CASE16 ((k) + 48)
+
+/* argv[1] dispatches through a 256 entries switch, in a random order */
+int main (int argc, char *argv[])
+{
+	long n = (argc > 1) ? atol (argv[1]) : 1000000;
+	unsigned int x = 1;
+	volatile long sum = 0;
+	for (long i = 0; i < n; i++)
+		{
+			x = x * 1103515245 + 12345;
+			switch ((x >> 16) & 0xFF)
+				{
+					CASE64 (0) CASE64 (64) CASE64 (128) CASE64 (192)
+				}
+		}
+	return (int) (sum & 1);
+}
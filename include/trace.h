@@ -13,13 +13,23 @@
 #ifndef _TRACE_H
 #define _TRACE_H
 
-#include "../graphviz/cgraph.h"
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stdlib.h>
 
 #define DEFAULT_HASHTABLE_SIZE 65536 /* 2^16 */
 
+/* Number of entries of an edge map (must be a power of 2) */
+#define EDGE_MAP_SIZE 65536 /* 2^16 */
+
+/* Entry of an edge map counting the edge from the instruction at address
+ * from to the one at address to, AFL-style: both directions of an edge
+ * differ, different edges may share an entry */
+#define EDGE_LOC(addr) \
+  ((uint32_t) (((uint64_t) (addr) * 0x9E3779B97F4A7C15ULL) >> 48))
+#define EDGE_INDEX(from, to) \
+  ((EDGE_LOC (to) ^ (EDGE_LOC (from) >> 1)) & (EDGE_MAP_SIZE - 1))
+
 /* A more convenient byte_t type */
 typedef uint8_t byte_t;
 
@@ -44,15 +54,21 @@ typedef struct _hashtable_t hashtable_t;
 /* ***** cfg nodes keeping track of the executions ***** */
 typedef struct _cfg_t cfg_t;
 
-/* ***** Linked list to store a trace, a stack or a queue ***** */
+/* ***** Linked list to store a queue ***** */
 typedef struct _list_t list_t;
 
-typedef struct _list_t trace_t;
+/* A trace, as the ids of the nodes it runs through */
+typedef struct _trace_t trace_t;
 
-typedef struct _list_t stack_t;
+/* Named after the call stack it models (stack_t belongs to <signal.h>) */
+typedef struct _callstack_t callstack_t;
 
 /* ***** instr_t functions ***** */
 
+/* Return the type of the instruction made of the given opcodes (size bytes
+ * at most are read, prefixes are skipped) */
+instr_type_t instr_classify (const uint8_t size, const uint8_t *opcodes);
+
 /* Return a new instr_t struct, NULL otherwise (and set errno) */
 instr_t *instr_new (const uintptr_t addr, const uint8_t size,
                     const uint8_t *opcodes);
@@ -69,16 +85,21 @@ size_t instr_get_size (const instr_t *instr);
 /* Get a pointer to the opcodes of the instruction */
 uint8_t * instr_get_opcodes (const instr_t *instr);
 
+/* Get the type of the instruction */
+instr_type_t instr_get_type (const instr_t *instr);
+
 
 /* ***** hashtable_t functions ***** */
 
 /* Return an hash index for the instruction */
 uint64_t hash_instr (const instr_t *instr);
 
-/* Initialize a new hashtable of given size, returns NULL is size == 0 */
+/* Initialize a new hashtable of (at least) given size, split in shards that
+ * grow when they are 7/8 full. Returns NULL is size == 0. The hashtable and
+ * the cfg it holds may be updated by several threads at once */
 hashtable_t *hashtable_new (const size_t size);
 
-/* Free the given hashtable */
+/* Free the given hashtable, along with all the nodes inserted in it */
 void hashtable_delete (hashtable_t *ht);
 
 /* Insert the instruction in the hashtable */
@@ -87,12 +108,41 @@ bool hashtable_insert (hashtable_t *ht, cfg_t *cfg);
 /* Look-up if current instruction is already in the hashtable */
 cfg_t *hashtable_lookup (hashtable_t *ht, instr_t *instr);
 
+/* Get the node of the hashtable with the given id */
+cfg_t *hashtable_get_node (hashtable_t *ht, uint32_t id);
+
+/* Get the list of the entries of the functions of the cfg, in the order
+ * they were found (the first node created is the first one) */
+list_t *hashtable_get_entries (hashtable_t *ht);
+
+/* Append CFG to the entries of the functions of the cfg, returns false if
+ * an error occured */
+bool hashtable_add_entry (hashtable_t *ht, cfg_t *CFG);
+
+/* Call fn on every node of the hashtable, with data. No node may be
+ * inserted meanwhile */
+void hashtable_foreach (hashtable_t *ht, void (*fn) (cfg_t *, void *),
+                        void *data);
+
+/* Get the edge map of the cfg: the number of times each edge was taken,
+ * saturating at UINT8_MAX, at EDGE_INDEX (from, to). Every edge stored or
+ * taken in the cfg is counted there, returns reach it from the return
+ * instruction (as in the trace). An entry at 0 means an edge is new */
+const uint8_t *hashtable_get_edge_map (hashtable_t *ht);
+
 /* Count the number of entries in the hashtable */
 size_t hashtable_entries (hashtable_t *ht);
 
 /* Count the number of collisions in the hashtable */
 size_t hashtable_collisions (hashtable_t *ht);
 
+/* Get the current number of slots of the hashtable */
+size_t hashtable_size (hashtable_t *ht);
+
+/* Get the longest probe sequence (in groups of slots) to find an entry, and
+ * the mean one in mean (if not NULL) */
+size_t hashtable_probe_length (hashtable_t *ht, double *mean);
+
 /* ***** list_t functions ***** */
 
 /* Return a new list_t struct, NULL otherwise */
@@ -108,59 +158,92 @@ list_t *list_insert_after (list_t *l, void *d);
 void list_delete (list_t *l);
 
 /* Return the data from the element at index i in the list */
-void *list_get_ith (list_t *l, unsigned int i);
+void *list_get_ith (list_t *l, size_t i);
 
 /* Return the number of element in a list */
-uint16_t list_get_size (list_t *l);
+size_t list_get_size (list_t *l);
+
+/* Return the data of the first element of the list */
+void *list_get_data (list_t *l);
+
+/* Return the element following the first one, NULL if there is none */
+list_t *list_get_next (list_t *l);
 
 /* ***** trace_t functions ***** */
 
-/* Creates a trace and initialize it with ins
+/* Creates an empty trace
 Returns a pointer to the created trace, or NULL if an error occured */
-trace_t *trace_new (instr_t *ins);
+trace_t *trace_new (void);
+
+/* Append the id of a node (cfg_get_id) to the trace t
+Returns false if an error occured */
+bool trace_append (trace_t *t, uint32_t id);
+
+/* Get the number of ids in the trace t */
+size_t trace_get_size (const trace_t *t);
 
-/* Creates an element initialized with ins and insert it after t
-Returns a pointer to the created element or NULL if an error occured */
-trace_t *trace_insert (trace_t *t, instr_t *ins);
+/* Get the ids of the trace t, stored in a row */
+const uint32_t *trace_get_ids (const trace_t *t);
 
-/* Free every element in the trace t */
+/* Free the trace t */
 void trace_delete (trace_t *t);
 
-/* Returns a pointer to the first element where t2 differs from t1 */
-trace_t *trace_compare (trace_t *t1, trace_t *t2);
+/* Returns the length of the longest common prefix of t1 and t2, which is
+the index of the first id where t2 differs from t1 */
+size_t trace_compare (const trace_t *t1, const trace_t *t2);
+
+/* Returns the hash of a trace hashing to hash, followed by id (with
+fasthash64). The hash of the empty trace is 0 */
+uint64_t trace_hash (uint64_t hash, uint32_t id);
+
+/* ***** callstack_t functions ***** */
+
+/* Return a new empty callstack_t struct, NULL otherwise */
+callstack_t *stack_new (void);
 
-/* ***** stack_t functions ***** */
+/* Push a new element on top of the stack, returns false otherwise */
+bool stack_push (callstack_t *s, void *d);
 
-/* Return a new stack_t struct, NULL otherwise */
-stack_t *stack_new (void *d);
+/* Pop the top of the stack and return it (NULL if the stack is empty) */
+void *stack_pop (callstack_t *s);
 
-/* Push a new element on top of the stack and return a pointer to it */
-stack_t *stack_push (stack_t *s, void *d);
+/* Get the element on top of the stack (NULL if the stack is empty) */
+void *stack_get_top (const callstack_t *s);
 
-/* Pop the top of the stack a return a pointer to the new top */
-stack_t *stack_pop (stack_t *s);
+/* Get the number of elements in the stack */
+size_t stack_get_size (const callstack_t *s);
 
-/* Get the element on top of the stack */
-void *stack_get_top (stack_t *s);
+/* Remove all the elements of the stack */
+void stack_clear (callstack_t *s);
 
 /* Free the stack */
-void stack_delete (stack_t *s);
+void stack_delete (callstack_t *s);
 
 /* ***** cfg_t functions ***** */
 
-/* Creates a cfg and it with hash_index
-Returns a pointer to the created trace, or NULL if an error occured */
-cfg_t *cfg_new (hashtable_t *ht, instr_t *ins, char *str, list_t **tail_entries);
+/* Get the node of ins in ht, it is created (and allocated in the arena of ht)
+if it is not there yet, without any link. ins is moved there or freed
+Returns a pointer to the node, or NULL if an error occured */
+cfg_t *cfg_new (hashtable_t *ht, instr_t *ins);
 
 /* Auxiliary function for cfg_insert */
-cfg_t *aux_cfg_insert (cfg_t *CFG, cfg_t *new, stack_t **stack);
+cfg_t *aux_cfg_insert (hashtable_t *ht, cfg_t *CFG, cfg_t *new,
+                       callstack_t *stack);
 
 /* Creates an element initialized with ins and insert it in CFG's succesors
 Returns a pointer to the created element or NULL if an error occured*/
-cfg_t *cfg_insert (hashtable_t *ht, cfg_t *CFG, instr_t *ins, char *str, stack_t **stack, list_t **tail_entries, uint16_t *nb_function);
+cfg_t *cfg_insert (hashtable_t *ht, cfg_t *CFG, instr_t *ins,
+                   callstack_t *stack);
+
+/* Link CFG to new, a node already in the cfg, as cfg_insert does when it
+finds ins in the hashtable. Returns new or NULL if an error occured */
+cfg_t *cfg_link (hashtable_t *ht, cfg_t *CFG, cfg_t *new,
+                 callstack_t *stack);
 
-/* Free every allocated field of CFG, as well as CFG itself */
-void cfg_delete (cfg_t *CFG);
+/* Link CFG, a call whose callee was not traced, to new, the instruction it
+returns to, as if the callee returned there. Returns new or NULL if an error
+occured */
+cfg_t *cfg_link_return (hashtable_t *ht, cfg_t *CFG, cfg_t *new);
 
 /* Get the instruction in CFG */
 instr_t *cfg_get_instr (cfg_t *CFG);
@@ -177,22 +260,26 @@ instr_type_t cfg_get_type (cfg_t *CFG);
 /* Get the index of the function CFG is in */
 uint16_t cfg_get_name (cfg_t *CFG);
 
-/* Get a pointer array of every successor of CFG */
-cfg_t **cfg_get_successor (cfg_t *CFG);
-
 /* Get a pointer to successor number i of CFG */
 cfg_t *cfg_get_successor_i (cfg_t *CFG, uint16_t i);
 
-/* Get the total number of functions */
-size_t get_nb_name (void);
+/* Get the number of times the edge to successor number i of CFG was taken */
+uint32_t cfg_get_hits_i (cfg_t *CFG, uint16_t i);
+
+/* Get the number of times CFG was executed, by all the runs */
+uint64_t cfg_get_hits (cfg_t *CFG);
+
+/* Count one more execution of CFG */
+void cfg_hit (cfg_t *CFG);
 
-/* Get the str with the address, the opcodes, the mnemonics and the operands */
-char *cfg_get_str (cfg_t *CFG);
+/* Set the index of the function CFG is in */
+void cfg_set_name (cfg_t *CFG, uint16_t name);
 
-/* Get a pointer to the first node in the function number index */
-cfg_t *get_function_entry (size_t index);
+/* Add hits to the edge from CFG to new, which is created if needed whatever
+the type of CFG. Returns false if an error occured */
+bool cfg_add_edge (hashtable_t *ht, cfg_t *CFG, cfg_t *new, uint32_t hits);
 
-/* Adds the very first node to function_entry */
-void add_first_entry (cfg_t *CFG);
+/* Get the id of CFG, unique among the nodes of its hashtable */
+uint32_t cfg_get_id (cfg_t *CFG);
 
 #endif /* _TRACE_H */
@@ -0,0 +1,1239 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#define _GNU_SOURCE
+
+#include "backend.h"
+#include "inject.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <err.h>
+
+#include <linux/perf_event.h>
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+
+/* Get current instruction pointer address */
+static uintptr_t
+get_current_ip (struct user_regs_struct *regs)
+{
+#if defined(__x86_64__) /* amd64 architecture */
+      return regs->rip;
+#elif defined(__i386__) /* i386 architecture */
+      return regs->eip;
+#else
+#error Cannot build, we only support: x86-64 and i386 architectures
+#endif
+}
+
+/* Set current instruction pointer address */
+static void
+set_current_ip (struct user_regs_struct *regs, uintptr_t ip)
+{
+#if defined(__x86_64__) /* amd64 architecture */
+      regs->rip = ip;
+#elif defined(__i386__) /* i386 architecture */
+      regs->eip = ip;
+#endif
+}
+
+void
+fetch_opcodes (tracer_t *tracer, uintptr_t addr, byte_t *buf)
+{
+  /* Most of the time, the snapshot of the mappings has it */
+  if (mem_read (tracer->mem, addr, buf, MAX_OPCODE_BYTES))
+    return;
+
+  for (size_t i = 0; i < MAX_OPCODE_BYTES; i += sizeof (long))
+    {
+      uint64_t start = stats_ticks ();
+      long word = ptrace (PTRACE_PEEKDATA, tracer->child, addr + i, NULL);
+      stats_add (&(tracer->stats), PHASE_PEEK, start);
+      memcpy (&(buf[i]), &word, sizeof (long));
+    }
+}
+
+/* Get the registers of the (stopped) child of tracer */
+static void
+get_regs (tracer_t *tracer, struct user_regs_struct *regs)
+{
+  uint64_t start = stats_ticks ();
+  ptrace (PTRACE_GETREGS, tracer->child, NULL, regs);
+  stats_add (&(tracer->stats), PHASE_GETREGS, start);
+}
+
+/* Handle the stop of the current thread of tracer on a ptrace event (with
+ * status), the threads and processes it creates are followed. It is stepped
+ * again afterwards */
+static void
+follow_event (tracer_t *tracer, int status)
+{
+  int event = status >> 16;
+  unsigned long pid;
+  if ((event == PTRACE_EVENT_CLONE || event == PTRACE_EVENT_FORK
+       || event == PTRACE_EVENT_VFORK)
+      && ptrace (PTRACE_GETEVENTMSG, tracer->child, NULL, &pid) != -1
+      && !tracer_attach (tracer, pid))
+    warn ("warning: cannot follow thread %lu", pid);
+  ptrace (PTRACE_SINGLESTEP, tracer->child, NULL, 0);
+}
+
+/* Resume the current thread of tracer with request (and signal sig), and
+ * wait for a thread of the run to stop, it becomes the current one (the
+ * others keep running meanwhile). The threads and processes created are
+ * followed without the caller noticing. Returns the status of the thread,
+ * an exit only once the last one exited */
+static int
+resume (tracer_t *tracer, enum __ptrace_request request, int sig)
+{
+  int status;
+  uint64_t start = stats_ticks ();
+
+  /* Note that, sometimes, ptrace(PTRACE_SINGLESTEP) returns '-1'
+   * to notify that the child process did not respond quick enough,
+   * we have to wait for ptrace() to return '0'. */
+  while (ptrace (request, tracer->child, NULL, sig) && errno != ESRCH
+         && request == PTRACE_SINGLESTEP);
+  while (true)
+    {
+      /* Tracees of the other workers are never waited for here */
+      pid_t pid = waitpid (-1, &status, __WALL | __WNOTHREAD);
+      if (pid == -1)
+        {
+          status = 0;
+          break;
+        }
+
+      /* Most of the time, the child has a single thread */
+      if (pid == tracer->child && tracer->nb_alive == 1 && !(status >> 16))
+        break;
+
+      /* A new thread may stop before its creation is reported */
+      if (!tracer_switch (tracer, pid))
+        {
+          if (!WIFSTOPPED (status))
+            continue;
+          if (!tracer_attach (tracer, pid) || !tracer_switch (tracer, pid))
+            {
+              warn ("warning: cannot follow thread %d", (int) pid);
+              ptrace (PTRACE_DETACH, pid, NULL, 0);
+              continue;
+            }
+        }
+
+      if (WIFEXITED (status) || WIFSIGNALED (status))
+        {
+          tracer_detach (tracer);
+          if (tracer->nb_alive == 0)
+            break;
+          continue;
+        }
+      if (status >> 16)
+        {
+          follow_event (tracer, status);
+          continue;
+        }
+
+      /* The first stop of a new thread, before it runs anything */
+      thread_t *thread = &(tracer->threads[tracer->current]);
+      if (!thread->started && WSTOPSIG (status) == SIGSTOP)
+        {
+          thread->started = true;
+          status = W_STOPCODE (SIGTRAP);
+        }
+      break;
+    }
+  stats_add (&(tracer->stats), PHASE_WAIT, start);
+  return status;
+}
+
+/* ***** ptrace backend ***** */
+
+/* Maximum number of instructions run at once in block mode */
+#define MAX_BLOCK_LEN 64
+
+/* Functions of the stepping loop taking the architecture of the child
+ * (wide: x86-64, or else i386), always inlined so that each copy of the
+ * loop is compiled for its own architecture (see ptrace_run) */
+#define ARCH_INLINE static inline __attribute__ ((always_inline))
+
+/* Check if the instruction may not fall through to the next one: control
+ * transfers, but also anything entering the kernel (the child may exit or
+ * exec there). A rep string instruction ends a block as well: stepping
+ * records each of its iterations, the breakpoint would record it once */
+ARCH_INLINE bool
+is_block_end (const decoded_t *insn, const bool wide)
+{
+  if (insn->type != BASIC)
+    return true;
+
+  /* Skip legacy prefixes, and REX prefixes (inc and dec in i386) */
+  const uint8_t size = insn->size;
+  const byte_t *opcodes = insn->opcodes;
+  uint8_t i = 0;
+  bool rep = false;
+  while (i < size - 1
+         && (opcodes[i] == 0x66 || opcodes[i] == 0x67 || opcodes[i] == 0xF0
+             || opcodes[i] == 0xF2 || opcodes[i] == 0xF3
+             || opcodes[i] == 0x2E || opcodes[i] == 0x36 || opcodes[i] == 0x3E
+             || opcodes[i] == 0x26 || opcodes[i] == 0x64 || opcodes[i] == 0x65
+             || (wide && (opcodes[i] & 0xF0) == 0x40)))
+    {
+      rep = rep || opcodes[i] == 0xF2 || opcodes[i] == 0xF3;
+      i++;
+    }
+
+  switch (opcodes[i])
+    {
+    case 0x6C: case 0x6D:       /* ins */
+    case 0x6E: case 0x6F:       /* outs */
+    case 0xA4: case 0xA5:       /* movs */
+    case 0xA6: case 0xA7:       /* cmps */
+    case 0xAA: case 0xAB:       /* stos */
+    case 0xAC: case 0xAD:       /* lods */
+    case 0xAE: case 0xAF:       /* scas */
+      return rep;
+
+    case 0xCC:          /* int3 */
+    case 0xCD:          /* int imm8 */
+    case 0xCE:          /* into */
+    case 0xCF:          /* iret */
+    case 0xF1:          /* int1 */
+    case 0xF4:          /* hlt */
+      return true;
+
+    case 0x0F:
+      if (i + 1 < size)
+        switch (opcodes[i + 1])
+          {
+          case 0x05:        /* syscall */
+          case 0x07:        /* sysret */
+          case 0x0B:        /* ud2 */
+          case 0x34:        /* sysenter */
+          case 0x35:        /* sysexit */
+            return true;
+          }
+      return false;
+    }
+  return false;
+}
+
+/* Decode the block starting at ip: store the address of each instruction up
+ * to (and including) the one ending the block, returns the number of
+ * instructions */
+ARCH_INLINE size_t
+decode_block (tracer_t *tracer, uintptr_t ip, uintptr_t *block_ip,
+              const bool wide)
+{
+  size_t n = 0;
+
+  while (n < MAX_BLOCK_LEN)
+    {
+      block_ip[n++] = ip;
+      const decoded_t *insn = tracer_decode (tracer, ip);
+      if (!insn || is_block_end (insn, wide))
+        break;
+      ip += insn->size;
+    }
+  return n;
+}
+
+/* Get the number of the system call the child is about to make */
+static inline long
+get_syscall_nr (struct user_regs_struct *regs)
+{
+#if defined(__x86_64__) /* amd64 architecture */
+      return regs->rax;
+#elif defined(__i386__) /* i386 architecture */
+      return regs->eax;
+#else
+#error Cannot build, we only support: x86-64 and i386 architectures
+#endif
+}
+
+/* Numbers of the system calls of i386 that may change the code mapped */
+#define I386_SYS_EXECVE 11
+#define I386_SYS_MMAP 90
+#define I386_SYS_MUNMAP 91
+#define I386_SYS_IPC 117
+#define I386_SYS_MPROTECT 125
+#define I386_SYS_MREMAP 163
+#define I386_SYS_MMAP2 192
+#define I386_SYS_REMAP_FILE_PAGES 257
+#define I386_SYS_PKEY_MPROTECT 380
+#define I386_SYS_SHMAT 397
+
+/* Check if the system call nr of i386 (int 0x80 or sysenter, even in a
+ * 64-bit child) may change the code mapped */
+static inline bool
+is_remap_nr_32 (long nr)
+{
+  switch (nr)
+    {
+    case I386_SYS_EXECVE:
+    case I386_SYS_MMAP:
+    case I386_SYS_MUNMAP:
+    case I386_SYS_IPC:
+    case I386_SYS_MPROTECT:
+    case I386_SYS_MREMAP:
+    case I386_SYS_MMAP2:
+    case I386_SYS_REMAP_FILE_PAGES:
+    case I386_SYS_PKEY_MPROTECT:
+    case I386_SYS_SHMAT:
+      return true;
+    }
+  return false;
+}
+
+/* Check if the system call nr of x86-64 (syscall) may change the code
+ * mapped */
+static inline bool
+is_remap_nr_64 (long nr)
+{
+#if defined(__x86_64__)
+  switch (nr)
+    {
+    case SYS_mmap:
+    case SYS_shmat:
+#ifdef SYS_pkey_mprotect
+    case SYS_pkey_mprotect:
+#endif
+    case SYS_mprotect:
+    case SYS_munmap:
+    case SYS_mremap:
+    case SYS_remap_file_pages:
+    case SYS_execve:
+      return true;
+    }
+  return false;
+#else
+  /* No 64-bit child on a 32-bit host */
+  (void) nr;
+  return true;
+#endif
+}
+
+/* Check if the instruction of opcodes is a system call that may change the
+ * code mapped in the child, regs being the registers right before it runs */
+ARCH_INLINE bool
+is_remap_syscall (const byte_t *opcodes, struct user_regs_struct *regs,
+                  const bool wide)
+{
+  /* syscall has the numbering of the code running it, int 0x80 and
+   * sysenter always the one of i386 (none of them takes a prefix) */
+  if (opcodes[0] == 0x0F && opcodes[1] == 0x05)
+    return wide ? is_remap_nr_64 (get_syscall_nr (regs))
+      : is_remap_nr_32 (get_syscall_nr (regs));
+  if ((opcodes[0] == 0xCD && opcodes[1] == 0x80)
+      || (opcodes[0] == 0x0F && opcodes[1] == 0x34))
+    return is_remap_nr_32 (get_syscall_nr (regs));
+  return false;
+}
+
+/* Move the hardware breakpoint (DR0) of the child to addr, or disable it when
+ * addr is 0. armed holds the current address of the breakpoint */
+static bool
+set_breakpoint (pid_t child, uintptr_t *armed, uintptr_t addr)
+{
+  if (addr && ptrace (PTRACE_POKEUSER, child,
+                      offsetof (struct user, u_debugreg[0]), addr) == -1)
+    return false;
+
+  /* DR7: local enable of DR0, break on execution */
+  if ((!addr || !*armed)
+      && ptrace (PTRACE_POKEUSER, child,
+                 offsetof (struct user, u_debugreg[7]), addr ? 1 : 0) == -1)
+    return false;
+
+  *armed = addr;
+  return true;
+}
+
+/* Let the child run the block decoded in block_ip up to the breakpoint set
+ * on the last instruction, then record the instructions run before it. sig
+ * is the signal delivered as it resumes (or 0), it gets the one stopping it
+ * in the block, if any. Returns false if the child is gone */
+static bool
+ptrace_run_block (tracer_t *tracer, size_t n, uintptr_t *block_ip, bool *hit,
+                  int *sig)
+{
+  struct user_regs_struct regs;
+
+  int status = resume (tracer, PTRACE_CONT, *sig);
+  if (WIFEXITED (status) || WIFSIGNALED (status))
+    return false;
+
+  /* The signal is delivered as the child resumes from where it stopped */
+  int stop_sig = WSTOPSIG (status);
+  *sig = (stop_sig == SIGTRAP || stop_sig == SIGSTOP) ? 0 : stop_sig;
+
+  /* Either the breakpoint or a signal stopped the child somewhere in the
+   * block, what comes before has been executed */
+  get_regs (tracer, &regs);
+  uintptr_t stop = get_current_ip (&regs);
+
+  size_t k = 0;
+  while (k < n && block_ip[k] != stop)
+    k++;
+  if (k == n)
+    {
+      tracer_resync (tracer);
+      k = 0;
+    }
+
+  for (size_t i = 0; i < k; i++)
+    tracer_step (tracer, block_ip[i]);
+  *hit = (k == n - 1 && stop_sig == SIGTRAP);
+  return true;
+}
+
+/* A run of pages holding code traced. They are not executable while the
+ * child runs code that is not traced, to get it back as soon as it runs
+ * traced code again (a return, a callback...) */
+typedef struct
+{
+  uintptr_t start;          /* First address of the pages */
+  uintptr_t end;            /* Address following the pages */
+  int prot;                 /* Protection of the pages */
+} guard_t;
+
+/* Guards of the mappings of a child */
+typedef struct
+{
+  guard_t *guards;          /* Runs of pages, by address */
+  size_t nb_guards;         /* Number of runs */
+  size_t max_guards;        /* Allocated size of guards */
+  uint32_t epoch;           /* Epoch of the tracer they were computed in */
+  uintptr_t exec;           /* Executable address to inject system calls */
+} guards_t;
+
+/* Compute the guards of the mappings of the child, if they may have
+ * changed. Returns false if there are none: with several threads, as the
+ * other ones would run into the guards of the current one */
+static bool
+guards_update (tracer_t *tracer, guards_t *g)
+{
+  if (tracer->nb_alive > 1)
+    return false;
+  if (g->epoch == tracer->epoch)
+    return g->nb_guards > 0;
+  g->epoch = tracer->epoch;
+  g->nb_guards = 0;
+
+  const mem_t *mem = tracer->mem;
+  for (size_t i = 0; mem && i < mem->nb_regions; i++)
+    {
+      const region_t *r = &(mem->regions[i]);
+      if (r->path && !strcmp (r->path, "[vsyscall]"))
+        continue;
+
+      bool open = false;
+      for (uintptr_t page = r->start; page < r->end; page += mem->page_size)
+        {
+          if (!filter_overlap (tracer->filter, page, page + mem->page_size,
+                               r->path, tracer->text_start, tracer->text_end))
+            {
+              open = false;
+              continue;
+            }
+          if (open)
+            {
+              g->guards[g->nb_guards - 1].end = page + mem->page_size;
+              continue;
+            }
+
+          if (g->nb_guards == g->max_guards)
+            {
+              size_t max = g->max_guards ? 2 * g->max_guards : 16;
+              guard_t *guards = realloc (g->guards, max * sizeof (guard_t));
+              if (!guards)
+                {
+                  g->nb_guards = 0;
+                  return false;
+                }
+              g->guards = guards;
+              g->max_guards = max;
+            }
+          g->guards[g->nb_guards++] = (guard_t) { page, page + mem->page_size,
+            PROT_READ | PROT_EXEC | (r->writable ? PROT_WRITE : 0) };
+          open = true;
+        }
+    }
+  return g->nb_guards > 0;
+}
+
+/* Tell if addr is in the guarded pages */
+static bool
+guards_find (const guards_t *g, uintptr_t addr)
+{
+  for (size_t i = 0; i < g->nb_guards; i++)
+    if (addr >= g->guards[i].start && addr < g->guards[i].end)
+      return true;
+  return false;
+}
+
+/* Make the guarded pages executable again (or not, if on), with system
+ * calls injected at g->exec. Returns false if some cannot be changed */
+static bool
+guards_set (tracer_t *tracer, guards_t *g, struct user_regs_struct *regs,
+            bool on)
+{
+  bool wide = (tracer->arch == x86_64_arch);
+  struct user_regs_struct at = *regs;
+  set_current_ip (&at, g->exec);
+
+  for (size_t i = 0; i < g->nb_guards; i++)
+    {
+      guard_t *guard = &(g->guards[i]);
+      long args[6] = { guard->start, guard->end - guard->start,
+                       on ? guard->prot & ~PROT_EXEC : guard->prot, 0, 0, 0 };
+      if (inject_syscall (tracer->child, &at, wide,
+                          wide ? SYS_mprotect : I386_SYS_MPROTECT, args,
+                          NULL) == -1)
+        {
+          /* Leave every page as it was */
+          if (on)
+            {
+              g->nb_guards = i;
+              guards_set (tracer, g, regs, false);
+              g->epoch = 0;
+            }
+          return false;
+        }
+    }
+  ptrace (PTRACE_SETREGS, tracer->child, NULL, regs);
+  return true;
+}
+
+/* Tell if the current thread of tracer stopped on a SIGSEGV executing the
+ * guarded pages at ip: its process was forked while they were guarded, it
+ * got its own copy of the guards */
+static bool
+guards_fault (tracer_t *tracer, const guards_t *g, uintptr_t ip)
+{
+  siginfo_t info;
+  return g && guards_find (g, ip)
+    && ptrace (PTRACE_GETSIGINFO, tracer->child, NULL, &info) != -1
+    && info.si_code == SEGV_ACCERR && (uintptr_t) info.si_addr == ip;
+}
+
+/* Step the child over one instruction, g being the guards of the run (or
+ * NULL) and sig a signal delivered as it resumes (or 0). Returns false if
+ * it is gone */
+static bool
+ptrace_step (tracer_t *tracer, guards_t *g, int sig)
+{
+  struct user_regs_struct regs;
+  bool lifted = false;
+  int status = resume (tracer, PTRACE_SINGLESTEP, sig);
+
+  /* A signal (SIGCHLD from a process followed, often) stops the thread
+   * before its instruction runs: it is delivered as it is stepped again,
+   * rather than the instruction being recorded twice */
+  while (WIFSTOPPED (status) && WSTOPSIG (status) != SIGTRAP)
+    {
+      sig = WSTOPSIG (status);
+
+      /* The guards of a forked process are lifted, once */
+      if (sig == SIGSEGV && !lifted)
+        {
+          get_regs (tracer, &regs);
+          if (guards_fault (tracer, g, get_current_ip (&regs)))
+            {
+              guards_set (tracer, g, &regs, false);
+              lifted = true;
+              sig = 0;
+            }
+        }
+      status = resume (tracer, PTRACE_SINGLESTEP, sig == SIGSTOP ? 0 : sig);
+    }
+  return !(WIFEXITED (status) || WIFSIGNALED (status));
+}
+
+/* Let the child run the code out of the ranges traced, up to an instruction
+ * traced. It runs at full speed with the traced code guarded, except in the
+ * guarded pages themselves (a PLT next to the code, for instance) where it
+ * is stepped, sig being a signal delivered as it resumes (or 0). Returns
+ * false if the child is gone */
+static bool
+ptrace_skip (tracer_t *tracer, guards_t *g, int sig)
+{
+  struct user_regs_struct regs;
+  int status;
+
+  /* Step up to code out of the guarded pages */
+  bool guarded = guards_update (tracer, g);
+  while (true)
+    {
+      get_regs (tracer, &regs);
+      uintptr_t ip = get_current_ip (&regs);
+      if (tracer_traced (tracer, ip))
+        return true;
+      if (!guarded || !guards_find (g, ip))
+        break;
+      if (!ptrace_step (tracer, g, sig))
+        return false;
+      sig = 0;
+    }
+
+  g->exec = get_current_ip (&regs);
+  if (!guarded || !guards_set (tracer, g, &regs, true))
+    return ptrace_step (tracer, g, sig);
+
+  /* Until the child runs guarded code */
+  while (true)
+    {
+      status = resume (tracer, PTRACE_CONT, sig);
+      if (WIFEXITED (status) || WIFSIGNALED (status))
+        return false;
+
+      /* A new thread: the code is not guarded anymore, all of them are
+       * stepped from now on. A forked process keeps its copy of the guards
+       * until it runs into them (see ptrace_step) */
+      if (tracer->nb_alive > 1)
+        {
+          get_regs (tracer, &regs);
+          guards_set (tracer, g, &regs, false);
+          g->epoch = 0;
+          return true;
+        }
+
+      /* Forward the signals to the child */
+      sig = WSTOPSIG (status);
+      if (sig == SIGTRAP)
+        sig = 0;
+      if (sig != SIGSEGV)
+        continue;
+      get_regs (tracer, &regs);
+      if (guards_find (g, get_current_ip (&regs)))
+        break;
+    }
+
+  guards_set (tracer, g, &regs, false);
+  return true;
+}
+
+/* Kill the processes of the run of tracer, and wait for all their threads */
+static void
+ptrace_kill (tracer_t *tracer)
+{
+  for (size_t i = 0; i < tracer->nb_threads; i++)
+    if (tracer->threads[i].pid)
+      kill (tracer->threads[i].pid, SIGKILL);
+
+  while (tracer->nb_alive > 0)
+    {
+      int status;
+      pid_t pid = waitpid (-1, &status, __WALL | __WNOTHREAD);
+      if (pid == -1)
+        break;
+      if ((WIFEXITED (status) || WIFSIGNALED (status))
+          && tracer_switch (tracer, pid))
+        tracer_detach (tracer);
+    }
+}
+
+/* Number of steps captured ahead of the ones recorded, at most (must be a
+ * power of 2) */
+#define PIPELINE_STEPS 16384 /* 2^14 */
+
+/* A step of the child, as captured while it is stopped */
+typedef struct
+{
+  uintptr_t ip;             /* Address of the instruction */
+  byte_t opcodes[MAX_OPCODE_BYTES]; /* Opcodes read at ip */
+} capture_t;
+
+/* The thread recording the steps captured in the ring of tracer */
+typedef struct
+{
+  tracer_t *tracer;         /* Tracer the steps are recorded in */
+  bool stop;                /* The run is given up, set by the thread */
+} pipeline_t;
+
+/* Record the steps of the ring, up to the one the run is given up at */
+static void *
+pipeline_record (void *arg)
+{
+  pipeline_t *p = arg;
+  tracer_t *tracer = p->tracer;
+  const capture_t *c;
+  while ((c = ring_peek (tracer->ring)))
+    {
+      /* The steps captured after it are not part of the run */
+      if (!p->stop)
+        {
+          tracer_step_opcodes (tracer, c->ip, c->opcodes);
+          if ((tracer->max_count && tracer->instr_count >= tracer->max_count)
+              || tracer->ahead.trace)
+            __atomic_store_n (&(p->stop), true, __ATOMIC_RELEASE);
+        }
+      ring_release (tracer->ring);
+    }
+  return NULL;
+}
+
+/* Trace the child of tracer as long as it has a single thread, the steps
+ * are captured here but recorded by another thread: the child runs the
+ * next one meanwhile. Every step is recorded before the code may change,
+ * or a thread come up. Returns true once the run is over, false if it goes
+ * on in lockstep (or if no thread can be started) */
+ARCH_INLINE bool
+ptrace_pipeline (tracer_t *tracer, const bool wide)
+{
+  struct user_regs_struct regs;
+  pipeline_t p = { tracer, false };
+  pthread_t thread;
+
+  tracer->ring = ring_new (PIPELINE_STEPS, sizeof (capture_t));
+  if (!tracer->ring
+      || pthread_create (&thread, NULL, pipeline_record, &p))
+    {
+      warnx ("warning: cannot start the pipeline, recording in lockstep");
+      ring_delete (tracer->ring);
+      tracer->ring = NULL;
+      return false;
+    }
+
+  /* Steps are counted as they are captured, the thread counts them again */
+  size_t count = tracer->instr_count;
+  bool over = false;
+  while (tracer->nb_alive == 1)
+    {
+      if ((tracer->max_count && count >= tracer->max_count)
+          || __atomic_load_n (&(p.stop), __ATOMIC_ACQUIRE))
+        {
+          ring_drain (tracer->ring);
+          ptrace_kill (tracer);
+          over = true;
+          break;
+        }
+
+      /* Capture the instruction, and let the child run it */
+      get_regs (tracer, &regs);
+      capture_t *c = ring_reserve (tracer->ring);
+      c->ip = get_current_ip (&regs);
+      fetch_opcodes (tracer, c->ip, c->opcodes);
+      bool remap = is_remap_syscall (c->opcodes, &regs, wide);
+      ring_commit (tracer->ring);
+      count++;
+
+      if (!ptrace_step (tracer, NULL, 0))
+        {
+          over = true;
+          break;
+        }
+
+      /* The cache is not checked against the code anymore */
+      if (remap)
+        {
+          ring_drain (tracer->ring);
+          tracer_invalidate (tracer);
+        }
+    }
+
+  ring_close (tracer->ring);
+  pthread_join (thread, NULL);
+  ring_delete (tracer->ring);
+  tracer->ring = NULL;
+  return over;
+}
+
+/* Trace the child of tracer, of the architecture given by wide */
+ARCH_INLINE bool
+ptrace_run_arch (tracer_t *tracer, const bool wide)
+{
+  struct user_regs_struct regs;
+
+  uintptr_t block_ip[MAX_BLOCK_LEN];
+  uintptr_t armed = 0;  /* Address of the hardware breakpoint */
+  pid_t owner = 0;      /* Thread the breakpoint is set in */
+  bool hit = false;     /* Child stopped on the breakpoint */
+  int sig = 0;          /* Signal stopping the child in a block */
+  guards_t guards = { 0 };
+
+  /* Threads and processes created by the child are traced as well */
+  if (ptrace (PTRACE_SETOPTIONS, tracer->child, NULL,
+              PTRACE_O_TRACECLONE | PTRACE_O_TRACEFORK | PTRACE_O_TRACEVFORK
+              | PTRACE_O_EXITKILL) == -1)
+    warn ("warning: cannot follow the threads of the child");
+
+  /* Blocks and ranges look at the code as the child stops, the pipeline
+   * records it later (-P) */
+  if (tracer->pipeline && !tracer->block && !tracer->filter
+      && ptrace_pipeline (tracer, wide))
+    return true;
+
+  while (true)
+    {
+      /* Runs that are too long, or along a known path, are given up */
+      if ((tracer->max_count && tracer->instr_count >= tracer->max_count)
+          || tracer->ahead.trace)
+        {
+          ptrace_kill (tracer);
+          break;
+        }
+
+      /* Get instruction pointer */
+      get_regs (tracer, &regs);
+      uintptr_t ip = get_current_ip (&regs);
+
+      /* Code out of the ranges traced is run, not recorded */
+      if (tracer->filter && !tracer_traced (tracer, ip))
+        {
+          if (armed)
+            set_breakpoint (tracer->child, &armed, 0);
+          tracer_skip (tracer);
+          if (!ptrace_skip (tracer, &guards, sig))
+            break;
+          sig = 0;
+          continue;
+        }
+
+      /* With several threads, one may stop in the block of another one:
+       * they are stepped (the breakpoint is the one of the child) */
+      if (armed && tracer->nb_alive > 1 && tracer->child == owner)
+        set_breakpoint (tracer->child, &armed, 0);
+
+      /* Run to the end of the block at once when it is not reached yet */
+      if (tracer->block && tracer->nb_alive == 1)
+        {
+          size_t n = decode_block (tracer, ip, block_ip, wide);
+          if (n > 1)
+            {
+              if (set_breakpoint (tracer->child, &armed, block_ip[n - 1]))
+                {
+                  owner = tracer->child;
+                  if (!ptrace_run_block (tracer, n, block_ip, &hit, &sig))
+                    break;
+                  continue;
+                }
+              warnx ("warning: cannot set a hardware breakpoint, "
+                     "single-stepping");
+              tracer->block = false;
+            }
+
+          /* An instruction gets trapped by the breakpoint before running
+           * unless it just stopped on it */
+          if (ip == armed && !hit)
+            set_breakpoint (tracer->child, &armed, 0);
+          hit = false;
+        }
+
+      /* Record the instruction, its opcodes are read only if needed */
+      const decoded_t *insn = tracer_step (tracer, ip);
+      bool remap = (insn && is_remap_syscall (insn->opcodes, &regs, wide));
+
+      /* Continue to next instruction... */
+      if (!ptrace_step (tracer, &guards, sig))
+        break;
+      sig = 0;
+
+      /* The code of the child may not be the one cached anymore */
+      if (remap)
+        tracer_invalidate (tracer);
+    }
+  free (guards.guards);
+  return true;
+}
+
+/* The loop compiled for i386 children */
+static bool
+ptrace_run_32 (tracer_t *tracer)
+{
+  return ptrace_run_arch (tracer, false);
+}
+
+/* The loop compiled for x86-64 children */
+static bool
+ptrace_run_64 (tracer_t *tracer)
+{
+  return ptrace_run_arch (tracer, true);
+}
+
+/* The architecture is known once per run, none of the steps checks it */
+static bool
+ptrace_run (tracer_t *tracer)
+{
+  if (tracer->arch == x86_64_arch)
+    return ptrace_run_64 (tracer);
+  return ptrace_run_32 (tracer);
+}
+
+const backend_t ptrace_backend = { "ptrace", ptrace_run };
+
+/* ***** perf backend ***** */
+
+/* Number of pages of the perf ring buffer (must be a power of 2) */
+#define PERF_DATA_PAGES 512
+
+/* Number of branches between two samples of the branch stack, it has to stay
+ * below the depth of the LBR so that two consecutive samples overlap */
+#define PERF_BRANCH_PERIOD 12
+
+/* Maximum number of instructions between two taken branches */
+#define PERF_MAX_WALK 65536
+
+/* Delay (in ms) between two reads of the ring buffer */
+#define PERF_POLL_DELAY 10
+
+/* Any address above belongs to the kernel */
+#define USER_SPACE_LIMIT 0x800000000000ULL
+
+/* A taken branch, a zeroed branch marks a hole in the stream */
+typedef struct
+{
+  uintptr_t from;
+  uintptr_t to;
+} branch_t;
+
+typedef struct
+{
+  int fd;                             /* perf event */
+  struct perf_event_mmap_page *meta;  /* Head of the ring buffer */
+  byte_t *data;                       /* Ring buffer data */
+  size_t data_size;                   /* Size of the data (power of 2) */
+  branch_t *branches;                 /* Stream of taken branches */
+  size_t nb_branches;                 /* Number of branches in the stream */
+  size_t max_branches;                /* Allocated size of branches */
+  size_t last_hole;                   /* Index following the last hole */
+  byte_t record[UINT16_MAX + 1];      /* Copy of the current record */
+} perf_t;
+
+static void
+perf_push (perf_t *p, uintptr_t from, uintptr_t to)
+{
+  if (p->nb_branches == p->max_branches)
+    {
+      p->max_branches = p->max_branches ? 2 * p->max_branches : 4096;
+      p->branches = realloc (p->branches, p->max_branches * sizeof (branch_t));
+      if (!p->branches)
+        err (EXIT_FAILURE, "error: cannot store the branch stream");
+    }
+  p->branches[p->nb_branches++] = (branch_t) { from, to };
+}
+
+static void
+perf_hole (perf_t *p)
+{
+  if (p->nb_branches == p->last_hole)
+    return;
+  perf_push (p, 0, 0);
+  p->last_hole = p->nb_branches;
+}
+
+/* Append the new branches of a sample to the stream: consecutive samples
+ * overlap, so the suffix of the stream that prefixes the sample is skipped.
+ * At most PERF_BRANCH_PERIOD branches were taken since the previous sample,
+ * and the shortest such overlap is kept: along a loop, every iteration looks
+ * the same and the longest one would drop all the new ones. It is a guess
+ * all the same (not-taken branches are counted in the period, and a sample
+ * can be late), the hit counts of the perf backend are approximate. Without
+ * any overlap, some branches were missed */
+static void
+perf_add_sample (perf_t *p, const struct perf_branch_entry *lbr, uint64_t nr)
+{
+  if (nr == 0)
+    return;
+
+  branch_t sample[nr];
+  size_t n = 0;
+
+  /* The lbr is ordered from the most recent branch to the oldest one */
+  for (uint64_t i = nr; i-- > 0;)
+    if (lbr[i].from && lbr[i].from < USER_SPACE_LIMIT
+        && lbr[i].to < USER_SPACE_LIMIT)
+      sample[n++] = (branch_t) { lbr[i].from, lbr[i].to };
+  if (n == 0)
+    return;
+
+  size_t avail = p->nb_branches - p->last_hole;
+  size_t max = (n < avail) ? n : avail;
+  size_t m = (n > PERF_BRANCH_PERIOD) ? n - PERF_BRANCH_PERIOD : 1;
+  for (; m <= max; m++)
+    if (!memcmp (&(p->branches[p->nb_branches - m]), sample,
+                 m * sizeof (branch_t)))
+      break;
+
+  if (m > max)
+    {
+      perf_hole (p);
+      m = 0;
+    }
+  for (size_t i = m; i < n; i++)
+    perf_push (p, sample[i].from, sample[i].to);
+}
+
+/* Copy len bytes at position pos of the ring buffer in dest */
+static void
+perf_copy (perf_t *p, uint64_t pos, void *dest, size_t len)
+{
+  size_t offset = pos & (p->data_size - 1);
+  size_t chunk = (len < p->data_size - offset) ? len : p->data_size - offset;
+
+  memcpy (dest, p->data + offset, chunk);
+  memcpy ((byte_t *) dest + chunk, p->data, len - chunk);
+}
+
+/* Consume all the records available in the ring buffer */
+static void
+perf_drain (perf_t *p)
+{
+  uint64_t head = __atomic_load_n (&(p->meta->data_head), __ATOMIC_ACQUIRE);
+  uint64_t tail = p->meta->data_tail;
+
+  while (tail < head)
+    {
+      struct perf_event_header header;
+      perf_copy (p, tail, &header, sizeof (header));
+      if (header.size < sizeof (header))
+        break;
+      perf_copy (p, tail, p->record, header.size);
+
+      switch (header.type)
+        {
+        case PERF_RECORD_SAMPLE:
+          {
+            uint64_t nr;
+            if (header.size < sizeof (header) + sizeof (nr))
+              break;
+            size_t max = (header.size - sizeof (header) - sizeof (nr))
+              / sizeof (struct perf_branch_entry);
+            memcpy (&nr, p->record + sizeof (header), sizeof (nr));
+            if (nr > max)
+              nr = max;
+            perf_add_sample (p, (struct perf_branch_entry *)
+                             (p->record + sizeof (header) + sizeof (nr)), nr);
+          }
+          break;
+
+        case PERF_RECORD_LOST:
+        case PERF_RECORD_THROTTLE:
+        case PERF_RECORD_UNTHROTTLE:
+          perf_hole (p);
+          break;
+        }
+      tail += header.size;
+    }
+  __atomic_store_n (&(p->meta->data_tail), tail, __ATOMIC_RELEASE);
+}
+
+/* Count the instructions run from 'from' to 'to' (included) if they can be
+ * executed in sequence without any taken branch, return 0 otherwise */
+static size_t
+perf_walk (tracer_t *tracer, uintptr_t from, uintptr_t to)
+{
+  uintptr_t ip = from;
+
+  for (size_t count = 1; count <= PERF_MAX_WALK; count++)
+    {
+      if (ip == to)
+        return count;
+
+      const decoded_t *insn = tracer_decode (tracer, ip);
+      if (!insn)
+        return 0;
+
+      /* Only a not-taken conditional branch can be stepped over */
+      if (insn->type != BASIC && insn->type != BRANCH)
+        return 0;
+      ip += insn->size;
+    }
+  return 0;
+}
+
+/* Record count instructions in sequence, starting from address ip. The
+ * ones out of the ranges traced are skipped */
+static void
+perf_feed (tracer_t *tracer, uintptr_t ip, size_t count)
+{
+  for (size_t i = 0; i < count; i++)
+    {
+      const decoded_t *insn;
+      if (tracer->filter && !tracer_traced (tracer, ip))
+        {
+          tracer_skip (tracer);
+          insn = tracer_decode (tracer, ip);
+        }
+      else
+        insn = tracer_step (tracer, ip);
+      if (!insn)
+        return;
+      ip += insn->size;
+    }
+}
+
+/* Rebuild the instructions executed from the branch stream, exit_ip is the
+ * address where the child stopped for good */
+static void
+perf_replay (tracer_t *tracer, perf_t *p, uintptr_t exit_ip)
+{
+  branch_t *last = NULL;
+
+  for (size_t i = 0; i < p->nb_branches; i++)
+    {
+      branch_t *b = &(p->branches[i]);
+      size_t count = 0;
+
+      if (!b->from)
+        {
+          last = NULL;
+          continue;
+        }
+
+      if (last)
+        count = perf_walk (tracer, last->to, b->from);
+      if (count)
+        perf_feed (tracer, last->to, count);
+      else
+        {
+          /* Start a new sequence with the branch itself */
+          tracer_resync (tracer);
+          perf_feed (tracer, b->from, 1);
+        }
+      last = b;
+    }
+
+  /* Last instructions up to the exit of the child */
+  if (last)
+    {
+      size_t count = perf_walk (tracer, last->to, exit_ip);
+      if (count > 1)
+        perf_feed (tracer, last->to, count - 1);
+    }
+}
+
+static bool
+perf_run (tracer_t *tracer)
+{
+  perf_t *p = calloc (1, sizeof (perf_t));
+  if (!p)
+    return false;
+
+  struct perf_event_attr attr = { 0 };
+  attr.size = sizeof (attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = PERF_COUNT_HW_BRANCH_INSTRUCTIONS;
+  attr.sample_period = PERF_BRANCH_PERIOD;
+  attr.sample_type = PERF_SAMPLE_BRANCH_STACK;
+  attr.branch_sample_type = PERF_SAMPLE_BRANCH_USER | PERF_SAMPLE_BRANCH_ANY;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.disabled = 1;
+  attr.watermark = 1;
+
+  size_t page_size = sysconf (_SC_PAGESIZE);
+  p->data_size = PERF_DATA_PAGES * page_size;
+  attr.wakeup_watermark = p->data_size / 2;
+
+  p->fd = syscall (SYS_perf_event_open, &attr, tracer->child, -1, -1,
+                   PERF_FLAG_FD_CLOEXEC);
+  if (p->fd == -1)
+    {
+      warn ("warning: cannot sample the branch stack");
+      free (p);
+      return false;
+    }
+
+  void *base = mmap (NULL, page_size + p->data_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED, p->fd, 0);
+  if (base == MAP_FAILED
+      || ptrace (PTRACE_SETOPTIONS, tracer->child, NULL,
+                 PTRACE_O_TRACEEXIT) == -1)
+    {
+      warn ("warning: cannot set up the perf backend");
+      if (base != MAP_FAILED)
+        munmap (base, page_size + p->data_size);
+      close (p->fd);
+      free (p);
+      return false;
+    }
+  p->meta = base;
+  p->data = (byte_t *) base + page_size;
+
+  /* Run the child at full speed until it stops before exiting */
+  ioctl (p->fd, PERF_EVENT_IOC_ENABLE, 0);
+  ptrace (PTRACE_CONT, tracer->child, NULL, NULL);
+
+  int status;
+  bool lost = false;
+  while (true)
+    {
+      struct pollfd pfd = { .fd = p->fd, .events = POLLIN };
+      poll (&pfd, 1, PERF_POLL_DELAY);
+      perf_drain (p);
+
+      pid_t pid = waitpid (tracer->child, &status, WNOHANG);
+      if (pid == 0)
+        continue;
+      if (pid == -1 || WIFEXITED (status) || WIFSIGNALED (status))
+        {
+          lost = true;
+          break;
+        }
+
+      if (status >> 8 == (SIGTRAP | (PTRACE_EVENT_EXIT << 8)))
+        {
+          struct user_regs_struct regs;
+
+          /* The memory of the child is still there, rebuild the trace */
+          ioctl (p->fd, PERF_EVENT_IOC_DISABLE, 0);
+          perf_drain (p);
+          get_regs (tracer, &regs);
+          perf_replay (tracer, p, get_current_ip (&regs));
+
+          ptrace (PTRACE_CONT, tracer->child, NULL, NULL);
+          do
+            waitpid (tracer->child, &status, 0);
+          while (!WIFEXITED (status) && !WIFSIGNALED (status));
+          break;
+        }
+
+      /* Forward the signals to the child */
+      int sig = WIFSTOPPED (status) ? WSTOPSIG (status) : 0;
+      ptrace (PTRACE_CONT, tracer->child, NULL, (sig == SIGTRAP) ? 0 : sig);
+    }
+
+  munmap (base, page_size + p->data_size);
+  close (p->fd);
+  free (p->branches);
+  free (p);
+  if (lost)
+    errno = ECHILD;
+  return !lost;
+}
+
+const backend_t perf_backend = { "perf", perf_run };
+
+const backend_t *
+backend_get (const char *name)
+{
+  static const backend_t *backends[] = { &ptrace_backend, &perf_backend };
+
+  for (size_t i = 0; i < sizeof (backends) / sizeof (backends[0]); i++)
+    if (!strcmp (backends[i]->name, name))
+      return backends[i];
+  return NULL;
+}
@@ -0,0 +1,44 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#ifndef _BACKEND_H
+#define _BACKEND_H
+
+#include "tracker.h"
+
+/* A trace backend follows the child of a tracer_t, from its first stop (right
+ * after execve() or at a snapshot point) to its exit, and feeds every
+ * instruction it sees to tracer_step() */
+typedef struct
+{
+  const char *name;                 /* Name of the backend (command line) */
+  /* Trace the child until it exits. Returns false, with the child still
+   * stopped and untouched, if the backend cannot run on this host, or with
+   * errno set to ECHILD if the child exited before it was traced */
+  bool (*run) (tracer_t *tracer);
+} backend_t;
+
+/* Single-step every instruction with ptrace (always available) */
+extern const backend_t ptrace_backend;
+
+/* Sample the branch stack with perf_event_open() and rebuild the
+ * instructions in between at exit */
+extern const backend_t perf_backend;
+
+/* Get the backend called name, NULL if there is none */
+const backend_t *backend_get (const char *name);
+
+/* Read MAX_OPCODE_BYTES bytes of the (stopped) child memory at addr, from
+ * the snapshot of its mappings when possible */
+void fetch_opcodes (tracer_t *tracer, uintptr_t addr, byte_t *buf);
+
+#endif /* _BACKEND_H */
@@ -0,0 +1,289 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#include "block.h"
+
+#include <errno.h>
+#include <string.h>
+
+/* State of the split of a cfg in blocks */
+typedef struct
+{
+  blocks_t *b;              /* Blocks built */
+  bool *leader;             /* Leaders, by node id */
+  size_t max_blocks;        /* Allocated size of b->blocks */
+  size_t nb_nodes;          /* Number of nodes stored in b->nodes */
+  size_t max_succs;         /* Allocated size of b->succs */
+  bool ok;                  /* Cleared if an error occured */
+} split_t;
+
+/* Get the return site of a call (its successor right after it), NULL if
+ * there is none */
+static cfg_t *
+return_site (cfg_t *CFG)
+{
+  instr_t *call = cfg_get_instr (CFG);
+  uintptr_t next = instr_get_addr (call) + instr_get_size (call);
+  for (uint16_t i = 0; i < cfg_get_nb_out (CFG); i++)
+    {
+      cfg_t *succ = cfg_get_successor_i (CFG, i);
+      if (instr_get_addr (cfg_get_instr (succ)) == next)
+        return succ;
+    }
+  return NULL;
+}
+
+/* Get the node run after CFG in the same block, if it is not a leader.
+ * Returns NULL if CFG ends its block */
+static cfg_t *
+block_next (split_t *s, cfg_t *CFG)
+{
+  cfg_t *next = NULL;
+  switch (cfg_get_type (CFG))
+    {
+    case BASIC:
+      if (cfg_get_nb_out (CFG) > 0)
+        next = cfg_get_successor_i (CFG, 0);
+      break;
+
+    case CALL:
+      next = return_site (CFG);
+      break;
+
+    default:
+      break;
+    }
+  return (next && !s->leader[cfg_get_id (next)]) ? next : NULL;
+}
+
+/* Find the number of ids in use */
+static void
+find_ids (cfg_t *CFG, void *data)
+{
+  split_t *s = data;
+  uint32_t id = cfg_get_id (CFG);
+  if (id >= s->b->nb_ids)
+    s->b->nb_ids = id + 1;
+}
+
+/* Mark the leaders reached from CFG, or CFG itself */
+static void
+mark_leaders (cfg_t *CFG, void *data)
+{
+  split_t *s = data;
+  if (cfg_get_nb_in (CFG) != 1)
+    s->leader[cfg_get_id (CFG)] = true;
+
+  /* Targets of the control transfers, callees included */
+  instr_type_t type = cfg_get_type (CFG);
+  if (type == BASIC)
+    return;
+  cfg_t *site = (type == CALL) ? return_site (CFG) : NULL;
+  for (uint16_t i = 0; i < cfg_get_nb_out (CFG); i++)
+    {
+      cfg_t *succ = cfg_get_successor_i (CFG, i);
+      if (succ != site)
+        s->leader[cfg_get_id (succ)] = true;
+    }
+}
+
+/* Build the block starting at a leader, following its nodes up to the end
+ * of the block */
+static void
+build_block (cfg_t *CFG, void *data)
+{
+  split_t *s = data;
+  blocks_t *b = s->b;
+  if (!s->ok || !s->leader[cfg_get_id (CFG)])
+    return;
+
+  if (b->nb_blocks == s->max_blocks)
+    {
+      size_t max = s->max_blocks ? 2 * s->max_blocks : 1024;
+      block_t *blocks = realloc (b->blocks, max * sizeof (block_t));
+      if (!blocks)
+        {
+          s->ok = false;
+          return;
+        }
+      b->blocks = blocks;
+      s->max_blocks = max;
+    }
+
+  /* Every node is in one block at most, nodes has room for all of them */
+  block_t *block = &(b->blocks[b->nb_blocks]);
+  *block = (block_t) { s->nb_nodes, 0, 0, 0 };
+  for (cfg_t *node = CFG; node && !b->index[cfg_get_id (node)];
+       node = block_next (s, node))
+    {
+      b->nodes[s->nb_nodes++] = node;
+      b->index[cfg_get_id (node)] = b->nb_blocks + 1;
+      block->nb_nodes++;
+    }
+  b->nb_blocks++;
+}
+
+/* Add the successor of a block to succs */
+static bool
+add_succ (split_t *s, cfg_t *succ)
+{
+  blocks_t *b = s->b;
+  uint32_t index = b->index[cfg_get_id (succ)];
+  if (!index)
+    return true;
+
+  if (b->nb_succs == s->max_succs)
+    {
+      size_t max = s->max_succs ? 2 * s->max_succs : 1024;
+      uint32_t *succs = realloc (b->succs, max * sizeof (uint32_t));
+      if (!succs)
+        return false;
+      b->succs = succs;
+      s->max_succs = max;
+    }
+  b->succs[b->nb_succs++] = index - 1;
+  return true;
+}
+
+/* Link the blocks, from the last node of each one */
+static bool
+link_blocks (split_t *s)
+{
+  blocks_t *b = s->b;
+  for (size_t i = 0; i < b->nb_blocks; i++)
+    {
+      block_t *block = &(b->blocks[i]);
+      cfg_t *last = b->nodes[block->first + block->nb_nodes - 1];
+      block->first_succ = b->nb_succs;
+
+      cfg_t *next = NULL;
+      switch (cfg_get_type (last))
+        {
+        case BASIC:
+          if (cfg_get_nb_out (last) > 0)
+            next = cfg_get_successor_i (last, 0);
+          break;
+
+        case CALL:
+          next = return_site (last);
+          break;
+
+        case BRANCH:
+        case JUMP:
+          for (uint16_t k = 0; k < cfg_get_nb_out (last); k++)
+            if (!add_succ (s, cfg_get_successor_i (last, k)))
+              return false;
+          break;
+
+        case RET:
+          /* Returns are linked from their call */
+          break;
+        }
+      if (next && !add_succ (s, next))
+        return false;
+      block->nb_succs = b->nb_succs - block->first_succ;
+    }
+  return true;
+}
+
+blocks_t *
+blocks_new (hashtable_t *ht)
+{
+  blocks_t *b = calloc (1, sizeof (blocks_t));
+  if (!b)
+    return NULL;
+
+  split_t s = { b, NULL, 0, 0, 0, true };
+  hashtable_foreach (ht, find_ids, &s);
+  s.leader = calloc (b->nb_ids ? b->nb_ids : 1, sizeof (bool));
+  b->index = calloc (b->nb_ids ? b->nb_ids : 1, sizeof (uint32_t));
+  b->nodes = malloc ((b->nb_ids ? b->nb_ids : 1) * sizeof (cfg_t *));
+  if (!s.leader || !b->index || !b->nodes)
+    goto failed;
+
+  hashtable_foreach (ht, mark_leaders, &s);
+  for (list_t *l = hashtable_get_entries (ht); l; l = list_get_next (l))
+    s.leader[cfg_get_id (list_get_data (l))] = true;
+  hashtable_foreach (ht, build_block, &s);
+  if (!s.ok || !link_blocks (&s))
+    goto failed;
+
+  /* A block is pushed once per edge to it at most */
+  b->seen = calloc (b->nb_blocks ? b->nb_blocks : 1, sizeof (uint32_t));
+  b->todo = malloc ((b->nb_succs + 1) * sizeof (uint32_t));
+  if (!b->seen || !b->todo)
+    goto failed;
+  free (s.leader);
+  return b;
+
+ failed:
+  free (s.leader);
+  blocks_delete (b);
+  errno = ENOMEM;
+  return NULL;
+}
+
+void
+blocks_delete (blocks_t *b)
+{
+  if (!b)
+    return;
+  free (b->blocks);
+  free (b->nodes);
+  free (b->succs);
+  free (b->index);
+  free (b->seen);
+  free (b->todo);
+  free (b);
+}
+
+long
+blocks_find (const blocks_t *b, cfg_t *node)
+{
+  uint32_t id = cfg_get_id (node);
+  if (id >= b->nb_ids || !b->index[id])
+    return -1;
+  return b->index[id] - 1;
+}
+
+size_t
+blocks_reach (blocks_t *b, cfg_t *entry, uint32_t *order)
+{
+  long start = blocks_find (b, entry);
+  if (start < 0)
+    return 0;
+
+  /* Blocks seen in a previous walk are told apart by their walk number */
+  if (++b->walk == 0)
+    {
+      memset (b->seen, 0, b->nb_blocks * sizeof (uint32_t));
+      b->walk = 1;
+    }
+
+  size_t n = 0, top = 0;
+  b->todo[top++] = start;
+  while (top > 0)
+    {
+      uint32_t i = b->todo[--top];
+      if (b->seen[i] == b->walk)
+        continue;
+      b->seen[i] = b->walk;
+      order[n++] = i;
+
+      /* Pushed backwards, so that the first successor is visited first */
+      const block_t *block = &(b->blocks[i]);
+      for (uint32_t k = block->nb_succs; k-- > 0;)
+        if (b->seen[b->succs[block->first_succ + k]] != b->walk)
+          b->todo[top++] = b->succs[block->first_succ + k];
+    }
+  return n;
+}
@@ -0,0 +1,65 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#ifndef _BLOCK_H
+#define _BLOCK_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <trace.h>
+
+/* A basic block of the cfg: nodes run in sequence, only entered at the
+ * first one. A call does not end a block, it goes on at its return site */
+typedef struct
+{
+  uint32_t first;           /* Index of its first node in nodes */
+  uint32_t nb_nodes;        /* Number of nodes */
+  uint32_t first_succ;      /* Index of its first successor in succs */
+  uint32_t nb_succs;        /* Number of successors */
+} block_t;
+
+/* The basic blocks of a cfg, computed once it is built */
+typedef struct
+{
+  block_t *blocks;          /* Basic blocks */
+  size_t nb_blocks;         /* Number of blocks */
+  cfg_t **nodes;            /* Nodes of the blocks, block after block */
+  uint32_t *succs;          /* Successors of the blocks (block indexes) */
+  size_t nb_succs;          /* Number of successors */
+  uint32_t *index;          /* Block of each node + 1, by id (0 if none) */
+  size_t nb_ids;            /* Number of entries of index */
+  uint32_t *seen;           /* Walk a block was last reached in, by block */
+  uint32_t *todo;           /* Blocks left to visit in a walk */
+  uint32_t walk;            /* Number of walks done */
+} blocks_t;
+
+/* Split the cfg held by ht in basic blocks. The leaders are the entries of
+ * the functions, the nodes with several predecessors (or none) and the ones
+ * following a control transfer other than the return of a call. Returns
+ * NULL otherwise (and set errno) */
+blocks_t *blocks_new (hashtable_t *ht);
+
+/* Free the given blocks */
+void blocks_delete (blocks_t *b);
+
+/* Get the index of the block holding node, -1 if there is none */
+long blocks_find (const blocks_t *b, cfg_t *node);
+
+/* Store in order the indexes of the blocks reachable from the one of entry
+ * (the entry of a function), depth-first and successors in order, order
+ * holding b->nb_blocks entries. A walk only costs the blocks it reaches.
+ * Returns the number of blocks stored */
+size_t blocks_reach (blocks_t *b, cfg_t *entry, uint32_t *order);
+
+#endif /* _BLOCK_H */
@@ -0,0 +1,372 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#define _GNU_SOURCE
+
+#include "cfgdb.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Offset of the hits in a record */
+#define HITS_OFFSET offsetof (cfgdb_record_t, edge.hits)
+
+/* Make room for the node id in the tables indexed by id */
+static bool
+cfgdb_reserve_id (cfgdb_t *db, uint32_t id)
+{
+  if (id < db->max_ids)
+    return true;
+
+  size_t max = db->max_ids ? 2 * db->max_ids : 4096;
+  while (max <= id)
+    max *= 2;
+  uint32_t *index = realloc (db->index, max * sizeof (uint32_t));
+  if (!index)
+    return false;
+  db->index = index;
+  uint16_t *nb_out = realloc (db->nb_out, max * sizeof (uint16_t));
+  if (!nb_out)
+    return false;
+  db->nb_out = nb_out;
+
+  memset (db->index + db->max_ids, 0, (max - db->max_ids) * sizeof (uint32_t));
+  memset (db->nb_out + db->max_ids, 0,
+          (max - db->max_ids) * sizeof (uint16_t));
+  db->max_ids = max;
+  return true;
+}
+
+/* Remember the edge number index of from, its hits are at offset */
+static bool
+cfgdb_add_edge (cfgdb_t *db, cfg_t *from, uint16_t index, uint32_t hits,
+                off_t offset)
+{
+  if (db->nb_edges == db->max_edges)
+    {
+      size_t max = db->max_edges ? 2 * db->max_edges : 4096;
+      cfgdb_edge_t *edges = realloc (db->edges, max * sizeof (cfgdb_edge_t));
+      if (!edges)
+        return false;
+      db->edges = edges;
+      db->max_edges = max;
+    }
+  db->edges[db->nb_edges++] =
+    (cfgdb_edge_t) { cfg_get_id (from), index, hits, offset };
+  db->nb_out[cfg_get_id (from)] = index + 1;
+  return true;
+}
+
+/* Insert the records of the mapping in ht */
+static bool
+cfgdb_load (cfgdb_t *db, hashtable_t *ht)
+{
+  const cfgdb_record_t *records =
+    (const cfgdb_record_t *) (db->map + CFGDB_MAGIC_LEN);
+  size_t nb_records =
+    (db->map_size - CFGDB_MAGIC_LEN) / sizeof (cfgdb_record_t);
+  bool ok = false;
+
+  /* Records of the nodes and nodes of ht, by index in the database */
+  const cfgdb_record_t **recs = malloc (nb_records * sizeof (cfgdb_record_t *));
+  cfg_t **nodes = malloc (nb_records * sizeof (cfg_t *));
+  if (nb_records && (!recs || !nodes))
+    goto end;
+
+  uint32_t nb_nodes = 0, first = UINT32_MAX;
+  for (size_t i = 0; i < nb_records; i++)
+    if (records[i].kind == CFGDB_NODE)
+      recs[nb_nodes++] = &(records[i]);
+    else if (records[i].kind == CFGDB_ENTRY && first == UINT32_MAX)
+      first = records[i].from;
+
+  /* cfg_new() makes the first node created the first entry */
+  errno = EINVAL;
+  if (first != UINT32_MAX && first >= nb_nodes)
+    goto end;
+  for (uint32_t k = 0; k < nb_nodes; k++)
+    {
+      uint32_t n = (first == UINT32_MAX) ? k
+        : (k == 0) ? first : (k <= first) ? k - 1 : k;
+      const cfgdb_record_t *rec = recs[n];
+      if (rec->size > sizeof (rec->node.opcodes))
+        goto end;
+      instr_t *ins = instr_new (rec->node.address, rec->size,
+                                rec->node.opcodes);
+      nodes[n] = ins ? cfg_new (ht, ins) : NULL;
+      if (!nodes[n] || !cfgdb_reserve_id (db, cfg_get_id (nodes[n])))
+        goto end;
+      db->index[cfg_get_id (nodes[n])] = n + 1;
+    }
+  db->nb_nodes = nb_nodes;
+
+  for (size_t i = 0; i < nb_records; i++)
+    {
+      const cfgdb_record_t *rec = &(records[i]);
+      switch (rec->kind)
+        {
+        case CFGDB_NODE:
+          break;
+
+        case CFGDB_EDGE:
+          {
+            errno = EINVAL;
+            if (rec->from >= nb_nodes || rec->edge.to >= nb_nodes)
+              goto end;
+            cfg_t *from = nodes[rec->from];
+            uint16_t index = cfg_get_nb_out (from);
+            if (!cfg_add_edge (ht, from, nodes[rec->edge.to], rec->edge.hits)
+                || cfg_get_nb_out (from) != index + 1)
+              goto end;
+            off_t offset = (const uint8_t *) rec - db->map + HITS_OFFSET;
+            if (!cfgdb_add_edge (db, from, index, rec->edge.hits, offset))
+              goto end;
+          }
+          break;
+
+        case CFGDB_ENTRY:
+          errno = EINVAL;
+          if (rec->from >= nb_nodes)
+            goto end;
+          if (db->nb_entries++ > 0
+              && !hashtable_add_entry (ht, nodes[rec->from]))
+            goto end;
+          break;
+
+        default:
+          errno = EINVAL;
+          goto end;
+        }
+    }
+
+  /* Edges set the function of their successor, set it back */
+  for (uint32_t n = 0; n < nb_nodes; n++)
+    cfg_set_name (nodes[n], recs[n]->name);
+  ok = true;
+
+ end:
+  free (recs);
+  free (nodes);
+  return ok;
+}
+
+cfgdb_t *
+cfgdb_open (const char *path, hashtable_t *ht)
+{
+  cfgdb_t *db = calloc (1, sizeof (cfgdb_t));
+  if (!db)
+    return NULL;
+  db->map = MAP_FAILED;
+
+  /* Another tracker may grow the same database, one at a time */
+  db->fd = open (path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (db->fd == -1 || flock (db->fd, LOCK_EX) == -1)
+    goto failed;
+
+  struct stat st;
+  if (fstat (db->fd, &st) == -1)
+    goto failed;
+  if (st.st_size == 0)
+    {
+      if (pwrite (db->fd, CFGDB_MAGIC, CFGDB_MAGIC_LEN, 0) != CFGDB_MAGIC_LEN)
+        goto failed;
+      db->size = CFGDB_MAGIC_LEN;
+      return db;
+    }
+
+  /* Records are read straight from the mapping (the hashtable is rebuilt
+   * from them all the same), the hits are updated there */
+  db->size = st.st_size;
+  db->map_size = st.st_size;
+  db->map = mmap (NULL, db->map_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                  db->fd, 0);
+  if (db->map == MAP_FAILED)
+    goto failed;
+  if (db->map_size < CFGDB_MAGIC_LEN
+      || memcmp (db->map, CFGDB_MAGIC, CFGDB_MAGIC_LEN)
+      || (db->map_size - CFGDB_MAGIC_LEN) % sizeof (cfgdb_record_t))
+    {
+      errno = EINVAL;
+      goto failed;
+    }
+  if (!cfgdb_load (db, ht))
+    goto failed;
+  return db;
+
+ failed:
+  {
+    int saved = errno;
+    cfgdb_close (db);
+    errno = saved;
+  }
+  return NULL;
+}
+
+/* Records appended by cfgdb_sync() */
+typedef struct
+{
+  cfgdb_t *db;              /* Database synchronized */
+  cfgdb_record_t *records;  /* Records to append */
+  size_t nb_records;        /* Number of records */
+  size_t max_records;       /* Allocated size of records */
+  bool ok;                  /* Cleared if an error occured */
+} append_t;
+
+/* Get a new record to append, NULL otherwise */
+static cfgdb_record_t *
+append_record (append_t *app)
+{
+  if (app->nb_records == app->max_records)
+    {
+      size_t max = app->max_records ? 2 * app->max_records : 4096;
+      cfgdb_record_t *records =
+        realloc (app->records, max * sizeof (cfgdb_record_t));
+      if (!records)
+        {
+          app->ok = false;
+          return NULL;
+        }
+      app->records = records;
+      app->max_records = max;
+    }
+  cfgdb_record_t *rec = &(app->records[app->nb_records++]);
+  *rec = (cfgdb_record_t) { 0 };
+  return rec;
+}
+
+/* Append the node if it is not stored yet */
+static void
+append_node (cfg_t *CFG, void *data)
+{
+  append_t *app = data;
+  cfgdb_t *db = app->db;
+  uint32_t id = cfg_get_id (CFG);
+
+  if (!app->ok || !cfgdb_reserve_id (db, id))
+    {
+      app->ok = false;
+      return;
+    }
+  if (db->index[id])
+    return;
+
+  cfgdb_record_t *rec = append_record (app);
+  if (!rec)
+    return;
+  instr_t *ins = cfg_get_instr (CFG);
+  rec->kind = CFGDB_NODE;
+  rec->size = instr_get_size (ins);
+  rec->name = cfg_get_name (CFG);
+  rec->node.address = instr_get_addr (ins);
+  memcpy (rec->node.opcodes, instr_get_opcodes (ins), rec->size);
+  db->index[id] = ++db->nb_nodes;
+}
+
+/* Append the edges of the node that are not stored yet */
+static void
+append_edges (cfg_t *CFG, void *data)
+{
+  append_t *app = data;
+  cfgdb_t *db = app->db;
+  uint32_t id = cfg_get_id (CFG);
+
+  for (uint16_t i = db->nb_out[id]; app->ok && i < cfg_get_nb_out (CFG); i++)
+    {
+      cfgdb_record_t *rec = append_record (app);
+      if (!rec)
+        return;
+      uint32_t hits = cfg_get_hits_i (CFG, i);
+      rec->kind = CFGDB_EDGE;
+      rec->from = db->index[id] - 1;
+      rec->edge.to = db->index[cfg_get_id (cfg_get_successor_i (CFG, i))] - 1;
+      rec->edge.hits = hits;
+
+      off_t offset = db->size + (app->nb_records - 1) * sizeof (cfgdb_record_t)
+        + HITS_OFFSET;
+      if (!cfgdb_add_edge (db, CFG, i, hits, offset))
+        app->ok = false;
+    }
+}
+
+bool
+cfgdb_sync (cfgdb_t *db, hashtable_t *ht)
+{
+  append_t app = { db, NULL, 0, 0, true };
+
+  /* Hits of the edges already stored */
+  for (size_t i = 0; i < db->nb_edges; i++)
+    {
+      cfgdb_edge_t *edge = &(db->edges[i]);
+      uint32_t hits = cfg_get_hits_i (hashtable_get_node (ht, edge->from),
+                                      edge->index);
+      if (hits == edge->hits)
+        continue;
+      edge->hits = hits;
+      if (edge->offset + sizeof (uint32_t) <= db->map_size)
+        memcpy (db->map + edge->offset, &hits, sizeof (uint32_t));
+      else if (pwrite (db->fd, &hits, sizeof (uint32_t), edge->offset)
+               != sizeof (uint32_t))
+        return false;
+    }
+
+  /* Nodes come before the edges and entries referring to them */
+  hashtable_foreach (ht, append_node, &app);
+  hashtable_foreach (ht, append_edges, &app);
+
+  /* Entries already stored are skipped, the others are appended in order */
+  list_t *entries = hashtable_get_entries (ht);
+  for (size_t i = 0; entries && i < db->nb_entries; i++)
+    entries = list_get_next (entries);
+  for (; app.ok && entries; entries = list_get_next (entries))
+    {
+      cfgdb_record_t *rec = append_record (&app);
+      if (!rec)
+        break;
+      cfg_t *entry = list_get_data (entries);
+      rec->kind = CFGDB_ENTRY;
+      rec->from = db->index[cfg_get_id (entry)] - 1;
+      db->nb_entries++;
+    }
+
+  size_t len = app.nb_records * sizeof (cfgdb_record_t);
+  if (app.ok && len > 0)
+    {
+      if (pwrite (db->fd, app.records, len, db->size) != (ssize_t) len)
+        app.ok = false;
+      else
+        db->size += len;
+    }
+  free (app.records);
+  return app.ok;
+}
+
+void
+cfgdb_close (cfgdb_t *db)
+{
+  if (!db)
+    return;
+  if (db->map != MAP_FAILED)
+    munmap (db->map, db->map_size);
+  if (db->fd != -1)
+    close (db->fd);
+  free (db->index);
+  free (db->nb_out);
+  free (db->edges);
+  free (db);
+}
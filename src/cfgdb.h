@@ -0,0 +1,99 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#ifndef _CFGDB_H
+#define _CFGDB_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <sys/types.h>
+
+#include <trace.h>
+
+/* A cfg database is the magic string followed by fixed size records, in the
+ * order they were appended. Nodes are numbered from 0 in the order of their
+ * records, an edge or an entry comes after the nodes it refers to. Only the
+ * hits of the edges are updated in place, the rest is only appended */
+#define CFGDB_MAGIC "TRKCFG1\n"
+#define CFGDB_MAGIC_LEN 8
+
+/* Kind of a record */
+typedef enum
+{
+  CFGDB_NODE = 1,
+  CFGDB_EDGE,
+  CFGDB_ENTRY
+} cfgdb_kind_t;
+
+/* A record of the database */
+typedef struct
+{
+  uint8_t kind;             /* Kind of the record */
+  uint8_t size;             /* Size of the instruction (NODE) */
+  uint16_t name;            /* Function of the node (NODE) */
+  uint32_t from;            /* Source (EDGE) or entry (ENTRY) */
+  union
+  {
+    struct
+    {
+      uint64_t address;     /* Address of the instruction */
+      uint8_t opcodes[16];  /* Opcodes of the instruction */
+    } node;
+    struct
+    {
+      uint32_t to;          /* Successor */
+      uint32_t hits;        /* Number of times it was taken */
+    } edge;
+  };
+} cfgdb_record_t;
+
+/* An edge stored in the database */
+typedef struct
+{
+  uint32_t from;            /* Id of its source in the hashtable */
+  uint16_t index;           /* Index among the successors of its source */
+  uint32_t hits;            /* Hits stored */
+  off_t offset;             /* Offset of the hits in the file */
+} cfgdb_edge_t;
+
+/* A cfg database, opened for a hashtable */
+typedef struct
+{
+  int fd;                   /* File of the database (locked) */
+  uint8_t *map;             /* Mapping of the file as it was at opening */
+  size_t map_size;          /* Size of map */
+  off_t size;               /* Size of the file */
+  uint32_t nb_nodes;        /* Number of nodes stored */
+  uint32_t *index;          /* Index + 1 of the nodes stored, by id (or 0) */
+  uint16_t *nb_out;         /* Number of edges stored, by id */
+  size_t max_ids;           /* Allocated size of index and nb_out */
+  cfgdb_edge_t *edges;      /* Edges stored */
+  size_t nb_edges;          /* Number of edges */
+  size_t max_edges;         /* Allocated size of edges */
+  size_t nb_entries;        /* Number of function entries stored */
+} cfgdb_t;
+
+/* Open (or create) the database at path and insert its cfg in ht, which
+ * must be empty. Each record is inserted, in a time linear in the size of
+ * the database. Returns NULL otherwise (and set errno) */
+cfgdb_t *cfgdb_open (const char *path, hashtable_t *ht);
+
+/* Store the new nodes, edges and entries of ht in the database and update
+ * the hits of the others. Returns false if an error occured */
+bool cfgdb_sync (cfgdb_t *db, hashtable_t *ht);
+
+/* Close the database */
+void cfgdb_close (cfgdb_t *db);
+
+#endif /* _CFGDB_H */
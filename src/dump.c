@@ -0,0 +1,179 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "tlog.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <err.h>
+#include <getopt.h>
+#include <libgen.h>
+
+#include <capstone/capstone.h>
+
+#define VERSION "1.0.0"
+
+/* Maximum length of a line of the listing */
+#define MAX_LINE 512
+
+/* Lines of the listing, indexed by instruction id */
+static char **lines = NULL;
+static size_t max_lines = 0;
+
+/* Render the line of a newly defined instruction */
+static void
+define (csh handle, tlog_record_t *rec)
+{
+  if (rec->id >= max_lines)
+    {
+      size_t max = max_lines ? 2 * max_lines : 4096;
+      while (max <= rec->id)
+        max *= 2;
+      char **tmp = realloc (lines, max * sizeof (char *));
+      if (!tmp)
+        err (EXIT_FAILURE, "error: cannot store the listing");
+      memset (tmp + max_lines, 0, (max - max_lines) * sizeof (char *));
+      lines = tmp;
+      max_lines = max;
+    }
+
+  char line[MAX_LINE];
+  cs_insn *insn;
+  size_t count = cs_disasm (handle, rec->data, rec->arg, 0x1000, 1, &insn);
+  if (count == 0)
+    tlog_format (line, MAX_LINE, rec->ip, rec->data, rec->arg, "(bad)", "");
+  else
+    {
+      tlog_format (line, MAX_LINE, rec->ip, rec->data, rec->arg,
+                   insn[0].mnemonic, insn[0].op_str);
+      cs_free (insn, count);
+    }
+
+  free (lines[rec->id]);
+  lines[rec->id] = strdup (line);
+  if (!lines[rec->id])
+    err (EXIT_FAILURE, "error: cannot store the listing");
+}
+
+int
+main (int argc, char *argv[])
+{
+  const char *program_name = basename (argv[0]);
+  FILE *output = stdout;
+
+  /* Options parser settings */
+  opterr = 0; /* Mute error message from getopt() */
+  const char *opts = "o:Vh";
+
+   const struct option long_opts[] = {
+    {"output",   required_argument, NULL, 'o'},
+    {"version",        no_argument, NULL, 'V'},
+    {"help",           no_argument, NULL, 'h'},
+    {NULL,                       0, NULL,   0}
+  };
+
+   const char *usage_msg =
+     "Usage: %1$s [-o FILE|-V|-h] [--] TRACE\n"
+     "Render the listing of a binary trace written by 'tracker -t'\n"
+     "\n"
+     " -o FILE,--output FILE  write the listing to FILE\n"
+     " -V,--version           display version and exit\n"
+     " -h,--help              display this help\n";
+
+  /* Parsing options */
+  int optc;
+  while ((optc = getopt_long (argc, argv, opts, long_opts, NULL)) != -1)
+    switch (optc)
+      {
+      case 'o':         /* Output file */
+        output = fopen (optarg, "we");
+        if (!output)
+          err (EXIT_FAILURE, "error: cannot open file '%s'", optarg);
+        break;
+
+      case 'V':         /* Display version number and exit */
+        fprintf (stdout, "%s %s\n", program_name, VERSION);
+        fputs ("Render the listing of a binary trace\n", stdout);
+        exit (EXIT_SUCCESS);
+        break;
+
+      case 'h':         /* Display usage and exit */
+        fprintf (stdout, usage_msg, program_name);
+        exit (EXIT_SUCCESS);
+        break;
+
+      default:
+        errx (EXIT_FAILURE, "error: invalid option '%s'!", argv[optind - 1]);
+      }
+
+  if (optind > (argc - 1))
+    errx (EXIT_FAILURE, "error: missing argument: a trace is required!");
+
+  tlog_reader_t *reader = tlog_reader_new (argv[optind]);
+  if (!reader)
+    err (EXIT_FAILURE, "error: cannot read trace '%s'", argv[optind]);
+
+  csh handle;
+  bool opened = false;
+  tlog_record_t rec;
+  while (tlog_read (reader, &rec))
+    switch (rec.kind)
+      {
+      case TLOG_BEGIN:
+        /* Each run may have its own architecture and syntax */
+        if (opened)
+          cs_close (&handle);
+        if (cs_open (CS_ARCH_X86, rec.arg, &handle) != CS_ERR_OK)
+          errx (EXIT_FAILURE, "error: cannot start capstone disassembler");
+        cs_option (handle, CS_OPT_SYNTAX, (rec.flags & TLOG_INTEL) ?
+                   CS_OPT_SYNTAX_INTEL : CS_OPT_SYNTAX_ATT);
+        opened = true;
+        fprintf (output, "tracker: starting to trace '%s'\n\n", rec.data);
+        break;
+
+      case TLOG_DEFINE:
+        if (!opened)
+          errx (EXIT_FAILURE, "error: '%s' is corrupted", argv[optind]);
+        define (handle, &rec);
+        break;
+
+      case TLOG_STEP:
+        fputs (lines[rec.id], output);
+        break;
+
+      case TLOG_END:
+        fprintf (output,
+                 "\n"
+                 "\tStatistics about this run\n"
+                 "\t=========================\n"
+                 "* #instructions executed: %" PRIu64 "\n\n\n", rec.arg);
+        break;
+      }
+  if (errno)
+    err (EXIT_FAILURE, "error: '%s' is corrupted", argv[optind]);
+
+  if (opened)
+    cs_close (&handle);
+  tlog_reader_delete (reader);
+  for (size_t i = 0; i < max_lines; i++)
+    free (lines[i]);
+  free (lines);
+  fclose (output);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,205 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#include "export.h"
+#include "json.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <string.h>
+
+/* State of an export */
+typedef struct
+{
+  FILE *out;                /* File written */
+  blocks_t *b;              /* Blocks of the cfg */
+  csh handle;               /* Decoder rendering the instructions */
+  cs_insn *insn;            /* Last instruction decoded */
+  uint32_t *order;          /* Blocks of the function written */
+} exporter_t;
+
+export_format_t
+export_format (const char *path)
+{
+  size_t len = strlen (path);
+  return (len >= 5 && !strcmp (path + len - 5, ".json"))
+    ? EXPORT_JSON : EXPORT_DOT;
+}
+
+/* Get the mnemonic and operands of instr, an empty string if it cannot be
+ * decoded */
+static const char *
+instr_text (exporter_t *e, instr_t *instr, char *text, size_t max)
+{
+  const uint8_t *code = instr_get_opcodes (instr);
+  size_t size = instr_get_size (instr);
+  uint64_t addr = instr_get_addr (instr);
+
+  text[0] = '\0';
+  if (cs_disasm_iter (e->handle, &code, &size, &addr, e->insn))
+    snprintf (text, max, "%s %s", e->insn->mnemonic, e->insn->op_str);
+  return text;
+}
+
+/* Write s in a quoted string, escaped as DOT wants it */
+static void
+dot_puts (FILE *out, const char *s)
+{
+  for (; *s; s++)
+    {
+      if (*s == '"' || *s == '\\')
+        fputc ('\\', out);
+      fputc (*s, out);
+    }
+}
+
+/* Maximum length of the text of an instruction */
+#define MAX_INSN_TEXT 256
+
+/* Write the block of index i of the function number fn, as a DOT node with
+ * its instructions as label */
+static void
+dot_block (exporter_t *e, size_t fn, uint32_t i)
+{
+  const block_t *block = &(e->b->blocks[i]);
+  char text[MAX_INSN_TEXT];
+
+  fprintf (e->out, "    \"%zu.%" PRIu32 "\" [label=\"", fn, i);
+  for (uint32_t k = 0; k < block->nb_nodes; k++)
+    {
+      instr_t *instr = cfg_get_instr (e->b->nodes[block->first + k]);
+      uint8_t *opcodes = instr_get_opcodes (instr);
+
+      if (k > 0)
+        fputs ("\\n", e->out);
+      fprintf (e->out, "0x%" PRIxPTR "  ", instr_get_addr (instr));
+      for (size_t j = 0; j < instr_get_size (instr); j++)
+        fprintf (e->out, "%02x ", opcodes[j]);
+      fputc (' ', e->out);
+      dot_puts (e->out, instr_text (e, instr, text, MAX_INSN_TEXT));
+    }
+  fputs ("\"];\n", e->out);
+}
+
+/* Write the function number fn, of n blocks in e->order, as a DOT cluster */
+static void
+dot_function (exporter_t *e, size_t fn, cfg_t *entry, size_t n)
+{
+  fprintf (e->out, "  subgraph \"cluster_%zu\" {\n", fn);
+  fprintf (e->out, "    label=\"0x%" PRIxPTR "\";\n",
+           instr_get_addr (cfg_get_instr (entry)));
+
+  for (size_t i = 0; i < n; i++)
+    dot_block (e, fn, e->order[i]);
+
+  for (size_t i = 0; i < n; i++)
+    {
+      const block_t *block = &(e->b->blocks[e->order[i]]);
+      for (uint32_t k = 0; k < block->nb_succs; k++)
+        fprintf (e->out, "    \"%zu.%" PRIu32 "\" -> \"%zu.%" PRIu32 "\";\n",
+                 fn, e->order[i], fn, e->b->succs[block->first_succ + k]);
+    }
+  fputs ("  }\n", e->out);
+}
+
+/* Write the block of index i as a JSON object, with its instructions */
+static void
+json_block (exporter_t *e, uint32_t i)
+{
+  const block_t *block = &(e->b->blocks[i]);
+  char text[MAX_INSN_TEXT];
+
+  fprintf (e->out, "      {\"id\": %" PRIu32 ", \"instrs\": [", i);
+  for (uint32_t k = 0; k < block->nb_nodes; k++)
+    {
+      instr_t *instr = cfg_get_instr (e->b->nodes[block->first + k]);
+      uint8_t *opcodes = instr_get_opcodes (instr);
+
+      fprintf (e->out, "%s{\"addr\": \"0x%" PRIxPTR "\", \"opcodes\": \"",
+               (k > 0) ? ", " : "", instr_get_addr (instr));
+      for (size_t j = 0; j < instr_get_size (instr); j++)
+        fprintf (e->out, "%02x", opcodes[j]);
+      fputs ("\", \"text\": \"", e->out);
+      json_puts (e->out, instr_text (e, instr, text, MAX_INSN_TEXT));
+      fputs ("\"}", e->out);
+    }
+  fputs ("]}", e->out);
+}
+
+/* Write the function number fn, of n blocks in e->order, as a JSON object:
+ * its entry, its blocks and the edges between them (by block id) */
+static void
+json_function (exporter_t *e, size_t fn, cfg_t *entry, size_t n)
+{
+  fprintf (e->out, "%s    {\"entry\": \"0x%" PRIxPTR "\",\n     \"blocks\": [\n",
+           (fn > 0) ? ",\n" : "", instr_get_addr (cfg_get_instr (entry)));
+  for (size_t i = 0; i < n; i++)
+    {
+      if (i > 0)
+        fputs (",\n", e->out);
+      json_block (e, e->order[i]);
+    }
+
+  fputs ("],\n     \"edges\": [", e->out);
+  bool first = true;
+  for (size_t i = 0; i < n; i++)
+    {
+      const block_t *block = &(e->b->blocks[e->order[i]]);
+      for (uint32_t k = 0; k < block->nb_succs; k++)
+        {
+          fprintf (e->out, "%s[%" PRIu32 ", %" PRIu32 "]", first ? "" : ", ",
+                   e->order[i], e->b->succs[block->first_succ + k]);
+          first = false;
+        }
+    }
+  fputs ("]}", e->out);
+}
+
+bool
+export_cfg (FILE *out, export_format_t format, hashtable_t *ht,
+            blocks_t *b, csh handle)
+{
+  exporter_t e = { out, b, handle, cs_malloc (handle),
+                   malloc ((b->nb_blocks ? b->nb_blocks : 1)
+                           * sizeof (uint32_t)) };
+  if (!e.insn || !e.order)
+    {
+      if (e.insn)
+        cs_free (e.insn, 1);
+      free (e.order);
+      errno = ENOMEM;
+      return false;
+    }
+
+  fputs ((format == EXPORT_DOT)
+         ? "digraph G {\n  node [shape=box];\n" : "{\"functions\": [\n", out);
+
+  size_t fn = 0;
+  for (list_t *l = hashtable_get_entries (ht); l; l = list_get_next (l))
+    {
+      cfg_t *entry = list_get_data (l);
+      size_t n = blocks_reach (b, entry, e.order);
+      if (n == 0)
+        continue;
+
+      if (format == EXPORT_DOT)
+        dot_function (&e, fn, entry, n);
+      else
+        json_function (&e, fn, entry, n);
+      fn++;
+    }
+
+  fputs ((format == EXPORT_DOT) ? "}\n" : "\n]}\n", out);
+  cs_free (e.insn, 1);
+  free (e.order);
+  return !ferror (out) && fflush (out) != EOF;
+}
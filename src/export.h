@@ -0,0 +1,43 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#ifndef _EXPORT_H
+#define _EXPORT_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include <capstone/capstone.h>
+
+#include <trace.h>
+
+#include "block.h"
+
+/* Formats of an exported cfg */
+typedef enum
+{
+  EXPORT_DOT,               /* Graphviz, a cluster per function */
+  EXPORT_JSON               /* Functions with their blocks and edges */
+} export_format_t;
+
+/* Get the format a cfg is written in to path: JSON for a '.json' file, DOT
+ * otherwise */
+export_format_t export_format (const char *path);
+
+/* Write the functions of ht (in order of discovery) to out, one node per
+ * basic block of b, instructions rendered by handle. The graph is written
+ * as it is walked, with no other memory than one block index per block.
+ * Returns false otherwise (and set errno) */
+bool export_cfg (FILE *out, export_format_t format, hashtable_t *ht,
+                 blocks_t *b, csh handle);
+
+#endif /* _EXPORT_H */
@@ -0,0 +1,154 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#define _GNU_SOURCE
+
+#include "filter.h"
+
+#include <errno.h>
+#include <string.h>
+
+/* Parse START-END in range, returns false if spec is not of this form */
+static bool
+parse_addr (const char *spec, range_t *range)
+{
+  char *end;
+  errno = 0;
+  range->start = strtoull (spec, &end, 16);
+  if (end == spec || *end != '-' || errno)
+    return false;
+
+  const char *last = end + 1;
+  range->end = strtoull (last, &end, 16);
+  return (end != last && *end == '\0' && !errno);
+}
+
+bool
+filter_add (filter_t *filter, const char *spec, bool exclude)
+{
+  range_t range = { RANGE_OBJECT, exclude, spec, 0, 0 };
+  if (!strcmp (spec, "text"))
+    range.kind = RANGE_TEXT;
+  else if (parse_addr (spec, &range))
+    range.kind = RANGE_ADDR;
+  if (*spec == '\0' || (range.kind == RANGE_ADDR && range.start >= range.end))
+    {
+      errno = EINVAL;
+      return false;
+    }
+
+  range_t *ranges = realloc (filter->ranges,
+                             (filter->nb_ranges + 1) * sizeof (range_t));
+  if (!ranges)
+    return false;
+  filter->ranges = ranges;
+  ranges[filter->nb_ranges] = range;
+
+  filter->nb_ranges++;
+  filter->include |= !exclude;
+  filter->text |= (range.kind == RANGE_TEXT);
+  return true;
+}
+
+/* Tell if path is the file object: the same path, or a file named after
+ * it ('libc' for 'libc.so.6' or 'libc-2.31.so') */
+static bool
+is_object (const char *path, const char *object)
+{
+  if (strchr (object, '/'))
+    return !strcmp (path, object);
+
+  const char *name = strrchr (path, '/');
+  name = name ? name + 1 : path;
+  size_t len = strlen (object);
+  return !strncmp (name, object, len)
+    && (name[len] == '\0' || name[len] == '.' || name[len] == '-');
+}
+
+bool
+filter_match (const filter_t *filter, uintptr_t ip, const char *path,
+              uintptr_t text_start, uintptr_t text_end)
+{
+  bool traced = !filter->include;
+
+  for (size_t i = 0; i < filter->nb_ranges; i++)
+    {
+      const range_t *range = &(filter->ranges[i]);
+      bool in = false;
+      switch (range->kind)
+        {
+        case RANGE_TEXT:
+          in = (ip >= text_start && ip < text_end);
+          break;
+
+        case RANGE_OBJECT:
+          in = (path && is_object (path, range->object));
+          break;
+
+        case RANGE_ADDR:
+          in = (ip >= range->start && ip < range->end);
+          break;
+        }
+
+      if (in && range->exclude)
+        return false;
+      traced |= in;
+    }
+  return traced;
+}
+
+bool
+filter_overlap (const filter_t *filter, uintptr_t start, uintptr_t end,
+                const char *path, uintptr_t text_start, uintptr_t text_end)
+{
+  bool traced = !filter->include;
+
+  for (size_t i = 0; i < filter->nb_ranges; i++)
+    {
+      const range_t *range = &(filter->ranges[i]);
+      uintptr_t low = 0, high = 0;
+      switch (range->kind)
+        {
+        case RANGE_TEXT:
+          low = text_start;
+          high = text_end;
+          break;
+
+        case RANGE_OBJECT:
+          if (path && is_object (path, range->object))
+            {
+              low = start;
+              high = end;
+            }
+          break;
+
+        case RANGE_ADDR:
+          low = range->start;
+          high = range->end;
+          break;
+        }
+
+      /* Excluded as a whole, or in part only */
+      if (range->exclude && low <= start && end <= high)
+        return false;
+      if (!range->exclude && low < end && start < high)
+        traced = true;
+    }
+  return traced;
+}
+
+void
+filter_clear (filter_t *filter)
+{
+  free (filter->ranges);
+  *filter = (filter_t) { 0 };
+}
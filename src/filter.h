@@ -0,0 +1,67 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#ifndef _FILTER_H
+#define _FILTER_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+/* Kind of a range of addresses */
+typedef enum
+{
+  RANGE_TEXT,               /* .text section of the executable */
+  RANGE_OBJECT,             /* Mappings of a file (shared object) */
+  RANGE_ADDR                /* Explicit addresses */
+} range_kind_t;
+
+/* A range of addresses of the child, traced or excluded */
+typedef struct
+{
+  range_kind_t kind;        /* Kind of the range */
+  bool exclude;             /* Not traced, whatever the other ranges */
+  const char *object;       /* Name or path of the file (RANGE_OBJECT) */
+  uintptr_t start;          /* First address (RANGE_ADDR) */
+  uintptr_t end;            /* Address following the range (RANGE_ADDR) */
+} range_t;
+
+/* Instructions traced: the ones in one of the included ranges (if any) and
+ * in none of the excluded ones */
+typedef struct
+{
+  range_t *ranges;          /* Ranges, in the order they were added */
+  size_t nb_ranges;         /* Number of ranges */
+  bool include;             /* Some ranges are included */
+  bool text;                /* Some ranges are RANGE_TEXT */
+} filter_t;
+
+/* Add the range described by spec to filter: 'text', START-END (in hex) or
+ * the name of a shared object ('libc', 'ld-linux-x86-64', '[vdso]'...) or
+ * its path. Returns false otherwise (and set errno) */
+bool filter_add (filter_t *filter, const char *spec, bool exclude);
+
+/* Tell if the instruction at ip, in a mapping of path (or NULL), is traced.
+ * The .text section of the executable is from text_start to text_end */
+bool filter_match (const filter_t *filter, uintptr_t ip, const char *path,
+                   uintptr_t text_start, uintptr_t text_end);
+
+/* Tell if some instruction from start to end (excluded), in a mapping of
+ * path (or NULL), may be traced */
+bool filter_overlap (const filter_t *filter, uintptr_t start, uintptr_t end,
+                     const char *path, uintptr_t text_start,
+                     uintptr_t text_end);
+
+/* Free the ranges of filter */
+void filter_clear (filter_t *filter);
+
+#endif /* _FILTER_H */
@@ -0,0 +1,273 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#define _GNU_SOURCE
+
+#include "forksrv.h"
+#include "image.h"
+#include "inject.h"
+#include "mem.h"
+
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+/* Opcode of 'int3', as the low byte of a code word */
+#define INT3_OPCODE 0xcc
+
+/* Mapping with the system call of its offset in pages on i386 */
+#if defined(__x86_64__) /* amd64 architecture */
+#define SERVER_MMAP SYS_mmap
+#elif defined(__i386__) /* i386 architecture */
+#define SERVER_MMAP SYS_mmap2
+#else
+#error Cannot build, we only support: x86-64 and i386 architectures
+#endif
+
+/* Get the instruction pointer of regs */
+static uintptr_t
+get_ip (const struct user_regs_struct *regs)
+{
+#if defined(__x86_64__) /* amd64 architecture */
+  return regs->rip;
+#elif defined(__i386__) /* i386 architecture */
+  return regs->eip;
+#endif
+}
+
+/* Set the instruction pointer of regs */
+static void
+set_ip (struct user_regs_struct *regs, uintptr_t ip)
+{
+#if defined(__x86_64__) /* amd64 architecture */
+  regs->rip = ip;
+#elif defined(__i386__) /* i386 architecture */
+  regs->eip = ip;
+#endif
+}
+
+/* Get the load bias of the executable of pid, from its entry point */
+static bool
+get_load_bias (pid_t pid, const image_t *img, uintptr_t *bias)
+{
+  *bias = 0;
+  if (img->type != ET_DYN)
+    return true;
+
+  uintptr_t entry = mem_get_entry (pid, FORKSRV_WIDE);
+  if (!entry)
+    {
+      errno = EINVAL;
+      return false;
+    }
+  *bias = entry - img->entry;
+  return true;
+}
+
+/* Get the address where to stop child, exec being its executable */
+static uintptr_t
+resolve (pid_t child, const char *exec, const char *where)
+{
+  const image_t *img = image_get (exec);
+  if (!img)
+    return 0;
+
+  uintptr_t addr = 0, bias;
+  if (img->wide != FORKSRV_WIDE)
+    errno = ENOEXEC;
+  else if (get_load_bias (child, img, &bias))
+    {
+      char *end;
+      addr = strtoull (where, &end, 0);
+      if (*where == '\0' || *end != '\0')
+        addr = image_find_symbol (img, where);
+      if (addr)
+        addr += bias;
+      else
+        errno = ENOENT;
+    }
+  return addr;
+}
+
+/* Run child up to addr, forwarding it its signals. Its registers and the
+ * code word at addr are stored in regs and word */
+static bool
+run_to (pid_t child, uintptr_t addr, struct user_regs_struct *regs,
+        long *word)
+{
+  errno = 0;
+  *word = ptrace (PTRACE_PEEKTEXT, child, addr, NULL);
+  if (errno
+      || ptrace (PTRACE_POKETEXT, child, addr,
+                 (*word & ~0xffL) | INT3_OPCODE) == -1)
+    return false;
+
+  int sig = 0, status;
+  while (true)
+    {
+      if (ptrace (PTRACE_CONT, child, NULL, sig) == -1
+          || waitpid (child, &status, 0) == -1)
+        return false;
+      if (!WIFSTOPPED (status))
+        {
+          errno = ESRCH;
+          return false;
+        }
+
+      sig = WSTOPSIG (status);
+      if (sig == SIGTRAP)
+        {
+          if (ptrace (PTRACE_GETREGS, child, NULL, regs) == -1)
+            return false;
+          if (get_ip (regs) == addr + 1)
+            break;
+          sig = 0;
+        }
+    }
+
+  set_ip (regs, addr);
+  return ptrace (PTRACE_POKETEXT, child, addr, *word) != -1
+    && ptrace (PTRACE_SETREGS, child, NULL, regs) != -1;
+}
+
+bool
+forksrv_start (forksrv_t *srv, pid_t child, const char *exec,
+               const char *where)
+{
+  forksrv_stop (srv);
+
+  srv->addr = resolve (child, exec, where);
+  srv->exec = strdup (exec);
+  srv->args = !strcmp (where, "main");
+  if (!srv->addr || !srv->exec
+      || !run_to (child, srv->addr, &(srv->regs), &(srv->word))
+      || ptrace (PTRACE_SETOPTIONS, child, NULL,
+                 PTRACE_O_TRACEFORK | PTRACE_O_EXITKILL) == -1)
+    {
+      int saved = errno;
+      kill (child, SIGKILL);
+      waitpid (child, NULL, __WALL);
+      free (srv->exec);
+      srv->exec = NULL;
+      errno = saved;
+      return false;
+    }
+  srv->pid = child;
+  return true;
+}
+
+/* Copy the arguments argv (of argc entries) in a new mapping of child, and
+ * give them to main() in regs */
+static bool
+set_args (pid_t child, struct user_regs_struct *regs, int argc, char *argv[])
+{
+  size_t len = (argc + 1) * sizeof (long);
+  for (int i = 0; i < argc; i++)
+    len += strlen (argv[i]) + 1;
+  len = (len + sizeof (long) - 1) & ~(sizeof (long) - 1);
+
+  long args[6] = { 0, len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 };
+  long base = inject_syscall (child, regs, FORKSRV_WIDE, SERVER_MMAP, args,
+                             NULL);
+  if (base == -1)
+    return false;
+
+  /* The pointers of argv, followed by their strings */
+  long *buf = calloc (len / sizeof (long), sizeof (long));
+  if (!buf)
+    return false;
+  char *str = (char *) (buf + argc + 1);
+  for (int i = 0; i < argc; i++)
+    {
+      buf[i] = base + (str - (char *) buf);
+      str = stpcpy (str, argv[i]) + 1;
+    }
+
+  bool ok = true;
+  for (size_t i = 0; ok && i < len / sizeof (long); i++)
+    ok = (ptrace (PTRACE_POKEDATA, child, base + i * sizeof (long), buf[i])
+          != -1);
+  free (buf);
+
+#if defined(__x86_64__) /* amd64 architecture, in registers */
+  regs->rdi = argc;
+  regs->rsi = base;
+#elif defined(__i386__) /* i386 architecture, past the return address */
+  ok = ok
+    && ptrace (PTRACE_POKEDATA, child, regs->esp + sizeof (long), argc) != -1
+    && ptrace (PTRACE_POKEDATA, child, regs->esp + 2 * sizeof (long), base)
+       != -1;
+#endif
+  return ok;
+}
+
+pid_t
+forksrv_fork (forksrv_t *srv, int argc, char *argv[])
+{
+  long args[6] = { 0 };
+  pid_t child = 0;
+  if (inject_syscall (srv->pid, &(srv->regs), FORKSRV_WIDE, SYS_fork, args,
+                      &child) == -1)
+    return -1;
+  if (child <= 0)
+    {
+      errno = ECHILD;
+      return -1;
+    }
+
+  /* The new child is a copy of the server in the middle of the fork */
+  int status;
+  struct user_regs_struct regs = srv->regs;
+  if (waitpid (child, &status, __WALL) == -1
+      || ptrace (PTRACE_POKETEXT, child, srv->addr, srv->word) == -1
+      || ptrace (PTRACE_SETREGS, child, NULL, &regs) == -1
+      || ptrace (PTRACE_SETOPTIONS, child, NULL, PTRACE_O_EXITKILL) == -1
+      || (srv->args && !set_args (child, &regs, argc, argv))
+      || ptrace (PTRACE_SETREGS, child, NULL, &regs) == -1)
+    {
+      int saved = errno;
+      kill (child, SIGKILL);
+      waitpid (child, NULL, __WALL);
+      forksrv_reap (srv, child);
+      errno = saved;
+      return -1;
+    }
+  return child;
+}
+
+void
+forksrv_reap (forksrv_t *srv, pid_t child)
+{
+  long args[6] = { child, 0, 0, 0, 0, 0 };
+  inject_syscall (srv->pid, &(srv->regs), FORKSRV_WIDE, SYS_wait4, args, NULL);
+}
+
+void
+forksrv_stop (forksrv_t *srv)
+{
+  if (srv->pid > 0)
+    {
+      kill (srv->pid, SIGKILL);
+      waitpid (srv->pid, NULL, __WALL);
+    }
+  free (srv->exec);
+  *srv = (forksrv_t) { 0 };
+}
@@ -0,0 +1,60 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#ifndef _FORKSRV_H
+#define _FORKSRV_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <sys/types.h>
+#include <sys/user.h>
+
+/* A fork server is of the architecture of tracker, 64-bit or not */
+#if defined(__x86_64__) /* amd64 architecture */
+#define FORKSRV_WIDE true
+#else
+#define FORKSRV_WIDE false
+#endif
+
+/* A fork server is a child (FORKSRV_WIDE) stopped once at a snapshot point,
+ * after execve() and the dynamic loader. The runs are forked from it, so
+ * that each starts from a clean copy of the snapshot */
+typedef struct
+{
+  pid_t pid;                /* Server process (0 if none) */
+  char *exec;               /* Executable it runs */
+  uintptr_t addr;           /* Address of the snapshot point */
+  long word;                /* Code word at addr */
+  bool args;                /* The snapshot point is main(), argc/argv are set */
+  struct user_regs_struct regs; /* Registers at the snapshot point */
+} forksrv_t;
+
+/* Turn child, stopped right after the execve() of exec, into the server of
+ * srv: run it up to where, 'main', the name of a function or an address of
+ * the executable. Returns false otherwise (and set errno), child is killed */
+bool forksrv_start (forksrv_t *srv, pid_t child, const char *exec,
+                    const char *where);
+
+/* Fork a new child from the snapshot, stopped at the snapshot point. Its
+ * arguments are set to argv (of argc entries) if it stops at main().
+ * Returns the child, -1 otherwise (and set errno) */
+pid_t forksrv_fork (forksrv_t *srv, int argc, char *argv[]);
+
+/* Let the server collect the exit status of child, once it is over */
+void forksrv_reap (forksrv_t *srv, pid_t child);
+
+/* Kill the server (if any) */
+void forksrv_stop (forksrv_t *srv);
+
+#endif /* _FORKSRV_H */
@@ -0,0 +1,378 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#define _GNU_SOURCE
+
+#include "fuzz.h"
+
+#include <string.h>
+
+/* Maximum number of mutations stacked on an input, as a power of 2 */
+#define MAX_STACK_POW 4
+
+/* Numbers an argument may be replaced with */
+static const char *interesting_args[] = {
+  "0", "1", "-1", "2", "3", "7", "16", "42", "100", "127", "128", "-128",
+  "255", "256", "1024", "4096", "32767", "-32768", "65535", "65536",
+  "2147483647", "-2147483648", "4294967295"
+};
+
+/* Bytes the standard input may be overwritten with */
+static const uint8_t interesting_bytes[] = {
+  0x00, 0x01, 0x10, 0x20, 0x40, 0x64, 0x7F, 0x80, 0xFF, '\n', '0', '9'
+};
+
+#define NB_INTERESTING_ARGS \
+  (sizeof (interesting_args) / sizeof (interesting_args[0]))
+#define NB_INTERESTING_BYTES \
+  (sizeof (interesting_bytes) / sizeof (interesting_bytes[0]))
+
+/* Get a random number below n (which is not 0), xorshift64* */
+static size_t
+rand_below (fuzzer_t *f, size_t n)
+{
+  f->rand ^= f->rand >> 12;
+  f->rand ^= f->rand << 25;
+  f->rand ^= f->rand >> 27;
+  return ((f->rand * 0x2545F4914F6CDD1DULL) >> 16) % n;
+}
+
+fuzzer_t *
+fuzzer_new (uint64_t seed, size_t max_command)
+{
+  fuzzer_t *f = calloc (1, sizeof (fuzzer_t));
+  if (!f)
+    return NULL;
+  f->rand = seed ? seed : 1;
+  f->max_command = max_command;
+  return f;
+}
+
+void
+fuzzer_delete (fuzzer_t *f)
+{
+  if (!f)
+    return;
+  for (size_t i = 0; i < f->nb_inputs; i++)
+    fuzz_input_clear (&(f->inputs[i]));
+  free (f->inputs);
+  free (f);
+}
+
+void
+fuzz_input_clear (fuzz_input_t *in)
+{
+  for (int i = 0; in->argv && i < in->argc; i++)
+    free (in->argv[i]);
+  free (in->argv);
+  free (in->data);
+  *in = (fuzz_input_t) { 0 };
+}
+
+/* Copy argv (of argc entries) and size bytes of data in in. Returns false
+ * otherwise, in is left empty */
+static bool
+input_set (fuzz_input_t *in, int argc, char *const argv[],
+           const uint8_t *data, size_t size, bool piped)
+{
+  *in = (fuzz_input_t) { argc, calloc (argc + 1, sizeof (char *)),
+                         malloc (size ? size : 1), size, piped };
+  if (!in->argv || !in->data)
+    {
+      fuzz_input_clear (in);
+      return false;
+    }
+  memcpy (in->data, data, size);
+  for (int i = 0; i < argc; i++)
+    if (!(in->argv[i] = strdup (argv[i])))
+      {
+        fuzz_input_clear (in);
+        return false;
+      }
+  return true;
+}
+
+bool
+fuzzer_keep (fuzzer_t *f, fuzz_input_t *in)
+{
+  if (f->nb_inputs == f->max_inputs)
+    {
+      size_t max = f->max_inputs ? 2 * f->max_inputs : 64;
+      fuzz_input_t *inputs = realloc (f->inputs, max * sizeof (fuzz_input_t));
+      if (!inputs)
+        return false;
+      f->inputs = inputs;
+      f->max_inputs = max;
+    }
+  f->inputs[f->nb_inputs++] = *in;
+  *in = (fuzz_input_t) { 0 };
+  return true;
+}
+
+bool
+fuzzer_add (fuzzer_t *f, int argc, char *argv[], const uint8_t *data,
+            size_t size, bool piped)
+{
+  fuzz_input_t in;
+  if (argc < 1 || size > FUZZ_MAX_DATA
+      || !input_set (&in, argc, argv, data, size, piped))
+    return false;
+  if (!fuzzer_keep (f, &in))
+    {
+      fuzz_input_clear (&in);
+      return false;
+    }
+  return true;
+}
+
+/* Get at most len bytes of one of the buffers (argument or data) of the
+ * inputs of f, at random. Returns NULL if the one picked is empty */
+static const uint8_t *
+splice_source (fuzzer_t *f, size_t *len)
+{
+  const fuzz_input_t *in = &(f->inputs[rand_below (f, f->nb_inputs)]);
+  size_t n = rand_below (f, in->argc + 1);
+  const uint8_t *src = (n < (size_t) in->argc)
+    ? (const uint8_t *) in->argv[n] : in->data;
+  size_t size = (n < (size_t) in->argc) ? strlen (in->argv[n]) : in->size;
+  if (size == 0 || n == 0)
+    return NULL;
+
+  size_t start = rand_below (f, size);
+  if (*len > size - start)
+    *len = size - start;
+  return src + start;
+}
+
+/* Apply one mutation on the len bytes of buf, which holds max bytes. Text
+ * (arguments) is mutated with numbers, binary data with bytes */
+static void
+mutate_bytes (fuzzer_t *f, uint8_t *buf, size_t *len, size_t max, bool text)
+{
+  size_t op = rand_below (f, 8);
+  if (*len == 0 && op < 5)
+    op = 5;
+
+  switch (op)
+    {
+    case 0:     /* Flip a bit */
+      buf[rand_below (f, *len)] ^= 1 << rand_below (f, 8);
+      break;
+
+    case 1:     /* Random byte */
+      buf[rand_below (f, *len)] = rand_below (f, 256);
+      break;
+
+    case 2:     /* Add or remove a little */
+      {
+        size_t pos = rand_below (f, *len);
+        int delta = 1 + rand_below (f, 16);
+        buf[pos] += rand_below (f, 2) ? delta : -delta;
+      }
+      break;
+
+    case 3:     /* Interesting byte */
+      buf[rand_below (f, *len)] =
+        interesting_bytes[rand_below (f, NB_INTERESTING_BYTES)];
+      break;
+
+    case 4:     /* Delete some bytes */
+      {
+        size_t pos = rand_below (f, *len);
+        size_t n = 1 + rand_below (f, *len - pos);
+        memmove (buf + pos, buf + pos + n, *len - pos - n);
+        *len -= n;
+      }
+      break;
+
+    case 5:     /* Insert some bytes, copied or all the same */
+      {
+        if (*len == max)
+          break;
+        size_t pos = rand_below (f, *len + 1);
+        size_t n = 1 + rand_below (f, (max - *len < 32) ? max - *len : 32);
+        memmove (buf + pos + n, buf + pos, *len - pos);
+        if (*len > n && rand_below (f, 2))
+          memmove (buf + pos, buf + rand_below (f, *len - n), n);
+        else
+          memset (buf + pos, text ? '0' + rand_below (f, 10)
+                  : rand_below (f, 256), n);
+        *len += n;
+      }
+      break;
+
+    case 6:     /* A whole interesting number, or bytes of one */
+      if (text)
+        {
+          const char *arg =
+            interesting_args[rand_below (f, NB_INTERESTING_ARGS)];
+          size_t n = strlen (arg);
+          if (n <= max)
+            {
+              memcpy (buf, arg, n);
+              *len = n;
+            }
+        }
+      else if (*len > 0)
+        buf[rand_below (f, *len)] =
+          interesting_bytes[rand_below (f, NB_INTERESTING_BYTES)];
+      break;
+
+    case 7:     /* Overwrite with a chunk of another input */
+      {
+        size_t pos = rand_below (f, *len + 1);
+        size_t n = 1 + rand_below (f, 32);
+        if (n > max - pos)
+          n = max - pos;
+        const uint8_t *src = splice_source (f, &n);
+        if (!src || n == 0)
+          break;
+        memmove (buf + pos, src, n);
+        if (pos + n > *len)
+          *len = pos + n;
+      }
+      break;
+    }
+
+  /* Arguments are strings */
+  if (text)
+    for (size_t i = 0; i < *len; i++)
+      if (buf[i] == '\0')
+        buf[i] = '0';
+}
+
+/* Mutate the argument number n of in in buf (of f->max_command bytes),
+ * keeping the arguments below that when joined. Returns false otherwise */
+static bool
+mutate_arg (fuzzer_t *f, fuzz_input_t *in, int n, uint8_t *buf)
+{
+  size_t others = 0;
+  for (int i = 0; i < in->argc; i++)
+    if (i != n)
+      others += strlen (in->argv[i]) + 1;
+  if (others >= f->max_command)
+    return true;
+
+  size_t max = f->max_command - others - 1;
+  size_t len = strlen (in->argv[n]);
+  if (len > max)
+    len = max;
+  memcpy (buf, in->argv[n], len);
+  mutate_bytes (f, buf, &len, max, true);
+
+  char *arg = strndup ((char *) buf, len);
+  if (!arg)
+    return false;
+  free (in->argv[n]);
+  in->argv[n] = arg;
+  return true;
+}
+
+bool
+fuzzer_mutate (fuzzer_t *f, fuzz_input_t *in)
+{
+  if (f->nb_inputs == 0)
+    return false;
+
+  const fuzz_input_t *parent = &(f->inputs[rand_below (f, f->nb_inputs)]);
+  if (!input_set (in, parent->argc, parent->argv, parent->data,
+                  parent->size, parent->piped))
+    return false;
+
+  /* The standard input is mutated in data, the arguments in arg */
+  uint8_t *data = in->piped ? malloc (FUZZ_MAX_DATA) : NULL;
+  uint8_t *arg = malloc (f->max_command);
+  bool ok = (arg && (data || !in->piped));
+  if (data)
+    memcpy (data, in->data, in->size);
+
+  size_t nb_bufs = (in->argc - 1) + in->piped;
+  size_t nb = (size_t) 1 << (1 + rand_below (f, MAX_STACK_POW));
+  for (size_t i = 0; ok && nb_bufs > 0 && i < nb; i++)
+    {
+      size_t n = rand_below (f, nb_bufs);
+      if (n < (size_t) in->argc - 1)
+        ok = mutate_arg (f, in, n + 1, arg);
+      else
+        mutate_bytes (f, data, &(in->size), FUZZ_MAX_DATA, false);
+    }
+
+  if (ok && data)
+    {
+      uint8_t *tmp = realloc (in->data, in->size ? in->size : 1);
+      if ((ok = (tmp != NULL)))
+        {
+          memcpy (tmp, data, in->size);
+          in->data = tmp;
+        }
+    }
+  free (data);
+  free (arg);
+  if (!ok)
+    fuzz_input_clear (in);
+  return ok;
+}
+
+/* Bucket of a hit count, as a bit */
+static uint8_t
+bucket (uint8_t hits)
+{
+  if (hits <= 2)
+    return hits;
+  if (hits == 3)
+    return 4;
+  if (hits < 8)
+    return 8;
+  if (hits < 16)
+    return 16;
+  if (hits < 32)
+    return 32;
+  return (hits < 128) ? 64 : 128;
+}
+
+size_t
+fuzzer_update (fuzzer_t *f, const uint8_t *map)
+{
+  size_t news = 0;
+
+  /* Most of the map is empty, skip it a word at a time */
+  for (size_t i = 0; i < EDGE_MAP_SIZE; i += sizeof (uint64_t))
+    {
+      uint64_t word;
+      memcpy (&word, map + i, sizeof (uint64_t));
+      if (!word)
+        continue;
+
+      for (size_t k = i; k < i + sizeof (uint64_t); k++)
+        {
+          uint8_t b = bucket (map[k]);
+          if (!(b & ~f->seen[k]))
+            continue;
+          if (!f->seen[k])
+            f->nb_edges++;
+          f->seen[k] |= b;
+          news++;
+        }
+    }
+  return news;
+}
+
+void
+fuzzer_know (fuzzer_t *f, const uint8_t *map)
+{
+  for (size_t i = 0; i < EDGE_MAP_SIZE; i++)
+    if (map[i] && !f->seen[i])
+      {
+        f->seen[i] = bucket (1);
+        f->nb_edges++;
+      }
+}
@@ -0,0 +1,79 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#ifndef _FUZZ_H
+#define _FUZZ_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <trace.h>
+
+/* Maximum size of the standard input of a run */
+#define FUZZ_MAX_DATA 65536
+
+/* An input of the traced program: its arguments and standard input */
+typedef struct
+{
+  int argc;                 /* Number of arguments (with the executable) */
+  char **argv;              /* Arguments, NULL terminated */
+  uint8_t *data;            /* Content of the standard input */
+  size_t size;              /* Size of data */
+  bool piped;               /* The standard input is mutated */
+} fuzz_input_t;
+
+/* Inputs reaching some new coverage, and the coverage of all of them. The
+ * coverage of a run is an edge map (see EDGE_INDEX) */
+typedef struct
+{
+  fuzz_input_t *inputs;     /* Inputs kept, mutated in turn */
+  size_t nb_inputs;         /* Number of inputs */
+  size_t max_inputs;        /* Allocated size of inputs */
+  size_t max_command;       /* Maximum length of the arguments (joined) */
+  uint64_t rand;            /* State of the random generator */
+  size_t nb_edges;          /* Number of edges covered */
+  uint8_t seen[EDGE_MAP_SIZE]; /* Buckets of hit counts seen, by entry */
+} fuzzer_t;
+
+/* Create a fuzzer without any input, seeded with seed. The arguments of the
+ * inputs, joined by spaces, stay below max_command bytes */
+fuzzer_t *fuzzer_new (uint64_t seed, size_t max_command);
+
+/* Free the given fuzzer and its inputs */
+void fuzzer_delete (fuzzer_t *f);
+
+/* Add a copy of the input argv (of argc entries) with size bytes of data as
+ * standard input (mutated only if piped). Returns false otherwise */
+bool fuzzer_add (fuzzer_t *f, int argc, char *argv[], const uint8_t *data,
+                 size_t size, bool piped);
+
+/* Add the input in (mutated by fuzzer_mutate), f now owns its content */
+bool fuzzer_keep (fuzzer_t *f, fuzz_input_t *in);
+
+/* Build a new input in in, by mutating one of the inputs of f. The program
+ * and the number of arguments are kept. Returns false otherwise */
+bool fuzzer_mutate (fuzzer_t *f, fuzz_input_t *in);
+
+/* Merge the coverage map of a run in the coverage of f. Returns the number
+ * of entries of map hit more often than ever before (in buckets of hit
+ * counts: 1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+) */
+size_t fuzzer_update (fuzzer_t *f, const uint8_t *map);
+
+/* Mark the edges of map as covered, whatever their hit counts (the edge
+ * map of a cfg, for instance) */
+void fuzzer_know (fuzzer_t *f, const uint8_t *map);
+
+/* Free the content of an input */
+void fuzz_input_clear (fuzz_input_t *in);
+
+#endif /* _FUZZ_H */
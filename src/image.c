@@ -0,0 +1,376 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#define _GNU_SOURCE
+
+#include "image.h"
+
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+
+/* A section header, whatever the class of the file */
+typedef struct
+{
+  uint32_t name;            /* Offset of its name in .shstrtab */
+  uint32_t type;            /* Type (SHT_*) */
+  uint32_t link;            /* Index of the section it refers to */
+  uint64_t addr;            /* Address it is loaded at */
+  uint64_t offset;          /* Offset of its content in the file */
+  uint64_t size;            /* Size of its content */
+} section_t;
+
+/* Images kept by image_get(), shared by the threads */
+static image_t **images = NULL;
+static size_t nb_images = 0;
+static size_t max_images = 0;
+static pthread_mutex_t images_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Tell if the len bytes at offset are in the file */
+static inline bool
+in_file (const image_t *img, uint64_t offset, uint64_t len)
+{
+  return offset <= img->size && len <= img->size - offset;
+}
+
+/* Copy the file header of img (of its class) in eh, fields are widened */
+static bool
+get_header (const image_t *img, Elf64_Ehdr *eh)
+{
+  if (img->wide)
+    {
+      if (!in_file (img, 0, sizeof (Elf64_Ehdr)))
+        return false;
+      memcpy (eh, img->data, sizeof (Elf64_Ehdr));
+      return eh->e_shentsize == sizeof (Elf64_Shdr) || eh->e_shnum == 0;
+    }
+
+  Elf32_Ehdr h;
+  if (!in_file (img, 0, sizeof (Elf32_Ehdr)))
+    return false;
+  memcpy (&h, img->data, sizeof (Elf32_Ehdr));
+  memcpy (eh->e_ident, h.e_ident, EI_NIDENT);
+  eh->e_type = h.e_type;
+  eh->e_machine = h.e_machine;
+  eh->e_entry = h.e_entry;
+  eh->e_phoff = h.e_phoff;
+  eh->e_shoff = h.e_shoff;
+  eh->e_phentsize = h.e_phentsize;
+  eh->e_phnum = h.e_phnum;
+  eh->e_shentsize = h.e_shentsize;
+  eh->e_shnum = h.e_shnum;
+  eh->e_shstrndx = h.e_shstrndx;
+  return eh->e_shentsize == sizeof (Elf32_Shdr) || eh->e_shnum == 0;
+}
+
+/* Copy section i of img, whose header is eh, in s */
+static bool
+get_section (const image_t *img, const Elf64_Ehdr *eh, size_t i,
+             section_t *s)
+{
+  if (i >= eh->e_shnum
+      || !in_file (img, eh->e_shoff, (uint64_t) eh->e_shnum
+                   * eh->e_shentsize))
+    return false;
+
+  const uint8_t *at = img->data + eh->e_shoff + i * eh->e_shentsize;
+  if (img->wide)
+    {
+      Elf64_Shdr sh;
+      memcpy (&sh, at, sizeof (sh));
+      *s = (section_t) { sh.sh_name, sh.sh_type, sh.sh_link, sh.sh_addr,
+                         sh.sh_offset, sh.sh_size };
+    }
+  else
+    {
+      Elf32_Shdr sh;
+      memcpy (&sh, at, sizeof (sh));
+      *s = (section_t) { sh.sh_name, sh.sh_type, sh.sh_link, sh.sh_addr,
+                         sh.sh_offset, sh.sh_size };
+    }
+  return true;
+}
+
+/* Find .text in the sections of img */
+static void
+find_text (image_t *img, const Elf64_Ehdr *eh)
+{
+  section_t strtab;
+  if (!get_section (img, eh, eh->e_shstrndx, &strtab)
+      || !in_file (img, strtab.offset, strtab.size))
+    return;
+
+  section_t s;
+  for (size_t i = 0; get_section (img, eh, i, &s); i++)
+    if (s.type == SHT_PROGBITS && s.name < strtab.size
+        && !strncmp ((const char *) img->data + strtab.offset + s.name,
+                     ".text", strtab.size - s.name)
+        && in_file (img, s.offset, s.size))
+      {
+        img->has_text = true;
+        img->text_addr = s.addr;
+        img->text_size = s.size;
+        img->text_offset = s.offset;
+        return;
+      }
+}
+
+/* Collect the executable segments of img, whose header is eh */
+static bool
+find_segments (image_t *img, const Elf64_Ehdr *eh)
+{
+  size_t entsize = img->wide ? sizeof (Elf64_Phdr) : sizeof (Elf32_Phdr);
+  if (eh->e_phnum == 0)
+    return true;
+  if (eh->e_phentsize != entsize
+      || !in_file (img, eh->e_phoff, (uint64_t) eh->e_phnum * entsize))
+    return false;
+
+  img->segments = calloc (eh->e_phnum, sizeof (segment_t));
+  if (!img->segments)
+    return false;
+
+  for (size_t i = 0; i < eh->e_phnum; i++)
+    {
+      const uint8_t *at = img->data + eh->e_phoff + i * entsize;
+      Elf64_Phdr ph;
+      if (img->wide)
+        memcpy (&ph, at, sizeof (ph));
+      else
+        {
+          Elf32_Phdr ph32;
+          memcpy (&ph32, at, sizeof (ph32));
+          ph = (Elf64_Phdr) { .p_type = ph32.p_type, .p_flags = ph32.p_flags,
+                              .p_offset = ph32.p_offset,
+                              .p_vaddr = ph32.p_vaddr,
+                              .p_filesz = ph32.p_filesz,
+                              .p_memsz = ph32.p_memsz };
+        }
+
+      /* The part of the segment beyond the end of the file is ignored */
+      if (ph.p_type != PT_LOAD || !(ph.p_flags & PF_X))
+        continue;
+      uint64_t file_size = ph.p_filesz;
+      if (!in_file (img, ph.p_offset, file_size))
+        file_size = (ph.p_offset < img->size) ? img->size - ph.p_offset : 0;
+      img->segments[img->nb_segments++] = (segment_t) {
+        ph.p_vaddr, ph.p_memsz, ph.p_offset, file_size };
+    }
+  return true;
+}
+
+/* Parse the headers of img. Returns false if it is not a valid ELF file */
+static bool
+parse (image_t *img)
+{
+  const uint8_t *id = img->data;
+  if (img->size < EI_NIDENT || memcmp (id, ELFMAG, SELFMAG)
+      || (id[EI_CLASS] != ELFCLASS32 && id[EI_CLASS] != ELFCLASS64)
+      || id[EI_DATA] != ELFDATA2LSB)
+    return false;
+
+  img->wide = (id[EI_CLASS] == ELFCLASS64);
+  Elf64_Ehdr eh;
+  if (!get_header (img, &eh))
+    return false;
+  img->machine = eh.e_machine;
+  img->type = eh.e_type;
+  img->entry = eh.e_entry;
+
+  find_text (img, &eh);
+  return find_segments (img, &eh);
+}
+
+image_t *
+image_open (const char *path)
+{
+  image_t *img = calloc (1, sizeof (image_t));
+  if (!img)
+    return NULL;
+  img->data = MAP_FAILED;
+
+  int fd = open (path, O_RDONLY | O_CLOEXEC);
+  if (fd == -1 || fstat (fd, &(img->st)) == -1)
+    goto fail;
+  if (!S_ISREG (img->st.st_mode) || !(img->st.st_mode & S_IXUSR))
+    {
+      errno = EACCES;
+      goto fail;
+    }
+
+  img->size = img->st.st_size;
+  if (img->size > 0)
+    img->data = mmap (NULL, img->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (img->data == MAP_FAILED && img->size > 0)
+    goto fail;
+  close (fd);
+  fd = -1;
+
+  img->path = strdup (path);
+  if (!img->path)
+    goto fail;
+  if (img->size == 0 || !parse (img))
+    {
+      errno = ENOEXEC;
+      goto fail;
+    }
+  return img;
+
+ fail:
+  if (fd != -1)
+    close (fd);
+  int error = errno;
+  image_close (img);
+  errno = error;
+  return NULL;
+}
+
+void
+image_close (image_t *img)
+{
+  if (!img)
+    return;
+  if (img->data != MAP_FAILED && img->size > 0)
+    munmap ((void *) img->data, img->size);
+  free (img->segments);
+  free (img->path);
+  free (img);
+}
+
+/* Tell if the file at path is still the one img was mapped from */
+static bool
+image_current (const image_t *img, const char *path)
+{
+  struct stat st;
+  return !strcmp (img->path, path) && stat (path, &st) == 0
+    && st.st_dev == img->st.st_dev && st.st_ino == img->st.st_ino
+    && st.st_size == img->st.st_size
+    && st.st_mtim.tv_sec == img->st.st_mtim.tv_sec
+    && st.st_mtim.tv_nsec == img->st.st_mtim.tv_nsec;
+}
+
+const image_t *
+image_get (const char *path)
+{
+  pthread_mutex_lock (&images_lock);
+  for (size_t i = 0; i < nb_images; i++)
+    if (image_current (images[i], path))
+      {
+        pthread_mutex_unlock (&images_lock);
+        return images[i];
+      }
+
+  /* Older images of the path may still be used, they are kept */
+  image_t *img = image_open (path);
+  if (img && nb_images == max_images)
+    {
+      size_t max = max_images ? 2 * max_images : 16;
+      image_t **array = realloc (images, max * sizeof (image_t *));
+      if (!array)
+        {
+          image_close (img);
+          img = NULL;
+          errno = ENOMEM;
+        }
+      else
+        {
+          images = array;
+          max_images = max;
+        }
+    }
+  if (img)
+    images[nb_images++] = img;
+  pthread_mutex_unlock (&images_lock);
+  return img;
+}
+
+void
+image_flush (void)
+{
+  pthread_mutex_lock (&images_lock);
+  for (size_t i = 0; i < nb_images; i++)
+    image_close (images[i]);
+  free (images);
+  images = NULL;
+  nb_images = max_images = 0;
+  pthread_mutex_unlock (&images_lock);
+}
+
+uintptr_t
+image_find_symbol (const image_t *img, const char *name)
+{
+  Elf64_Ehdr eh;
+  if (!get_header (img, &eh))
+    return 0;
+
+  section_t s, strtab;
+  for (size_t i = 0; get_section (img, &eh, i, &s); i++)
+    {
+      if ((s.type != SHT_SYMTAB && s.type != SHT_DYNSYM)
+          || !get_section (img, &eh, s.link, &strtab)
+          || !in_file (img, s.offset, s.size)
+          || !in_file (img, strtab.offset, strtab.size))
+        continue;
+
+      const char *strs = (const char *) img->data + strtab.offset;
+      size_t entsize = img->wide ? sizeof (Elf64_Sym) : sizeof (Elf32_Sym);
+      for (size_t k = 0; k < s.size / entsize; k++)
+        {
+          const uint8_t *at = img->data + s.offset + k * entsize;
+          uint32_t st_name;
+          uint64_t st_value;
+          unsigned char st_info;
+          if (img->wide)
+            {
+              Elf64_Sym sym;
+              memcpy (&sym, at, sizeof (sym));
+              st_name = sym.st_name;
+              st_value = sym.st_value;
+              st_info = sym.st_info;
+            }
+          else
+            {
+              Elf32_Sym sym;
+              memcpy (&sym, at, sizeof (sym));
+              st_name = sym.st_name;
+              st_value = sym.st_value;
+              st_info = sym.st_info;
+            }
+
+          if (ELF64_ST_TYPE (st_info) == STT_FUNC && st_value
+              && st_name < strtab.size
+              && !strncmp (strs + st_name, name, strtab.size - st_name)
+              && strlen (name) < strtab.size - st_name)
+            return st_value;
+        }
+    }
+  return 0;
+}
+
+const uint8_t *
+image_read (const image_t *img, uintptr_t addr, size_t *len)
+{
+  for (size_t i = 0; i < img->nb_segments; i++)
+    {
+      const segment_t *seg = &(img->segments[i]);
+      if (addr < seg->addr || addr - seg->addr >= seg->file_size)
+        continue;
+      *len = seg->file_size - (addr - seg->addr);
+      return img->data + seg->offset + (addr - seg->addr);
+    }
+  return NULL;
+}
@@ -0,0 +1,76 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#ifndef _IMAGE_H
+#define _IMAGE_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/* An executable segment of an image, as loaded (PT_LOAD) */
+typedef struct
+{
+  uintptr_t addr;           /* Address it is loaded at (before any bias) */
+  size_t size;              /* Size in memory */
+  size_t offset;            /* Offset of its content in the file */
+  size_t file_size;         /* Size of its content in the file */
+} segment_t;
+
+/* An ELF file mapped in memory (an executable, 32 or 64-bit), and what the
+ * tracer needs of its headers */
+typedef struct
+{
+  char *path;               /* Path it was opened with */
+  struct stat st;           /* Status of the file when it was mapped */
+  const uint8_t *data;      /* Content of the file */
+  size_t size;              /* Size of data */
+  bool wide;                /* ELFCLASS64, or else ELFCLASS32 */
+  uint16_t machine;         /* e_machine (EM_386, EM_X86_64...) */
+  uint16_t type;            /* e_type (ET_EXEC or ET_DYN) */
+  uintptr_t entry;          /* Entry point (before any bias) */
+  bool has_text;            /* There is a .text section */
+  uintptr_t text_addr;      /* Address of .text (before any bias) */
+  size_t text_size;         /* Size of .text */
+  size_t text_offset;       /* Offset of .text in the file */
+  segment_t *segments;      /* Executable segments, by address */
+  size_t nb_segments;       /* Number of segments */
+} image_t;
+
+/* Map the ELF file at path and parse its headers. Returns NULL otherwise
+ * (and set errno: EACCES if it is not a regular executable file, ENOEXEC if
+ * it is not a valid ELF file) */
+image_t *image_open (const char *path);
+
+/* Unmap the image and free it */
+void image_close (image_t *img);
+
+/* Get the image of the file at path, from the images opened before if it
+ * did not change since. Images are shared by all threads, and stay until
+ * image_flush(). Returns NULL otherwise (as image_open) */
+const image_t *image_get (const char *path);
+
+/* Close every image kept by image_get() */
+void image_flush (void);
+
+/* Get the address of the function name in the symbols of img (before any
+ * bias). Returns 0 if there is none */
+uintptr_t image_find_symbol (const image_t *img, const char *name);
+
+/* Get the bytes of img loaded at addr (before any bias), up to the end of
+ * its segment, in len. Returns NULL if none is loaded from the file there */
+const uint8_t *image_read (const image_t *img, uintptr_t addr, size_t *len);
+
+#endif /* _IMAGE_H */
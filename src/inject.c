@@ -0,0 +1,155 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#define _GNU_SOURCE
+
+#include "inject.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+
+#include <sys/ptrace.h>
+#include <sys/wait.h>
+
+/* Opcodes of 'syscall' and 'int 0x80', as the low bytes of a code word */
+#define SYSCALL_OPCODES 0x050f
+#define INT80_OPCODES 0x80cd
+
+/* Get the instruction pointer of regs */
+static uintptr_t
+get_ip (const struct user_regs_struct *regs)
+{
+#if defined(__x86_64__) /* amd64 architecture */
+  return regs->rip;
+#elif defined(__i386__) /* i386 architecture */
+  return regs->eip;
+#else
+#error Cannot build, we only support: x86-64 and i386 architectures
+#endif
+}
+
+/* Set the system call nr on args in regs, wide for a 64-bit process */
+static void
+set_call (struct user_regs_struct *regs, bool wide, long nr,
+          const long args[6])
+{
+#if defined(__x86_64__) /* amd64 architecture */
+  regs->rax = nr;
+  regs->orig_rax = -1;
+  if (wide)
+    {
+      regs->rdi = args[0];
+      regs->rsi = args[1];
+      regs->rdx = args[2];
+      regs->r10 = args[3];
+      regs->r8 = args[4];
+      regs->r9 = args[5];
+    }
+  else
+    {
+      regs->rbx = args[0];
+      regs->rcx = args[1];
+      regs->rdx = args[2];
+      regs->rsi = args[3];
+      regs->rdi = args[4];
+      regs->rbp = args[5];
+    }
+#elif defined(__i386__) /* i386 architecture, every process is 32-bit */
+  (void) wide;
+  regs->eax = nr;
+  regs->orig_eax = -1;
+  regs->ebx = args[0];
+  regs->ecx = args[1];
+  regs->edx = args[2];
+  regs->esi = args[3];
+  regs->edi = args[4];
+  regs->ebp = args[5];
+#endif
+}
+
+/* Get the result of the system call in regs */
+static long
+get_result (const struct user_regs_struct *regs, bool wide)
+{
+#if defined(__x86_64__) /* amd64 architecture */
+  return wide ? (long) regs->rax : (long) (int32_t) regs->rax;
+#elif defined(__i386__) /* i386 architecture */
+  (void) wide;
+  return regs->eax;
+#endif
+}
+
+long
+inject_syscall (pid_t pid, const struct user_regs_struct *regs, bool wide,
+                long nr, const long args[6], pid_t *forked)
+{
+  uintptr_t ip = get_ip (regs);
+  errno = 0;
+  long word = ptrace (PTRACE_PEEKTEXT, pid, ip, NULL);
+  if (errno)
+    return -1;
+
+  struct user_regs_struct call = *regs;
+  set_call (&call, wide, nr, args);
+  long opcodes = wide ? SYSCALL_OPCODES : INT80_OPCODES;
+  if (ptrace (PTRACE_POKETEXT, pid, ip, (word & ~0xffffL) | opcodes) == -1
+      || ptrace (PTRACE_SETREGS, pid, NULL, &call) == -1)
+    return -1;
+
+  long ret = -1;
+  int status, pending = 0;
+  while (true)
+    {
+      if (ptrace (PTRACE_SINGLESTEP, pid, NULL, NULL) == -1
+          || waitpid (pid, &status, __WALL) == -1)
+        goto restore;
+      if (!WIFSTOPPED (status))
+        {
+          errno = ESRCH;
+          return -1;
+        }
+
+      if (status >> 8 == (SIGTRAP | (PTRACE_EVENT_FORK << 8)))
+        {
+          unsigned long msg;
+          ptrace (PTRACE_GETEVENTMSG, pid, NULL, &msg);
+          if (forked)
+            *forked = msg;
+          continue;
+        }
+      /* Other signals are sent again once the call is over */
+      if (WSTOPSIG (status) == SIGTRAP)
+        break;
+      pending = WSTOPSIG (status);
+    }
+
+  if (ptrace (PTRACE_GETREGS, pid, NULL, &call) == -1)
+    goto restore;
+  ret = get_result (&call, wide);
+  if (ret < 0 && ret > -4096)
+    {
+      errno = -ret;
+      ret = -1;
+    }
+
+ restore:
+  {
+    int saved = errno;
+    ptrace (PTRACE_POKETEXT, pid, ip, word);
+    ptrace (PTRACE_SETREGS, pid, NULL, regs);
+    if (pending)
+      kill (pid, pending);
+    errno = saved;
+  }
+  return ret;
+}
@@ -0,0 +1,29 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#ifndef _INJECT_H
+#define _INJECT_H
+
+#include <stdbool.h>
+
+#include <sys/types.h>
+#include <sys/user.h>
+
+/* Run the system call nr on args in the stopped process pid, as if it was
+ * at regs, which are restored afterwards. The process is 64-bit if wide
+ * ('syscall'), 32-bit otherwise ('int 0x80', nr and args of i386). The
+ * process it forks meanwhile (if any) is stored in forked. Returns its
+ * result, -1 otherwise (and set errno) */
+long inject_syscall (pid_t pid, const struct user_regs_struct *regs,
+                     bool wide, long nr, const long args[6], pid_t *forked);
+
+#endif /* _INJECT_H */
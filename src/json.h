@@ -0,0 +1,31 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#ifndef _JSON_H
+#define _JSON_H
+
+#include <stdio.h>
+
+/* Write s in a quoted string, escaped as JSON wants it */
+static inline void
+json_puts (FILE *out, const char *s)
+{
+  for (; *s; s++)
+    if (*s == '"' || *s == '\\')
+      fprintf (out, "\\%c", *s);
+    else if ((unsigned char) *s < 0x20)
+      fprintf (out, "\\u%04x", (unsigned char) *s);
+    else
+      fputc (*s, out);
+}
+
+#endif /* _JSON_H */
@@ -0,0 +1,293 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#define _GNU_SOURCE
+
+#include "mem.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <elf.h>
+#include <limits.h>
+
+#include <sys/uio.h>
+
+/* Maximum length of a path in /proc */
+#define MAX_PROC_PATH 64
+
+/* Maximum length of a line of /proc/<pid>/maps, after the permissions */
+#define MAX_MAPS_LINE (PATH_MAX + 128)
+
+uintptr_t
+mem_get_entry (pid_t pid, bool wide)
+{
+  char path[MAX_PROC_PATH];
+  snprintf (path, MAX_PROC_PATH, "/proc/%d/auxv", (int) pid);
+  FILE *auxv = fopen (path, "re");
+  if (!auxv)
+    return 0;
+
+  /* Pairs of words: type and value, up to AT_NULL */
+  uintptr_t entry = 0;
+  while (true)
+    {
+      uint64_t type, value;
+      if (wide)
+        {
+          Elf64_auxv_t aux;
+          if (fread (&aux, sizeof (aux), 1, auxv) != 1)
+            break;
+          type = aux.a_type;
+          value = aux.a_un.a_val;
+        }
+      else
+        {
+          Elf32_auxv_t aux;
+          if (fread (&aux, sizeof (aux), 1, auxv) != 1)
+            break;
+          type = aux.a_type;
+          value = aux.a_un.a_val;
+        }
+      if (type == AT_NULL)
+        break;
+      if (type == AT_ENTRY)
+        {
+          entry = value;
+          break;
+        }
+    }
+  fclose (auxv);
+  return entry;
+}
+
+mem_t *
+mem_new (pid_t pid)
+{
+  mem_t *mem = calloc (1, sizeof (mem_t));
+  if (!mem)
+    return NULL;
+
+  mem->pid = pid;
+  mem->fd = -1;
+  mem->page_size = sysconf (_SC_PAGESIZE);
+  if (!mem_update (mem))
+    {
+      int saved = errno;
+      mem_delete (mem);
+      errno = saved;
+      return NULL;
+    }
+  return mem;
+}
+
+/* Drop the snapshots of all the regions */
+static void
+mem_drop (mem_t *mem)
+{
+  for (size_t i = 0; i < mem->nb_regions; i++)
+    {
+      free (mem->regions[i].snapshot);
+      free (mem->regions[i].loaded);
+      free (mem->regions[i].path);
+    }
+  mem->nb_regions = 0;
+}
+
+void
+mem_delete (mem_t *mem)
+{
+  if (!mem)
+    return;
+  mem_drop (mem);
+  if (mem->fd != -1)
+    close (mem->fd);
+  free (mem->regions);
+  free (mem);
+}
+
+bool
+mem_update (mem_t *mem)
+{
+  char path[MAX_PROC_PATH];
+  snprintf (path, MAX_PROC_PATH, "/proc/%d/maps", (int) mem->pid);
+
+  FILE *maps = fopen (path, "re");
+  if (!maps)
+    return false;
+
+  /* Lines are: start-end perms offset dev inode [path] */
+  mem_drop (mem);
+  uintptr_t start, end;
+  char perms[5];
+  char line[MAX_MAPS_LINE];
+  int c;
+  while (fscanf (maps, "%" SCNxPTR "-%" SCNxPTR " %4s", &start, &end,
+                 perms) == 3)
+    {
+      if (!fgets (line, MAX_MAPS_LINE, maps))
+        line[0] = '\0';
+      size_t len = strlen (line);
+      if (len > 0 && line[len - 1] == '\n')
+        line[--len] = '\0';
+      else
+        while ((c = fgetc (maps)) != EOF && c != '\n');
+
+      if (perms[2] != 'x')
+        continue;
+
+      /* The path follows the offset, device and inode */
+      int n = 0;
+      sscanf (line, "%*s %*s %*s %n", &n);
+      char *name = (n > 0 && line[n]) ? strdup (line + n) : NULL;
+
+      if (mem->nb_regions == mem->max_regions)
+        {
+          size_t max = mem->max_regions ? 2 * mem->max_regions : 16;
+          region_t *regions = realloc (mem->regions, max * sizeof (region_t));
+          if (!regions)
+            {
+              free (name);
+              fclose (maps);
+              return false;
+            }
+          mem->regions = regions;
+          mem->max_regions = max;
+        }
+      mem->regions[mem->nb_regions++] =
+        (region_t) { start, end, perms[1] == 'w', name, NULL, NULL };
+    }
+  fclose (maps);
+  return true;
+}
+
+/* Copy len bytes of the child at addr in buf, straight from its memory */
+static bool
+mem_copy (mem_t *mem, uintptr_t addr, uint8_t *buf, size_t len)
+{
+  if (mem->fd == -1)
+    {
+      struct iovec local = { buf, len };
+      struct iovec remote = { (void *) addr, len };
+      ssize_t n = process_vm_readv (mem->pid, &local, 1, &remote, 1, 0);
+      if (n == (ssize_t) len)
+        return true;
+      if (n != -1 || (errno != ENOSYS && errno != EPERM))
+        return false;
+
+      /* Not allowed here, but a tracer can read /proc/<pid>/mem */
+      char path[MAX_PROC_PATH];
+      snprintf (path, MAX_PROC_PATH, "/proc/%d/mem", (int) mem->pid);
+      mem->fd = open (path, O_RDONLY | O_CLOEXEC);
+      if (mem->fd == -1)
+        return false;
+    }
+  return (pread (mem->fd, buf, len, addr) == (ssize_t) len);
+}
+
+/* Read the page of region holding addr in its snapshot, if not done yet */
+static bool
+mem_load (mem_t *mem, region_t *region, uintptr_t addr)
+{
+  size_t size = region->end - region->start;
+  size_t page = (addr - region->start) / mem->page_size;
+
+  if (!region->snapshot)
+    {
+      size_t nb_pages = (size + mem->page_size - 1) / mem->page_size;
+      region->snapshot = malloc (size);
+      region->loaded = calloc ((nb_pages + 7) / 8, sizeof (uint8_t));
+      if (!region->snapshot || !region->loaded)
+        {
+          free (region->snapshot);
+          free (region->loaded);
+          region->snapshot = region->loaded = NULL;
+          return false;
+        }
+    }
+
+  if (region->loaded[page / 8] & (1 << (page % 8)))
+    return true;
+
+  size_t offset = page * mem->page_size;
+  size_t len = (size - offset < mem->page_size) ? size - offset
+    : mem->page_size;
+  if (!mem_copy (mem, region->start + offset, region->snapshot + offset, len))
+    return false;
+  region->loaded[page / 8] |= (1 << (page % 8));
+  return true;
+}
+
+bool
+mem_read (mem_t *mem, uintptr_t addr, uint8_t *buf, size_t len)
+{
+  size_t done = 0;
+
+  while (done < len)
+    {
+      region_t *region = (region_t *) mem_find (mem, addr + done);
+      if (!region)
+        {
+          if (done == 0)
+            return false;
+
+          /* Past the end of the code, like the fetch window may be */
+          memset (buf + done, 0, len - done);
+          return true;
+        }
+
+      uintptr_t from = addr + done;
+      size_t chunk = (len - done < region->end - from) ? len - done
+        : region->end - from;
+
+      if (region->writable)
+        {
+          if (!mem_copy (mem, from, buf + done, chunk))
+            return false;
+        }
+      else
+        {
+          /* The chunk spans at most two pages */
+          if (!mem_load (mem, region, from)
+              || !mem_load (mem, region, from + chunk - 1))
+            return false;
+          memcpy (buf + done, region->snapshot + (from - region->start),
+                  chunk);
+        }
+      done += chunk;
+    }
+  return true;
+}
+
+const region_t *
+mem_find (const mem_t *mem, uintptr_t addr)
+{
+  if (!mem)
+    return NULL;
+
+  /* The kernel lists the mappings by address */
+  size_t low = 0, high = mem->nb_regions;
+  while (low < high)
+    {
+      size_t mid = low + (high - low) / 2;
+      if (addr < mem->regions[mid].start)
+        high = mid;
+      else if (addr >= mem->regions[mid].end)
+        low = mid + 1;
+      else
+        return &(mem->regions[mid]);
+    }
+  return NULL;
+}
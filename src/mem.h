@@ -0,0 +1,66 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#ifndef _MEM_H
+#define _MEM_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <sys/types.h>
+
+/* An executable mapping of the child */
+typedef struct
+{
+  uintptr_t start;          /* First address of the mapping */
+  uintptr_t end;            /* Address following the mapping */
+  bool writable;            /* Code may change without any system call */
+  char *path;               /* File mapped (NULL if anonymous) */
+  uint8_t *snapshot;        /* Copy of the mapping, read page by page */
+  uint8_t *loaded;          /* Bitmap of the pages read in snapshot */
+} region_t;
+
+/* Executable memory layout of a child, as read in /proc/<pid>/maps */
+typedef struct
+{
+  pid_t pid;                /* Process owning the mappings */
+  int fd;                   /* /proc/<pid>/mem, when process_vm_readv fails */
+  size_t page_size;         /* Size of a page of the snapshots */
+  region_t *regions;        /* Executable mappings, sorted by address */
+  size_t nb_regions;        /* Number of mappings */
+  size_t max_regions;       /* Allocated size of regions */
+} mem_t;
+
+/* Get the entry point of the executable of pid, from its auxiliary vector
+ * (of 64-bit entries if wide, 32-bit otherwise). Returns 0 otherwise */
+uintptr_t mem_get_entry (pid_t pid, bool wide);
+
+/* Read the executable mappings of pid, NULL otherwise (and set errno) */
+mem_t *mem_new (pid_t pid);
+
+/* Free the given mem */
+void mem_delete (mem_t *mem);
+
+/* Read again the mappings after the child changed them, all the snapshots
+ * are dropped */
+bool mem_update (mem_t *mem);
+
+/* Get the executable mapping holding addr, NULL if there is none */
+const region_t *mem_find (const mem_t *mem, uintptr_t addr);
+
+/* Copy len bytes of the child at addr in buf. Pages of read-only mappings
+ * are read once and served from their snapshot, writable ones are read at
+ * each call. Returns false if addr is not in an executable mapping */
+bool mem_read (mem_t *mem, uintptr_t addr, uint8_t *buf, size_t len);
+
+#endif /* _MEM_H */
@@ -0,0 +1,262 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "paths.h"
+
+#include <errno.h>
+#include <string.h>
+
+/* Hash of a command line, as a trace of its characters */
+static uint64_t
+command_hash (const char *command)
+{
+  uint64_t hash = 0;
+  for (; *command; command++)
+    hash = trace_hash (hash, (unsigned char) *command);
+  return hash;
+}
+
+/* Get the index of the command line in p, PATHS_ANY_COMMAND if there is
+ * none */
+static size_t
+command_find (const paths_t *p, const char *command)
+{
+  for (size_t i = 0; i < p->nb_commands; i++)
+    if (!strcmp (p->commands[i], command))
+      return i;
+  return PATHS_ANY_COMMAND;
+}
+
+/* Get the index of the entry of a prefix, or of the empty entry where it
+ * goes */
+static size_t
+prefix_find (const paths_t *p, uint64_t key, size_t size, size_t command)
+{
+  size_t mask = p->max_prefixes - 1;
+  size_t i = (key + size) & mask;
+  while (p->prefixes[i].size
+         && (p->prefixes[i].key != key || p->prefixes[i].size != size
+             || p->prefixes[i].command != command))
+    i = (i + 1) & mask;
+  return i;
+}
+
+/* Register a prefix, unless it is already there. p holds less than half
+ * its size of prefixes */
+static void
+prefix_store (paths_t *p, const prefix_t *prefix)
+{
+  size_t i = prefix_find (p, prefix->key, prefix->size, prefix->command);
+  if (p->prefixes[i].size)
+    return;
+  p->prefixes[i] = *prefix;
+  p->nb_prefixes++;
+}
+
+/* Make room for a new prefix in p, keeping it half empty at least */
+static bool
+prefix_reserve (paths_t *p)
+{
+  if (2 * (p->nb_prefixes + 1) <= p->max_prefixes)
+    return true;
+
+  size_t max = p->max_prefixes ? 2 * p->max_prefixes : 1024;
+  prefix_t *old = p->prefixes;
+  size_t old_max = p->max_prefixes;
+  p->prefixes = calloc (max, sizeof (prefix_t));
+  if (!p->prefixes)
+    {
+      p->prefixes = old;
+      return false;
+    }
+
+  p->max_prefixes = max;
+  p->nb_prefixes = 0;
+  for (size_t i = 0; i < old_max; i++)
+    if (old[i].size)
+      prefix_store (p, &(old[i]));
+  free (old);
+  return true;
+}
+
+paths_t *
+paths_new (void)
+{
+  paths_t *p = calloc (1, sizeof (paths_t));
+  if (!p)
+    return NULL;
+  if (!prefix_reserve (p))
+    {
+      free (p);
+      return NULL;
+    }
+  pthread_mutex_init (&(p->lock), NULL);
+  return p;
+}
+
+void
+paths_delete (paths_t *p)
+{
+  if (!p)
+    return;
+  for (size_t i = 0; i < p->nb_paths; i++)
+    trace_delete (p->paths[i].trace);
+  for (size_t i = 0; i < p->nb_commands; i++)
+    free (p->commands[i]);
+  free (p->paths);
+  free (p->commands);
+  free (p->prefixes);
+  pthread_mutex_destroy (&(p->lock));
+  free (p);
+}
+
+/* Get the path of p starting with t (of size ids), registered with key
+ * for command, or NULL if there is none. p is locked */
+static const path_t *
+paths_lookup (const paths_t *p, const trace_t *t, uint64_t key, size_t size,
+              size_t command)
+{
+  const prefix_t *prefix = &(p->prefixes[prefix_find (p, key, size,
+                                                      command)]);
+  if (!prefix->size)
+    return NULL;
+
+  /* Traces hashing alike may still differ */
+  const path_t *path = &(p->paths[prefix->path]);
+  if (trace_compare (t, path->trace) < size)
+    return NULL;
+  return path;
+}
+
+bool
+paths_find (paths_t *p, const trace_t *t, uint64_t hash,
+            const char *command, path_t *path)
+{
+  size_t size = trace_get_size (t);
+  bool found = false;
+
+  pthread_mutex_lock (&(p->lock));
+  size_t c = command_find (p, command);
+  if (c != PATHS_ANY_COMMAND)
+    {
+      const path_t *known = paths_lookup (p, t, hash ^ command_hash (command),
+                                          size, c);
+      found = (known && trace_get_size (known->trace) > size);
+      if (found)
+        *path = *known;
+    }
+  pthread_mutex_unlock (&(p->lock));
+  return found;
+}
+
+/* Add the trace t (of size ids) hashing to hash as a new path of p, and
+ * get its index in index. p is locked. Returns false if an error occured */
+static bool
+paths_append (paths_t *p, trace_t *t, uint64_t hash, size_t size,
+              size_t *index)
+{
+  if (p->nb_paths == p->max_paths)
+    {
+      size_t max = p->max_paths ? 2 * p->max_paths : 64;
+      path_t *paths = realloc (p->paths, max * sizeof (path_t));
+      if (!paths)
+        return false;
+      p->paths = paths;
+      p->max_paths = max;
+    }
+  if (!prefix_reserve (p))
+    return false;
+
+  *index = p->nb_paths++;
+  p->paths[*index] = (path_t) { t, hash };
+  prefix_store (p, &(prefix_t) { hash, size, *index, PATHS_ANY_COMMAND });
+  return true;
+}
+
+/* Get the index of command in p, added if it is not there yet. p is
+ * locked. Returns PATHS_ANY_COMMAND if an error occured */
+static size_t
+command_add (paths_t *p, const char *command)
+{
+  size_t c = command_find (p, command);
+  if (c != PATHS_ANY_COMMAND)
+    return c;
+
+  if (p->nb_commands == p->max_commands)
+    {
+      size_t max = p->max_commands ? 2 * p->max_commands : 64;
+      char **commands = realloc (p->commands, max * sizeof (char *));
+      if (!commands)
+        return PATHS_ANY_COMMAND;
+      p->commands = commands;
+      p->max_commands = max;
+    }
+  p->commands[p->nb_commands] = strdup (command);
+  if (!p->commands[p->nb_commands])
+    return PATHS_ANY_COMMAND;
+  return p->nb_commands++;
+}
+
+bool
+paths_add (paths_t *p, trace_t *t, uint64_t hash, const char *command,
+           bool *known)
+{
+  size_t size = trace_get_size (t);
+  *known = false;
+  if (size == 0)
+    {
+      trace_delete (t);
+      return true;
+    }
+
+  pthread_mutex_lock (&(p->lock));
+  const path_t *path = paths_lookup (p, t, hash, size, PATHS_ANY_COMMAND);
+  size_t index;
+  bool ok = true;
+  if (path)
+    {
+      /* Run by another command line, or by the same one again */
+      *known = true;
+      index = path - p->paths;
+      trace_delete (t);
+    }
+  else if (!paths_append (p, t, hash, size, &index))
+    {
+      trace_delete (t);
+      ok = false;
+    }
+
+  /* The prefixes looked for as the runs of command go */
+  size_t c = ok ? command_add (p, command) : PATHS_ANY_COMMAND;
+  if (c == PATHS_ANY_COMMAND)
+    ok = false;
+  if (ok)
+    {
+      const uint32_t *ids = trace_get_ids (p->paths[index].trace);
+      uint64_t mix = command_hash (command), prefix = 0;
+      for (size_t i = 0; i + 1 < size && ok; i++)
+        {
+          prefix = trace_hash (prefix, ids[i]);
+          if (!paths_checkpoint (i + 1))
+            continue;
+          ok = prefix_reserve (p);
+          if (ok)
+            prefix_store (p, &(prefix_t) { prefix ^ mix, i + 1, index, c });
+        }
+    }
+  pthread_mutex_unlock (&(p->lock));
+  if (!ok)
+    errno = ENOMEM;
+  return ok;
+}
@@ -0,0 +1,90 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#ifndef _PATHS_H
+#define _PATHS_H
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include <trace.h>
+
+/* Size of the shortest prefix of a path looked for (a power of 2) */
+#define PATHS_MIN_PREFIX 1024
+
+/* Command of the entries of whole paths */
+#define PATHS_ANY_COMMAND SIZE_MAX
+
+/* A path run by a traced program: the trace of the run and its hash */
+typedef struct
+{
+  trace_t *trace;           /* Ids of the nodes run through */
+  uint64_t hash;            /* trace_hash() of the whole trace */
+} path_t;
+
+/* A path, or a prefix of a path run by a command line, by its hash */
+typedef struct
+{
+  uint64_t key;             /* trace_hash() of the ids, mixed with the hash
+                             * of the command line */
+  size_t size;              /* Number of ids (0 if the entry is empty) */
+  size_t path;              /* Index of the path in paths */
+  size_t command;           /* Index of the command line in commands
+                             * (PATHS_ANY_COMMAND for a whole path) */
+} prefix_t;
+
+/* Paths of the runs traced so far, by their hash, and by the hashes of
+ * their prefixes of sizes PATHS_MIN_PREFIX, 2 * PATHS_MIN_PREFIX... for
+ * each command line they were run by. They may be used by several threads
+ * at once */
+typedef struct
+{
+  path_t *paths;            /* Paths, in the order they were added */
+  size_t nb_paths;          /* Number of paths */
+  size_t max_paths;         /* Allocated size of paths */
+  char **commands;          /* Command lines of the runs */
+  size_t nb_commands;       /* Number of command lines */
+  size_t max_commands;      /* Allocated size of commands */
+  prefix_t *prefixes;       /* Open addressing table of the prefixes */
+  size_t nb_prefixes;       /* Number of prefixes */
+  size_t max_prefixes;      /* Size of prefixes (a power of 2) */
+  pthread_mutex_t lock;     /* Lock of all the fields */
+} paths_t;
+
+/* Tell if the prefixes of size ids are looked for */
+static inline bool
+paths_checkpoint (size_t size)
+{
+  return size >= PATHS_MIN_PREFIX && !(size & (size - 1));
+}
+
+/* Create an empty set of paths, NULL otherwise */
+paths_t *paths_new (void);
+
+/* Free p and all its paths */
+void paths_delete (paths_t *p);
+
+/* Get in path a path of p run by command that goes on after t, whose
+ * prefix of the size of t hashes to hash and is t itself. Returns false if
+ * there is none. The trace of path stays in p, it is never changed */
+bool paths_find (paths_t *p, const trace_t *t, uint64_t hash,
+                 const char *command, path_t *path);
+
+/* Add the path of trace t, hashing to hash, run by command. known is set
+ * if p holds it already, whatever the command that ran it. p owns t
+ * afterwards. Returns false if an error occured */
+bool paths_add (paths_t *p, trace_t *t, uint64_t hash, const char *command,
+                bool *known);
+
+#endif /* _PATHS_H */
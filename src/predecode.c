@@ -0,0 +1,266 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "predecode.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <trace.h>
+
+/* Address instructions are decoded at, as the tracer does (relative
+ * operands are rendered from it) */
+#define DECODE_ADDR 0x1000
+
+/* A chunk of .text, decoded by a thread */
+typedef struct
+{
+  predecode_t *pre;         /* Table it is decoded in */
+  bool intel;               /* Intel syntax, or else AT&T */
+  bool listing;             /* Mnemonics and operands are kept */
+  size_t start;             /* Offset of the chunk in .text */
+  size_t end;               /* Offset following the chunk */
+  char *text;               /* Mnemonics and operands of the chunk */
+  size_t text_len;          /* Length of text */
+  size_t text_max;          /* Allocated size of text */
+  size_t nb_insns;          /* Number of instructions decoded */
+  bool ok;                  /* No error occured */
+} chunk_t;
+
+/* Tables kept by predecode_get(), shared by the threads */
+static predecode_t **tables = NULL;
+static size_t nb_tables = 0;
+static size_t max_tables = 0;
+static pthread_mutex_t tables_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Append the mnemonic and operands of cs to the text of c, at offset */
+static bool
+chunk_text (chunk_t *c, const cs_insn *cs, uint32_t *offset)
+{
+  size_t mnemonic = strlen (cs->mnemonic) + 1;
+  size_t op_str = strlen (cs->op_str) + 1;
+  if (c->text_len + mnemonic + op_str > c->text_max)
+    {
+      size_t max = c->text_max ? 2 * c->text_max : 65536;
+      while (c->text_len + mnemonic + op_str > max)
+        max *= 2;
+      char *text = realloc (c->text, max);
+      if (!text)
+        return false;
+      c->text = text;
+      c->text_max = max;
+    }
+
+  *offset = c->text_len;
+  memcpy (c->text + c->text_len, cs->mnemonic, mnemonic);
+  memcpy (c->text + c->text_len + mnemonic, cs->op_str, op_str);
+  c->text_len += mnemonic + op_str;
+  return true;
+}
+
+/* Decode the instructions starting in a chunk of .text (the last one may
+ * end in the next chunk) */
+static void *
+chunk_decode (void *arg)
+{
+  chunk_t *c = arg;
+  predecode_t *pre = c->pre;
+  csh handle;
+  c->ok = false;
+  if (cs_open (CS_ARCH_X86, pre->mode, &handle) != CS_ERR_OK)
+    return NULL;
+  cs_option (handle, CS_OPT_SYNTAX,
+             c->intel ? CS_OPT_SYNTAX_INTEL : CS_OPT_SYNTAX_ATT);
+  cs_insn *cs = cs_malloc (handle);
+  if (!cs)
+    {
+      cs_close (&handle);
+      return NULL;
+    }
+
+  c->ok = true;
+  for (size_t off = c->start; off < c->end && c->ok;)
+    {
+      const uint8_t *code = pre->code + off;
+      size_t size = pre->size - off;
+      uint64_t addr = DECODE_ADDR;
+      if (!cs_disasm_iter (handle, &code, &size, &addr, cs))
+        {
+          /* Not an instruction, the next byte may start one */
+          off++;
+          continue;
+        }
+
+      ahead_t *insn = &(pre->insns[off]);
+      insn->size = cs->size;
+      insn->type = instr_classify (cs->size, pre->code + off);
+      if (c->listing)
+        c->ok = chunk_text (c, cs, &(insn->text));
+      c->nb_insns++;
+      off += cs->size;
+    }
+
+  cs_free (cs, 1);
+  cs_close (&handle);
+  return NULL;
+}
+
+/* Free a table */
+static void
+predecode_delete (predecode_t *pre)
+{
+  if (!pre)
+    return;
+  if (pre->texts)
+    for (size_t i = 0; i < pre->nb_chunks; i++)
+      free (pre->texts[i]);
+  free (pre->texts);
+  free (pre->insns);
+  free (pre);
+}
+
+/* Decode .text of img in a new table, with a thread per chunk */
+static predecode_t *
+predecode_new (const image_t *img, cs_mode mode, bool intel, bool listing)
+{
+  predecode_t *pre = calloc (1, sizeof (predecode_t));
+  if (!pre)
+    return NULL;
+  pre->img = img;
+  pre->mode = mode;
+  pre->addr = img->text_addr;
+  pre->size = img->text_size;
+  pre->code = img->data + img->text_offset;
+
+  /* As many chunks as processors, unless they get too small */
+  long nb_cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  size_t nb_chunks = (nb_cpus > 1) ? nb_cpus : 1;
+  size_t max_chunks = (pre->size + PREDECODE_MIN_CHUNK - 1)
+    / PREDECODE_MIN_CHUNK;
+  if (nb_chunks > max_chunks)
+    nb_chunks = max_chunks ? max_chunks : 1;
+  pre->chunk_size = (pre->size + nb_chunks - 1) / nb_chunks;
+  if (!pre->chunk_size)
+    pre->chunk_size = 1;
+
+  pre->insns = calloc (pre->size ? pre->size : 1, sizeof (ahead_t));
+  chunk_t *chunks = calloc (nb_chunks, sizeof (chunk_t));
+  pthread_t *threads = calloc (nb_chunks, sizeof (pthread_t));
+  bool *started = calloc (nb_chunks, sizeof (bool));
+  pre->nb_chunks = nb_chunks;
+  if (listing)
+    pre->texts = calloc (nb_chunks, sizeof (char *));
+  if (!pre->insns || !chunks || !threads || !started
+      || (listing && !pre->texts))
+    {
+      free (chunks);
+      free (threads);
+      free (started);
+      predecode_delete (pre);
+      return NULL;
+    }
+
+  /* Chunks write the entries of their own offsets only */
+  for (size_t i = 0; i < nb_chunks; i++)
+    {
+      size_t start = i * pre->chunk_size;
+      size_t end = start + pre->chunk_size;
+      chunks[i] = (chunk_t) { pre, intel, listing, start,
+                              (end < pre->size) ? end : pre->size,
+                              NULL, 0, 0, 0, false };
+      started[i] = (i > 0 && !pthread_create (&(threads[i]), NULL,
+                                              chunk_decode, &(chunks[i])));
+    }
+
+  /* The first chunk, and those no thread was left for, are decoded here */
+  bool ok = true;
+  for (size_t i = 0; i < nb_chunks; i++)
+    {
+      if (started[i])
+        pthread_join (threads[i], NULL);
+      else
+        chunk_decode (&(chunks[i]));
+      ok = ok && chunks[i].ok;
+      pre->nb_insns += chunks[i].nb_insns;
+      if (listing)
+        pre->texts[i] = chunks[i].text;
+      else
+        free (chunks[i].text);
+    }
+  free (chunks);
+  free (threads);
+  free (started);
+
+  if (!ok)
+    {
+      predecode_delete (pre);
+      errno = ENOMEM;
+      return NULL;
+    }
+  return pre;
+}
+
+const predecode_t *
+predecode_get (const image_t *img, cs_mode mode, bool intel, bool listing)
+{
+  if (!img->has_text)
+    {
+      errno = ENOENT;
+      return NULL;
+    }
+
+  pthread_mutex_lock (&tables_lock);
+  for (size_t i = 0; i < nb_tables; i++)
+    if (tables[i]->img == img && tables[i]->mode == mode)
+      {
+        pthread_mutex_unlock (&tables_lock);
+        return tables[i];
+      }
+
+  /* The other threads wait for it instead of decoding it too */
+  predecode_t *pre = predecode_new (img, mode, intel, listing);
+  if (pre && nb_tables == max_tables)
+    {
+      size_t max = max_tables ? 2 * max_tables : 16;
+      predecode_t **array = realloc (tables, max * sizeof (predecode_t *));
+      if (!array)
+        {
+          predecode_delete (pre);
+          pre = NULL;
+          errno = ENOMEM;
+        }
+      else
+        {
+          tables = array;
+          max_tables = max;
+        }
+    }
+  if (pre)
+    tables[nb_tables++] = pre;
+  pthread_mutex_unlock (&tables_lock);
+  return pre;
+}
+
+void
+predecode_flush (void)
+{
+  pthread_mutex_lock (&tables_lock);
+  for (size_t i = 0; i < nb_tables; i++)
+    predecode_delete (tables[i]);
+  free (tables);
+  tables = NULL;
+  nb_tables = max_tables = 0;
+  pthread_mutex_unlock (&tables_lock);
+}
@@ -0,0 +1,99 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#ifndef _PREDECODE_H
+#define _PREDECODE_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <capstone/capstone.h>
+
+#include "image.h"
+
+/* Size of the smallest part of .text decoded by a thread */
+#define PREDECODE_MIN_CHUNK 65536 /* 2^16 */
+
+/* An instruction of .text as decoded from the file, before the child runs
+ * it: nothing tells it is an instruction until it does */
+typedef struct
+{
+  uint8_t size;             /* Size of the instruction (0 if none) */
+  uint8_t type;             /* Type of the instruction (instr_type_t) */
+  uint32_t text;            /* Offset of its mnemonic and operands (both
+                             * ending with '\0') in the text of its chunk,
+                             * without listing they are not kept */
+} ahead_t;
+
+/* The .text of an image decoded ahead, linearly and in chunks decoded by
+ * threads at once. A chunk starting in the middle of an instruction decodes
+ * a few wrong ones before it gets in step, they are never run. Tables are
+ * never changed once they are decoded */
+typedef struct
+{
+  const image_t *img;       /* Image decoded */
+  cs_mode mode;             /* Mode it was decoded in */
+  uintptr_t addr;           /* Address of .text (before any bias) */
+  size_t size;              /* Size of .text */
+  const uint8_t *code;      /* Content of .text in the image */
+  ahead_t *insns;           /* Instructions, by offset in .text */
+  size_t nb_insns;          /* Number of instructions decoded */
+  size_t chunk_size;        /* Size of the chunks */
+  size_t nb_chunks;         /* Number of chunks */
+  char **texts;             /* Mnemonics and operands, one text per chunk
+                             * (NULL without listing) */
+} predecode_t;
+
+/* Get .text of img decoded ahead in mode (with the syntax of intel, and the
+ * mnemonics and operands if listing), from the tables decoded before. They
+ * are shared by all threads, and stay until predecode_flush(). Returns NULL
+ * if img has no .text (errno set to ENOENT) or if an error occured */
+const predecode_t *predecode_get (const image_t *img, cs_mode mode,
+                                  bool intel, bool listing);
+
+/* Free every table kept by predecode_get() */
+void predecode_flush (void);
+
+/* Get the instruction decoded ahead at addr (before any bias), NULL if
+ * there is none (or pre is NULL) */
+static inline const ahead_t *
+predecode_find (const predecode_t *pre, uintptr_t addr)
+{
+  if (!pre || addr - pre->addr >= pre->size)
+    return NULL;
+  const ahead_t *insn = &(pre->insns[addr - pre->addr]);
+  return insn->size ? insn : NULL;
+}
+
+/* Tell if the code at addr (before any bias) is still opcodes, as insn was
+ * decoded from */
+static inline bool
+predecode_match (const predecode_t *pre, uintptr_t addr, const ahead_t *insn,
+                 const uint8_t *opcodes)
+{
+  return !memcmp (pre->code + (addr - pre->addr), opcodes, insn->size);
+}
+
+/* Get the mnemonic of insn, decoded ahead at addr (before any bias). Its
+ * operands follow its '\0'. NULL without listing */
+static inline const char *
+predecode_mnemonic (const predecode_t *pre, uintptr_t addr,
+                    const ahead_t *insn)
+{
+  if (!pre->texts)
+    return NULL;
+  return pre->texts[(addr - pre->addr) / pre->chunk_size] + insn->text;
+}
+
+#endif /* _PREDECODE_H */
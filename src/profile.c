@@ -0,0 +1,206 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#include "profile.h"
+
+#include <errno.h>
+#include <inttypes.h>
+
+/* A block or a function, with the number of times it was run */
+typedef struct
+{
+  uint64_t hits;            /* Runs (blocks), instructions run (functions) */
+  uint64_t count;           /* Instructions (blocks), calls (functions) */
+  cfg_t *node;              /* First node */
+} hot_t;
+
+/* An edge out of a node with several successors */
+typedef struct
+{
+  cfg_t *from;              /* Source of the edge */
+  cfg_t *to;                /* Destination of the edge */
+  uint32_t hits;            /* Number of times it was taken */
+  uint64_t total;           /* Number of times an edge of from was taken */
+} rare_t;
+
+/* Edges collected out of the nodes of a cfg */
+typedef struct
+{
+  rare_t *edges;            /* Edges */
+  size_t nb_edges;          /* Number of edges */
+  size_t max_edges;         /* Allocated size of edges */
+  bool ok;                  /* Cleared if an error occured */
+} edges_t;
+
+/* Sort hot_t by decreasing hits */
+static int
+hot_cmp (const void *a, const void *b)
+{
+  uint64_t x = ((const hot_t *) a)->hits, y = ((const hot_t *) b)->hits;
+  return (x < y) - (x > y);
+}
+
+/* Sort rare_t by increasing share of the runs of their source */
+static int
+rare_cmp (const void *a, const void *b)
+{
+  const rare_t *x = a, *y = b;
+  double rx = (double) x->hits / x->total, ry = (double) y->hits / y->total;
+  return (rx > ry) - (rx < ry);
+}
+
+/* Collect the edges taken out of CFG, if it has several successors */
+static void
+collect_edges (cfg_t *CFG, void *data)
+{
+  edges_t *e = data;
+  uint16_t nb_out = cfg_get_nb_out (CFG);
+  if (!e->ok || nb_out < 2)
+    return;
+
+  uint64_t total = 0;
+  for (uint16_t i = 0; i < nb_out; i++)
+    total += cfg_get_hits_i (CFG, i);
+  if (total == 0)
+    return;
+
+  for (uint16_t i = 0; i < nb_out; i++)
+    {
+      if (e->nb_edges == e->max_edges)
+        {
+          size_t max = e->max_edges ? 2 * e->max_edges : 1024;
+          rare_t *edges = realloc (e->edges, max * sizeof (rare_t));
+          if (!edges)
+            {
+              e->ok = false;
+              return;
+            }
+          e->edges = edges;
+          e->max_edges = max;
+        }
+      e->edges[e->nb_edges++] = (rare_t) { CFG, cfg_get_successor_i (CFG, i),
+                                           cfg_get_hits_i (CFG, i), total };
+    }
+}
+
+/* Address of the instruction of a node */
+static uintptr_t
+node_addr (cfg_t *node)
+{
+  return instr_get_addr (cfg_get_instr (node));
+}
+
+/* Write the n hottest blocks of b */
+static bool
+report_blocks (FILE *out, blocks_t *b, size_t n)
+{
+  hot_t *hot = malloc ((b->nb_blocks ? b->nb_blocks : 1) * sizeof (hot_t));
+  if (!hot)
+    return false;
+  for (size_t i = 0; i < b->nb_blocks; i++)
+    {
+      cfg_t *first = b->nodes[b->blocks[i].first];
+      hot[i] = (hot_t) { cfg_get_hits (first), b->blocks[i].nb_nodes, first };
+    }
+  qsort (hot, b->nb_blocks, sizeof (hot_t), hot_cmp);
+
+  fprintf (out, "* Hottest blocks:\n"
+           "  %12s  %8s  %s\n", "runs", "instrs", "address");
+  for (size_t i = 0; i < n && i < b->nb_blocks && hot[i].hits; i++)
+    fprintf (out, "  %12" PRIu64 "  %8" PRIu64 "  0x%" PRIxPTR "\n",
+             hot[i].hits, hot[i].count, node_addr (hot[i].node));
+  free (hot);
+  return true;
+}
+
+/* Write the n functions of ht executing the most instructions, the ones of
+ * the blocks reached from their entries */
+static bool
+report_functions (FILE *out, hashtable_t *ht, blocks_t *b, size_t n)
+{
+  list_t *entries = hashtable_get_entries (ht);
+  size_t nb_functions = list_get_size (entries);
+  hot_t *hot = malloc ((nb_functions ? nb_functions : 1) * sizeof (hot_t));
+  uint32_t *order = malloc ((b->nb_blocks ? b->nb_blocks : 1)
+                            * sizeof (uint32_t));
+  if (!hot || !order)
+    {
+      free (hot);
+      free (order);
+      return false;
+    }
+
+  size_t nb = 0;
+  for (list_t *l = entries; l && nb < nb_functions; l = list_get_next (l))
+    {
+      cfg_t *entry = list_get_data (l);
+      hot_t *fn = &(hot[nb++]);
+      *fn = (hot_t) { 0, cfg_get_hits (entry), entry };
+
+      size_t nb_reached = blocks_reach (b, entry, order);
+      for (size_t i = 0; i < nb_reached; i++)
+        {
+          const block_t *block = &(b->blocks[order[i]]);
+          for (uint32_t k = 0; k < block->nb_nodes; k++)
+            fn->hits += cfg_get_hits (b->nodes[block->first + k]);
+        }
+    }
+  qsort (hot, nb, sizeof (hot_t), hot_cmp);
+
+  fprintf (out, "* Hottest functions:\n"
+           "  %12s  %8s  %s\n", "instrs", "calls", "entry");
+  for (size_t i = 0; i < n && i < nb && hot[i].hits; i++)
+    fprintf (out, "  %12" PRIu64 "  %8" PRIu64 "  0x%" PRIxPTR "\n",
+             hot[i].hits, hot[i].count, node_addr (hot[i].node));
+  free (hot);
+  free (order);
+  return true;
+}
+
+/* Write the n edges of ht taken the least often out of their source */
+static bool
+report_edges (FILE *out, hashtable_t *ht, size_t n)
+{
+  edges_t e = { NULL, 0, 0, true };
+  hashtable_foreach (ht, collect_edges, &e);
+  if (!e.ok)
+    {
+      free (e.edges);
+      return false;
+    }
+  qsort (e.edges, e.nb_edges, sizeof (rare_t), rare_cmp);
+
+  fprintf (out, "* Rarest edges:\n"
+           "  %12s  %8s  %s\n", "taken", "out of", "edge");
+  for (size_t i = 0; i < n && i < e.nb_edges; i++)
+    fprintf (out, "  %12" PRIu32 "  %8" PRIu64 "  0x%" PRIxPTR
+             " -> 0x%" PRIxPTR "\n", e.edges[i].hits, e.edges[i].total,
+             node_addr (e.edges[i].from), node_addr (e.edges[i].to));
+  free (e.edges);
+  return true;
+}
+
+bool
+profile_report (FILE *out, hashtable_t *ht, blocks_t *b, size_t n)
+{
+  fprintf (out,
+           "\tProfile of the runs\n"
+           "\t===================\n");
+  if (!report_blocks (out, b, n) || !report_functions (out, ht, b, n)
+      || !report_edges (out, ht, n))
+    {
+      errno = ENOMEM;
+      return false;
+    }
+  fputs ("\n\n", out);
+  return true;
+}
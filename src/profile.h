@@ -0,0 +1,29 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#ifndef _PROFILE_H
+#define _PROFILE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include <trace.h>
+
+#include "block.h"
+
+/* Write to out the profile of all the runs of the cfg of ht, split in the
+ * blocks b: the n blocks and functions executing the most, and the n edges
+ * taken the least often out of a node with several successors. Returns false
+ * otherwise (and set errno) */
+bool profile_report (FILE *out, hashtable_t *ht, blocks_t *b, size_t n);
+
+#endif /* _PROFILE_H */
@@ -0,0 +1,133 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "ring.h"
+
+#include <sched.h>
+#include <string.h>
+
+/* Let the other thread of the ring go on, while polling it */
+static inline void
+ring_relax (void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause ();
+#endif
+}
+
+ring_t *
+ring_new (size_t nb_slots, size_t slot_size)
+{
+  if (nb_slots == 0 || (nb_slots & (nb_slots - 1)))
+    return NULL;
+
+  ring_t *r = aligned_alloc (RING_LINE, sizeof (ring_t));
+  if (!r)
+    return NULL;
+  memset (r, 0, sizeof (ring_t));
+  r->slots = malloc (nb_slots * slot_size);
+  if (!r->slots)
+    {
+      free (r);
+      return NULL;
+    }
+  r->slot_size = slot_size;
+  r->mask = nb_slots - 1;
+  pthread_mutex_init (&(r->lock), NULL);
+  pthread_cond_init (&(r->cond), NULL);
+  return r;
+}
+
+void
+ring_delete (ring_t *r)
+{
+  if (!r)
+    return;
+  pthread_mutex_destroy (&(r->lock));
+  pthread_cond_destroy (&(r->cond));
+  free (r->slots);
+  free (r);
+}
+
+void *
+ring_reserve (ring_t *r)
+{
+  /* Only the producer changes head */
+  size_t head = r->head;
+  while (head - __atomic_load_n (&(r->tail), __ATOMIC_ACQUIRE) > r->mask)
+    sched_yield ();
+  return r->slots + (head & r->mask) * r->slot_size;
+}
+
+void
+ring_commit (ring_t *r)
+{
+  /* Both are sequentially consistent, against the consumer setting waiting
+   * before it looks at head one more time */
+  __atomic_store_n (&(r->head), r->head + 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n (&(r->waiting), __ATOMIC_SEQ_CST))
+    {
+      pthread_mutex_lock (&(r->lock));
+      pthread_cond_signal (&(r->cond));
+      pthread_mutex_unlock (&(r->lock));
+    }
+}
+
+const void *
+ring_peek (ring_t *r)
+{
+  /* Only the consumer changes tail */
+  size_t tail = r->tail;
+  for (int i = 0; i < RING_SPINS; i++)
+    {
+      if (__atomic_load_n (&(r->head), __ATOMIC_ACQUIRE) != tail)
+        return r->slots + (tail & r->mask) * r->slot_size;
+      ring_relax ();
+    }
+
+  pthread_mutex_lock (&(r->lock));
+  __atomic_store_n (&(r->waiting), true, __ATOMIC_SEQ_CST);
+  while (__atomic_load_n (&(r->head), __ATOMIC_SEQ_CST) == tail && !r->closed)
+    pthread_cond_wait (&(r->cond), &(r->lock));
+  __atomic_store_n (&(r->waiting), false, __ATOMIC_RELAXED);
+  bool empty = (__atomic_load_n (&(r->head), __ATOMIC_ACQUIRE) == tail);
+  pthread_mutex_unlock (&(r->lock));
+  return empty ? NULL : r->slots + (tail & r->mask) * r->slot_size;
+}
+
+void
+ring_release (ring_t *r)
+{
+  __atomic_store_n (&(r->tail), r->tail + 1, __ATOMIC_RELEASE);
+}
+
+void
+ring_drain (ring_t *r)
+{
+  for (int i = 0; __atomic_load_n (&(r->tail), __ATOMIC_ACQUIRE) != r->head;
+       i++)
+    if (i < RING_SPINS)
+      ring_relax ();
+    else
+      sched_yield ();
+}
+
+void
+ring_close (ring_t *r)
+{
+  pthread_mutex_lock (&(r->lock));
+  r->closed = true;
+  pthread_cond_signal (&(r->cond));
+  pthread_mutex_unlock (&(r->lock));
+}
@@ -0,0 +1,70 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#ifndef _RING_H
+#define _RING_H
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+/* Size of a cache line, the two ends of a ring never share one */
+#define RING_LINE 64
+
+/* Times the consumer polls an empty ring before sleeping on it */
+#define RING_SPINS 4096
+
+/* A ring buffer of fixed-size slots, between one producer thread and one
+ * consumer thread. Slots are written and read in place, without any lock
+ * unless the consumer sleeps on an empty ring */
+typedef struct
+{
+  uint8_t *slots;           /* Slots, one after the other */
+  size_t slot_size;         /* Size of a slot */
+  size_t mask;              /* Number of slots (a power of 2) minus 1 */
+  _Alignas (RING_LINE) size_t head; /* Slots written so far (producer) */
+  _Alignas (RING_LINE) size_t tail; /* Slots read so far (consumer) */
+  _Alignas (RING_LINE) bool waiting; /* The consumer sleeps on cond */
+  bool closed;              /* No slot is written anymore */
+  pthread_mutex_t lock;     /* Lock of waiting and closed, for cond */
+  pthread_cond_t cond;      /* Signaled when the consumer has to wake up */
+} ring_t;
+
+/* Create a ring of nb_slots (a power of 2) slots of slot_size bytes. Returns
+ * NULL otherwise */
+ring_t *ring_new (size_t nb_slots, size_t slot_size);
+
+/* Free r */
+void ring_delete (ring_t *r);
+
+/* Get the next slot to write (producer), waiting for the consumer to free
+ * one if r is full. It is not read before ring_commit() */
+void *ring_reserve (ring_t *r);
+
+/* Hand the slot of the last ring_reserve() to the consumer */
+void ring_commit (ring_t *r);
+
+/* Get the next slot to read (consumer), waiting for the producer to write
+ * one if r is empty. Returns NULL once r is empty and closed */
+const void *ring_peek (ring_t *r);
+
+/* Give the slot of the last ring_peek() back to the producer */
+void ring_release (ring_t *r);
+
+/* Wait for the consumer to release every slot written (producer) */
+void ring_drain (ring_t *r);
+
+/* Tell the consumer no slot is written anymore (producer) */
+void ring_close (ring_t *r);
+
+#endif /* _RING_H */
@@ -0,0 +1,154 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "stats.h"
+#include "json.h"
+
+#include <time.h>
+
+#include <sys/resource.h>
+
+/* Names of the phases, in the listing and in JSON */
+static const char *phase_names[NB_PHASES] = {
+  "wait", "getregs", "peek", "decode", "listing", "cfg", "export"
+};
+
+/* Get the wall clock time, in nanoseconds */
+static uint64_t
+now_ns (void)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* Get the peak resident set size of the tracker, in KiB */
+static long
+peak_rss (void)
+{
+  struct rusage usage;
+  return getrusage (RUSAGE_SELF, &usage) ? 0 : usage.ru_maxrss;
+}
+
+/* Get the share of hits among hits + misses, in percents */
+static double
+hit_rate (uint64_t hits, uint64_t misses)
+{
+  return (hits + misses) ? 100.0 * hits / (hits + misses) : 0.0;
+}
+
+void
+stats_start (stats_t *s)
+{
+  *s = (stats_t) { 0 };
+  s->start_ns = now_ns ();
+  s->start_ticks = stats_ticks ();
+}
+
+void
+stats_stop (stats_t *s)
+{
+  s->elapsed_ticks = stats_ticks () - s->start_ticks;
+  s->elapsed_ns = now_ns () - s->start_ns;
+}
+
+void
+stats_merge (stats_t *to, const stats_t *from)
+{
+  for (int p = 0; p < NB_PHASES; p++)
+    {
+      to->ticks[p] += from->ticks[p];
+      to->calls[p] += from->calls[p];
+    }
+  to->decode_hits += from->decode_hits;
+  to->decode_misses += from->decode_misses;
+  to->decode_ahead += from->decode_ahead;
+  to->node_hits += from->node_hits;
+  to->node_lookups += from->node_lookups;
+  to->forwarded += from->forwarded;
+  to->known_paths += from->known_paths;
+  to->threads += from->threads;
+}
+
+double
+stats_seconds (const stats_t *s, phase_t phase)
+{
+  if (!s->elapsed_ticks)
+    return 0.0;
+  return (double) s->ticks[phase] / s->elapsed_ticks * s->elapsed_ns / 1e9;
+}
+
+void
+stats_print (FILE *out, const stats_t *s, size_t instr_count)
+{
+  double seconds = s->elapsed_ns / 1e9;
+  size_t traced = instr_count - s->forwarded;
+  if (s->path)
+    fprintf (out, "* #path hash:             0x%016" PRIx64 "%s\n", s->path,
+             s->known_paths ? " (known)" : "");
+  if (s->forwarded)
+    fprintf (out, "* #steps fast-forwarded:  %" PRIu64 "\n", s->forwarded);
+  if (s->threads > 1)
+    fprintf (out, "* #threads followed:      %" PRIu64 "\n", s->threads);
+  if (s->decode_ahead)
+    fprintf (out, "* #misses decoded ahead:  %" PRIu64 "\n", s->decode_ahead);
+  fprintf (out,
+           "* #steps per second:      %.0f\n"
+           "* #decode cache hits:     %.2f%% (misses: %" PRIu64 ")\n"
+           "* #node cache hits:       %.2f%% (lookups: %" PRIu64 ")\n"
+           "* #peak RSS:              %ld KiB\n"
+           "* #time spent:            %.3f s\n",
+           seconds > 0 ? traced / seconds : 0.0,
+           hit_rate (s->decode_hits, s->decode_misses), s->decode_misses,
+           hit_rate (s->node_hits, s->node_lookups), s->node_lookups,
+           peak_rss (), seconds);
+
+  for (int p = 0; p < NB_PHASES; p++)
+    if (s->calls[p])
+      fprintf (out, "  - %-8s %10.3f s  (%" PRIu64 " calls)\n",
+               phase_names[p], stats_seconds (s, p), s->calls[p]);
+}
+
+void
+stats_json (FILE *out, const stats_t *s, const char *command,
+            size_t instr_count)
+{
+  double seconds = s->elapsed_ns / 1e9;
+  size_t traced = instr_count - s->forwarded;
+  if (command)
+    {
+      fputs ("{\"run\": \"", out);
+      json_puts (out, command);
+      fprintf (out, "\", \"path\": \"0x%016" PRIx64 "\"", s->path);
+    }
+  else
+    fputs ("{\"session\": true", out);
+
+  fprintf (out, ", \"instructions\": %zu, \"seconds\": %.6f, "
+           "\"steps_per_second\": %.0f, \"forwarded\": %" PRIu64 ", "
+           "\"known_paths\": %" PRIu64 ", \"threads\": %" PRIu64 ", "
+           "\"decode_cache\": {\"hits\": %" PRIu64 ", \"misses\": %" PRIu64 ", "
+           "\"ahead\": %" PRIu64 "}, "
+           "\"node_cache\": {\"hits\": %" PRIu64 ", \"lookups\": %" PRIu64 "}, "
+           "\"peak_rss_kib\": %ld, \"phases\": {",
+           instr_count, seconds, seconds > 0 ? traced / seconds : 0.0,
+           s->forwarded, s->known_paths, s->threads, s->decode_hits,
+           s->decode_misses, s->decode_ahead, s->node_hits, s->node_lookups,
+           peak_rss ());
+  for (int p = 0; p < NB_PHASES; p++)
+    fprintf (out, "%s\"%s\": {\"calls\": %" PRIu64 ", \"seconds\": %.6f}",
+             p ? ", " : "", phase_names[p], s->calls[p],
+             stats_seconds (s, p));
+  fputs ("}}\n", out);
+}
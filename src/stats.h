@@ -0,0 +1,102 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+/* Phases of the tracing loop timed */
+typedef enum
+{
+  PHASE_WAIT,               /* Child running, up to waitpid() */
+  PHASE_GETREGS,            /* PTRACE_GETREGS */
+  PHASE_PEEK,               /* PTRACE_PEEKDATA (opcodes not in mem_t) */
+  PHASE_DECODE,             /* cs_disasm() and the listing line */
+  PHASE_LISTING,            /* Writing the listing */
+  PHASE_CFG,                /* Inserting in the cfg */
+  PHASE_EXPORT,             /* Exporting the cfg (-g) */
+  NB_PHASES
+} phase_t;
+
+/* Counters of a tracer, over a run or a session. Phases are timed in ticks
+ * of the TSC, converted to seconds against the wall clock time of the run */
+typedef struct
+{
+  uint64_t ticks[NB_PHASES];        /* Ticks spent in each phase */
+  uint64_t calls[NB_PHASES];        /* Number of times in each phase */
+  uint64_t decode_hits;             /* Steps found in the decode cache */
+  uint64_t decode_misses;           /* Steps decoded again */
+  uint64_t decode_ahead;            /* Misses decoded ahead (-a) */
+  uint64_t node_hits;               /* Steps whose node was cached */
+  uint64_t node_lookups;            /* Steps looking for their node in ht */
+  uint64_t path;                    /* trace_hash() of the run (or 0) */
+  uint64_t forwarded;               /* Steps of a known path not traced */
+  uint64_t known_paths;             /* Runs along a path known before */
+  uint64_t threads;                 /* Threads followed (processes forked
+                                     * included) */
+  uint64_t start_ticks;             /* Ticks when it started */
+  uint64_t start_ns;                /* Wall clock time when it started */
+  uint64_t elapsed_ticks;           /* Ticks from start to stop */
+  uint64_t elapsed_ns;              /* Wall clock time from start to stop */
+} stats_t;
+
+/* Get the current number of ticks: the TSC, or nanoseconds without one */
+static inline uint64_t
+stats_ticks (void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc ();
+#else
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/* Count one more time in phase, which started at ticks since */
+static inline void
+stats_add (stats_t *s, phase_t phase, uint64_t since)
+{
+  s->ticks[phase] += stats_ticks () - since;
+  s->calls[phase]++;
+}
+
+/* Reset s and start the clock */
+void stats_start (stats_t *s);
+
+/* Stop the clock of s */
+void stats_stop (stats_t *s);
+
+/* Add the counters of from to the ones of to, not its clock */
+void stats_merge (stats_t *to, const stats_t *from);
+
+/* Get the number of seconds spent in phase */
+double stats_seconds (const stats_t *s, phase_t phase);
+
+/* Write the counters of s for instr_count instructions, as lines of the
+ * statistics of a run */
+void stats_print (FILE *out, const stats_t *s, size_t instr_count);
+
+/* Write the counters of s for instr_count instructions as a JSON object on
+ * a line: the ones of a run of command, or of the session if it is NULL */
+void stats_json (FILE *out, const stats_t *s, const char *command,
+                 size_t instr_count);
+
+#endif /* _STATS_H */
@@ -0,0 +1,384 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "tlog.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <err.h>
+
+/* Maximum length of a varint */
+#define MAX_VARINT 10
+
+/* ***** Writer ***** */
+
+/* Write the content of the buffer to the file */
+static void
+tlog_flush (tlog_t *log)
+{
+  size_t done = 0;
+  while (done < log->len)
+    {
+      ssize_t n = write (log->fd, log->buf + done, log->len - done);
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n == -1)
+        err (EXIT_FAILURE, "error: cannot write the trace log");
+      done += n;
+    }
+  log->len = 0;
+}
+
+/* Append a varint to the buffer (there must be room for it) */
+static inline void
+tlog_put_varint (tlog_t *log, uint64_t v)
+{
+  while (v >= 0x80)
+    {
+      log->buf[log->len++] = (v & 0x7F) | 0x80;
+      v >>= 7;
+    }
+  log->buf[log->len++] = v;
+}
+
+/* Make room for len bytes in the buffer */
+static inline void
+tlog_reserve (tlog_t *log, size_t len)
+{
+  if (log->len + len > TLOG_BUFFER_SIZE)
+    tlog_flush (log);
+}
+
+/* Append len bytes to the buffer, whatever their size */
+static void
+tlog_put_bytes (tlog_t *log, const uint8_t *bytes, size_t len)
+{
+  while (len > 0)
+    {
+      tlog_reserve (log, 1);
+      size_t chunk = TLOG_BUFFER_SIZE - log->len;
+      if (chunk > len)
+        chunk = len;
+      memcpy (log->buf + log->len, bytes, chunk);
+      log->len += chunk;
+      bytes += chunk;
+      len -= chunk;
+    }
+}
+
+tlog_t *
+tlog_new (const char *path)
+{
+  int fd = open (path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd == -1)
+    return NULL;
+
+  tlog_t *log = tlog_open (fd);
+  if (!log)
+    {
+      int saved = errno;
+      close (fd);
+      errno = saved;
+    }
+  return log;
+}
+
+tlog_t *
+tlog_open (int fd)
+{
+  tlog_t *log = calloc (1, sizeof (tlog_t));
+  if (!log)
+    return NULL;
+
+  log->buf = malloc (TLOG_BUFFER_SIZE);
+  if (!log->buf)
+    {
+      free (log);
+      errno = ENOMEM;
+      return NULL;
+    }
+
+  log->fd = fd;
+  log->nb_defs = 0;
+  log->next = 1;
+  tlog_put_bytes (log, (const uint8_t *) TLOG_MAGIC, TLOG_MAGIC_LEN);
+  return log;
+}
+
+void
+tlog_delete (tlog_t *log)
+{
+  if (!log)
+    return;
+  tlog_flush (log);
+  close (log->fd);
+  free (log->buf);
+  free (log);
+}
+
+void
+tlog_begin (tlog_t *log, unsigned mode, uint64_t flags, const char *command)
+{
+  size_t len = strlen (command);
+
+  tlog_reserve (log, 3 * MAX_VARINT);
+  tlog_put_varint (log, ((uint64_t) mode << 2) | TLOG_BEGIN);
+  tlog_put_varint (log, flags);
+  tlog_put_varint (log, len);
+  tlog_put_bytes (log, (const uint8_t *) command, len);
+  log->next = 1;
+}
+
+uint32_t
+tlog_define (tlog_t *log, uintptr_t ip, uint8_t size, const uint8_t *opcodes)
+{
+  tlog_reserve (log, 2 * MAX_VARINT + size);
+  tlog_put_varint (log, ((uint64_t) size << 2) | TLOG_DEFINE);
+  tlog_put_varint (log, ip);
+  memcpy (log->buf + log->len, opcodes, size);
+  log->len += size;
+  return ++log->nb_defs;
+}
+
+void
+tlog_step (tlog_t *log, uint32_t id)
+{
+  /* Straight-line code defined in order costs one byte per step */
+  int64_t delta = (int64_t) id - (int64_t) log->next;
+  uint64_t zigzag = ((uint64_t) delta << 1) ^ (uint64_t) (delta >> 63);
+
+  tlog_reserve (log, MAX_VARINT);
+  tlog_put_varint (log, (zigzag << 2) | TLOG_STEP);
+  log->next = id + 1;
+}
+
+void
+tlog_end (tlog_t *log, uint64_t count)
+{
+  /* Keep the count on 62 bits, the kind takes the others */
+  tlog_reserve (log, MAX_VARINT);
+  tlog_put_varint (log, (count << 2) | TLOG_END);
+}
+
+/* ***** Reader ***** */
+
+tlog_reader_t *
+tlog_reader_new (const char *path)
+{
+  FILE *file = fopen (path, "re");
+  if (!file)
+    return NULL;
+
+  tlog_reader_t *reader = tlog_reader_open (file);
+  if (!reader)
+    {
+      int saved = errno;
+      fclose (file);
+      errno = saved;
+    }
+  return reader;
+}
+
+tlog_reader_t *
+tlog_reader_open (FILE *file)
+{
+  char magic[TLOG_MAGIC_LEN];
+  if (fread (magic, 1, TLOG_MAGIC_LEN, file) != TLOG_MAGIC_LEN
+      || memcmp (magic, TLOG_MAGIC, TLOG_MAGIC_LEN))
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+
+  tlog_reader_t *reader = calloc (1, sizeof (tlog_reader_t));
+  if (!reader)
+    return NULL;
+  reader->file = file;
+  reader->next = 1;
+  return reader;
+}
+
+void
+tlog_reader_delete (tlog_reader_t *reader)
+{
+  if (!reader)
+    return;
+  fclose (reader->file);
+  free (reader->data);
+  free (reader);
+}
+
+/* Read a varint, returns false at the end of the file */
+static bool
+tlog_get_varint (tlog_reader_t *reader, uint64_t *v)
+{
+  int c;
+  *v = 0;
+  for (int shift = 0; shift < 7 * MAX_VARINT; shift += 7)
+    {
+      if ((c = getc_unlocked (reader->file)) == EOF)
+        return false;
+      *v |= (uint64_t) (c & 0x7F) << shift;
+      if (!(c & 0x80))
+        return true;
+    }
+  return false;
+}
+
+/* Read len bytes of data in the reader, NUL terminated */
+static bool
+tlog_get_data (tlog_reader_t *reader, size_t len)
+{
+  if (len + 1 > reader->max_data)
+    {
+      uint8_t *data = realloc (reader->data, len + 1);
+      if (!data)
+        return false;
+      reader->data = data;
+      reader->max_data = len + 1;
+    }
+  if (fread (reader->data, 1, len, reader->file) != len)
+    return false;
+  reader->data[len] = '\0';
+  return true;
+}
+
+bool
+tlog_read (tlog_reader_t *reader, tlog_record_t *rec)
+{
+  uint64_t head, v;
+
+  /* The log may only end between two records */
+  errno = 0;
+  int c = getc_unlocked (reader->file);
+  if (c == EOF)
+    {
+      if (ferror (reader->file))
+        errno = EIO;
+      return false;
+    }
+  ungetc (c, reader->file);
+  if (!tlog_get_varint (reader, &head))
+    goto corrupted;
+
+  *rec = (tlog_record_t) { 0 };
+  rec->kind = head & 3;
+  rec->arg = head >> 2;
+  switch (rec->kind)
+    {
+    case TLOG_STEP:
+      {
+        int64_t delta = (int64_t) (rec->arg >> 1) ^ -(int64_t) (rec->arg & 1);
+        rec->id = reader->next + delta;
+        if (rec->id == 0 || rec->id > reader->nb_defs)
+          goto corrupted;
+        reader->next = rec->id + 1;
+      }
+      break;
+
+    case TLOG_DEFINE:
+      if (!tlog_get_varint (reader, &v) || !tlog_get_data (reader, rec->arg))
+        goto corrupted;
+      rec->ip = v;
+      rec->id = ++reader->nb_defs;
+      rec->data = reader->data;
+      break;
+
+    case TLOG_BEGIN:
+      if (!tlog_get_varint (reader, &(rec->flags))
+          || !tlog_get_varint (reader, &v) || !tlog_get_data (reader, v))
+        goto corrupted;
+      rec->data = reader->data;
+      reader->next = 1;
+      break;
+
+    case TLOG_END:
+      break;
+    }
+  return true;
+
+ corrupted:
+  errno = EINVAL;
+  return false;
+}
+
+/* ***** Copy ***** */
+
+bool
+tlog_copy (tlog_t *log, tlog_reader_t *reader)
+{
+  /* Ids of log for the instructions defined in reader, indexed by id */
+  uint32_t *ids = NULL;
+  size_t max_ids = 0;
+  tlog_record_t rec;
+
+  while (tlog_read (reader, &rec))
+    switch (rec.kind)
+      {
+      case TLOG_STEP:
+        tlog_step (log, ids[rec.id]);
+        break;
+
+      case TLOG_DEFINE:
+        if (rec.id >= max_ids)
+          {
+            size_t max = max_ids ? 2 * max_ids : 4096;
+            uint32_t *tmp = realloc (ids, max * sizeof (uint32_t));
+            if (!tmp)
+              {
+                free (ids);
+                return false;
+              }
+            ids = tmp;
+            max_ids = max;
+          }
+        ids[rec.id] = tlog_define (log, rec.ip, rec.arg, rec.data);
+        break;
+
+      case TLOG_BEGIN:
+        tlog_begin (log, rec.arg, rec.flags, (const char *) rec.data);
+        break;
+
+      case TLOG_END:
+        tlog_end (log, rec.arg);
+        break;
+      }
+  free (ids);
+  return (errno == 0);
+}
+
+/* ***** Listing ***** */
+
+int
+tlog_format (char *line, size_t max, uintptr_t ip, const uint8_t *opcodes,
+             uint8_t size, const char *mnemonic, const char *op_str)
+{
+  int len = 0;
+
+  /* Address and bytes, then mnemonic and operand, aligned on tabs */
+  len += snprintf (line + len, max - len, "0x%" PRIxPTR "  ", ip);
+  for (size_t i = 0; i < size; i++)
+    len += snprintf (line + len, max - len, " %02x", opcodes[i]);
+
+  if (size != 8 && size != 11)
+    line[len++] = '\t';
+  for (int i = 0; i < 4 - (size / 3); i++)
+    line[len++] = '\t';
+
+  len += snprintf (line + len, max - len, "%s  %s\n", mnemonic, op_str);
+  return len;
+}
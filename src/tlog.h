@@ -0,0 +1,129 @@
+/*
+ * tracker is an hybrid trustworthy disassembler that tries to limit the number
+ * of false positive paths discovered.
+ *
+ *  Written and maintained by Emmanuel Fleury <emmanuel.fleury@u-bordeaux.fr>
+ *
+ * Copyright 2019 University of Bordeaux, CNRS (UMR 5800), France.
+ * All rights reserved.
+ *
+ * This software is released under a 3-clause BSD license (see COPYING file).
+ */
+
+#ifndef _TLOG_H
+#define _TLOG_H
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* A binary trace log is the magic string followed by records. A record
+ * starts with a varint (LEB128) whose 2 low bits are its kind, the other
+ * bits being its argument:
+ *  - STEP:   the zigzag encoded difference between the id of the executed
+ *            instruction and the id following the one of the previous step
+ *  - DEFINE: the size of a new instruction, followed by its address (varint)
+ *            and its opcodes. Instructions are numbered from 1, in the order
+ *            they are defined, and defined before their first step
+ *  - BEGIN:  the capstone mode of a new run, followed by its flags (varint),
+ *            the length (varint) and the bytes of the traced command
+ *  - END:    the number of instructions executed in the run */
+#define TLOG_MAGIC "TRKLOG1\n"
+#define TLOG_MAGIC_LEN 8
+
+/* Flags of a run */
+#define TLOG_INTEL 1            /* Listing in intel syntax */
+
+/* Size of the buffer of the writer */
+#define TLOG_BUFFER_SIZE (1 << 20)
+
+/* Kind of a record */
+typedef enum
+{
+  TLOG_STEP,
+  TLOG_DEFINE,
+  TLOG_BEGIN,
+  TLOG_END
+} tlog_kind_t;
+
+/* Writer of a trace log */
+typedef struct
+{
+  int fd;                   /* File written */
+  uint8_t *buf;             /* Records not written yet */
+  size_t len;               /* Length of buf */
+  uint32_t nb_defs;         /* Number of instructions defined */
+  uint32_t next;            /* Id following the one of the last step */
+} tlog_t;
+
+/* A record, as given by the reader */
+typedef struct
+{
+  tlog_kind_t kind;         /* Kind of the record */
+  uint32_t id;              /* Instruction (STEP, DEFINE) */
+  uintptr_t ip;             /* Address of the instruction (DEFINE) */
+  uint64_t arg;             /* Mode (BEGIN), count (END) or size (DEFINE) */
+  uint64_t flags;           /* Flags of the run (BEGIN) */
+  uint8_t *data;            /* Opcodes (DEFINE) or command (BEGIN) */
+} tlog_record_t;
+
+/* Reader of a trace log */
+typedef struct
+{
+  FILE *file;               /* File read */
+  uint32_t nb_defs;         /* Number of instructions defined */
+  uint32_t next;            /* Id following the one of the last step */
+  uint8_t *data;            /* Data of the last record */
+  size_t max_data;          /* Allocated size of data */
+} tlog_reader_t;
+
+/* Create the trace log path, NULL otherwise (and set errno) */
+tlog_t *tlog_new (const char *path);
+
+/* Create a trace log written to fd, NULL otherwise (and set errno). The
+ * file descriptor is closed with the log */
+tlog_t *tlog_open (int fd);
+
+/* Flush and close the trace log */
+void tlog_delete (tlog_t *log);
+
+/* Start a new run of command, decoded in the given capstone mode */
+void tlog_begin (tlog_t *log, unsigned mode, uint64_t flags,
+                 const char *command);
+
+/* Define a new instruction, returns its id */
+uint32_t tlog_define (tlog_t *log, uintptr_t ip, uint8_t size,
+                      const uint8_t *opcodes);
+
+/* Record the execution of the instruction id */
+void tlog_step (tlog_t *log, uint32_t id);
+
+/* End the current run, count instructions were executed */
+void tlog_end (tlog_t *log, uint64_t count);
+
+/* Open the trace log path, NULL otherwise (and set errno) */
+tlog_reader_t *tlog_reader_new (const char *path);
+
+/* Read the trace log from file, at the magic string. NULL otherwise (and
+ * set errno), file is closed with the reader only */
+tlog_reader_t *tlog_reader_open (FILE *file);
+
+/* Close the trace log */
+void tlog_reader_delete (tlog_reader_t *reader);
+
+/* Read the next record, returns false at the end of the log (errno is set
+ * if the log is corrupted). The data of the record is valid until the next
+ * call */
+bool tlog_read (tlog_reader_t *reader, tlog_record_t *rec);
+
+/* Append to log all the runs read by reader, returns false if they are
+ * corrupted or memory runs out */
+bool tlog_copy (tlog_t *log, tlog_reader_t *reader);
+
+/* Format the line of the listing of an instruction in line (of size max),
+ * returns its length */
+int tlog_format (char *line, size_t max, uintptr_t ip, const uint8_t *opcodes,
+                 uint8_t size, const char *mnemonic, const char *op_str);
+
+#endif /* _TLOG_H */
@@ -13,9 +13,15 @@
 #include <trace.h>
 
 #include <errno.h>
+#include <pthread.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdio.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 struct _instr_t
 {
   uintptr_t address;  /* Address where lies the instruction */
@@ -24,6 +30,61 @@ struct _instr_t
   uint8_t opcodes[];  /* Instruction opcode */
 };
 
+/* Classes of the primary opcodes, the control transfers and the bytes
+ * that need a look at the following one */
+#define OP_PREFIX 0x10      /* Legacy or REX prefix */
+#define OP_ESCAPE 0x11      /* Two-byte opcode (0x0F) */
+#define OP_GROUP5 0x12      /* Call or jump, depending on ModRM (0xFF) */
+
+static const uint8_t primary_class[256] = {
+  [0x26] = OP_PREFIX, [0x2E] = OP_PREFIX, [0x36] = OP_PREFIX,
+  [0x3E] = OP_PREFIX, [0x40 ... 0x4F] = OP_PREFIX, [0x64 ... 0x67] = OP_PREFIX,
+  [0xF0] = OP_PREFIX, [0xF2] = OP_PREFIX, [0xF3] = OP_PREFIX,
+  [0x0F] = OP_ESCAPE,
+  [0x70 ... 0x7F] = BRANCH,   /* jcc rel8 */
+  [0x9A] = CALL,              /* call far */
+  [0xC2] = RET, [0xC3] = RET, /* ret (imm16) */
+  [0xCA] = RET, [0xCB] = RET, /* ret far (imm16) */
+  [0xE0 ... 0xE3] = BRANCH,   /* loop, jcxz */
+  [0xE8] = CALL,              /* call rel */
+  [0xE9 ... 0xEB] = JUMP,     /* jmp rel, jmp far */
+  [0xFF] = OP_GROUP5
+};
+
+instr_type_t
+instr_classify (const uint8_t size, const uint8_t *opcodes)
+{
+  /* The class of the primary opcode, once past the prefixes. A prefix
+   * ending the instruction is the opcode itself (inc/dec in 32 bits) */
+  if (size == 0)
+    return BASIC;
+  uint8_t i = 0;
+  while (i + 1 < size && primary_class[opcodes[i]] == OP_PREFIX)
+    i++;
+
+  uint8_t class = primary_class[opcodes[i]];
+  if (class < OP_PREFIX)
+    return class;
+  if (class == OP_PREFIX || i + 1 >= size)
+    return BASIC;
+
+  /* jcc rel32, or group 5: /2 and /3 are calls, /4 and /5 are jumps */
+  uint8_t next = opcodes[i + 1];
+  if (class == OP_ESCAPE)
+    return (next >= 0x80 && next <= 0x8F) ? BRANCH : BASIC;
+  switch ((next >> 3) & 7)
+    {
+    case 2:
+    case 3:
+      return CALL;
+    case 4:
+    case 5:
+      return JUMP;
+    default:
+      return BASIC;
+    }
+}
+
 instr_t *
 instr_new (const uintptr_t addr, const uint8_t size, const uint8_t *opcodes)
 {
@@ -41,31 +102,7 @@ instr_new (const uintptr_t addr, const uint8_t size, const uint8_t *opcodes)
   instr->address = addr;
   instr->size = size;
   memcpy (instr->opcodes, opcodes, size);
-	/* Test opcodes to assign type to instruction */
-	if ((opcodes[0] >= 0x70 && opcodes[0] <= 0x7F)
-			|| (opcodes[0] == 0x0F && opcodes[1] >= 0x80 && opcodes[1] <= 0x8F))
-    instr->type = BRANCH;
-	else if (opcodes[0] == 0xE8
-           || opcodes[0] == 0x9A
-		       || (opcodes[0] == 0xFF && (((size == 2 && opcodes[1] >= 0xD0 && opcodes[1] <= 0xDF)
-                                        || size == 3) || opcodes[1] == 0x15))
-				 	 || (opcodes[0] == 0x41 && opcodes[1] == 0xFF
-						   && ((opcodes[2] >= 0xD0 && opcodes[2] <= 0xD7) || size > 3)))
-		instr->type = CALL;
-	else if ((opcodes[0] >= 0xE9 && opcodes[0] <= 0xEB)
-	         || (opcodes[0] == 0xFF && (((size == 2 && opcodes[1] >= 0xE0 && opcodes[1] <= 0xEF)
-                                        || size == 4 || size == 5) || opcodes[1] == 0x25))
-           || (opcodes[0] >= 0xE0 && opcodes[0] <= 0xE3)
-				   || (opcodes[0] == 0x41 && opcodes[1] == 0xFF
-					     && opcodes[2] >= 0xE0 && opcodes[2] <= 0xE7)
-           || (opcodes[0] == 0xF3 && (size == 2 || size == 3) && opcodes[1] != 0xC3))
-		instr->type = JUMP;
-	else if (((opcodes[0] == 0xC3 || opcodes[0] == 0xCB) && size == 1)
-           || ((opcodes[0] == 0xC2 || opcodes[0] == 0xCA) && size == 3)
-           || (opcodes[0] == 0xF3 && opcodes[1] == 0xC3 && size == 2))
-	  instr->type = RET;
-	else
-		instr->type = BASIC;
+  instr->type = instr_classify (size, opcodes);
   return instr;
 }
 
@@ -93,29 +130,172 @@ instr_get_opcodes (const instr_t *instr)
   return instr->opcodes;
 }
 
+instr_type_t
+instr_get_type (const instr_t *instr)
+{
+  return instr->type;
+}
+
+/* Arena implementation */
+
+/* Size of the first chunk of an arena, each next one is twice as large up
+ * to ARENA_MAX_CHUNK_SIZE: a small cfg only takes a few pages */
+#define ARENA_MIN_CHUNK_SIZE (1 << 12)
+#define ARENA_MAX_CHUNK_SIZE (1 << 20)
+
+/* Alignment of the blocks allocated in the arena */
+#define ARENA_ALIGN 8
+
+typedef struct _chunk_t chunk_t;
+
+struct _chunk_t
+{
+  chunk_t *next;        /* Previous chunk allocated */
+  size_t size;          /* Size of data */
+  size_t used;          /* Bytes of data already allocated */
+  max_align_t data[];   /* Memory given away by the arena */
+};
+
+/* Bump allocator owning all the memory of the nodes of a cfg */
+typedef struct
+{
+  chunk_t *chunks;      /* Chunk in use, followed by the full ones */
+} arena_t;
+
+/* Get size bytes from the arena, NULL otherwise */
+static void *
+arena_alloc (arena_t *arena, size_t size)
+{
+  size = (size + ARENA_ALIGN - 1) & ~((size_t) ARENA_ALIGN - 1);
+
+  chunk_t *chunk = arena->chunks;
+  if (!chunk || chunk->size - chunk->used < size)
+    {
+      size_t chunk_size = ARENA_MIN_CHUNK_SIZE;
+      if (chunk)
+        chunk_size = (chunk->size < ARENA_MAX_CHUNK_SIZE / 2) ?
+          2 * chunk->size : ARENA_MAX_CHUNK_SIZE;
+      if (size > chunk_size)
+        chunk_size = size;
+      chunk = malloc (sizeof (chunk_t) + chunk_size);
+      if (!chunk)
+        return NULL;
+      chunk->size = chunk_size;
+      chunk->used = 0;
+      chunk->next = arena->chunks;
+      arena->chunks = chunk;
+    }
+
+  void *ptr = (byte_t *) chunk->data + chunk->used;
+  chunk->used += size;
+  return ptr;
+}
+
+/* Free all the chunks of the arena at once */
+static void
+arena_release (arena_t *arena)
+{
+  while (arena->chunks)
+    {
+      chunk_t *next = arena->chunks->next;
+      free (arena->chunks);
+      arena->chunks = next;
+    }
+}
+
 /* Hashtable implementation */
 
-struct _hashtable_t
+/* Number of slots probed at once, they share a 16 bytes vector of tags */
+#define GROUP_SIZE 16
+
+/* Tag of an empty slot, the tag of a full one is 7 bits of its hash */
+#define TAG_EMPTY ((int8_t) 0x80)
+
+/* Maximum load factor before growing (7/8) */
+#define MAX_LOAD(size) ((size) - (size) / 8)
+
+/* Number of shards of a hashtable (2^SHARD_BITS), picked by the high bits
+ * of the hash, each one under its own lock */
+#define SHARD_BITS 6
+#define NB_SHARDS (1 << SHARD_BITS)
+
+/* Size of a chunk of nodes, chunks are aligned on their size */
+#define NODE_CHUNK_SIZE (1 << 16)
+
+/* Maximum number of chunks of nodes of a shard */
+#define MAX_CHUNKS 8192
+
+/* Header of a chunk of nodes, found from a node by masking its address */
+typedef struct
+{
+  hashtable_t *ht;      /* Hashtable owning the nodes */
+} node_chunk_t;
+
+/* An entry of the hashtable, its key is inlined */
+typedef struct
 {
-  size_t size;          /* Hashtable size */
-  size_t collisions;    /* Number of collisions encountered */
+  uint64_t hash;        /* Hash of the instruction */
+  uintptr_t address;    /* Address of the instruction */
+  cfg_t *cfg;           /* Node of the instruction */
+} slot_t;
+
+/* A part of the hashtable, it owns the nodes of its entries */
+typedef struct
+{
+  pthread_mutex_t lock; /* Lock of the shard and of the successors of its nodes */
+  size_t size;          /* Number of slots (power of 2) */
+  size_t collisions;    /* Entries stored out of their home group */
   size_t entries;       /* Number of entries registered */
-  cfg_t **buckets[];   /* Hachtable buckets */
+  int8_t *tags;         /* Tag of each slot */
+  slot_t *slots;        /* Hashtable slots */
+  arena_t arena;        /* Memory of the instructions and successors */
+  node_chunk_t **nodes; /* Chunks of nodes (MAX_CHUNKS), indexed by id */
+  size_t nb_chunks;     /* Number of chunks of nodes */
+  uint32_t nb_nodes;    /* Number of nodes allocated */
+} shard_t;
+
+struct _hashtable_t
+{
+  shard_t shards[NB_SHARDS]; /* Entries, by the high bits of their hash */
+  pthread_mutex_t lock; /* Lock of the function entries */
+  list_t *first_entry;  /* Entries of the functions, in order of discovery */
+  list_t *tail_entries; /* Last entry of first_entry */
+  uint16_t nb_function; /* Number of functions after the first one */
+  uint8_t edge_map[EDGE_MAP_SIZE]; /* Traversals of the edges, hashed */
 };
 
+/* Number of inline successors of a node */
+#define INLINE_SUCCESSORS 2
+
+/* An edge of the cfg, from the node holding it */
+typedef struct
+{
+  uint32_t id;          /* Id of the successor */
+  uint32_t hits;        /* Number of times it was taken (saturates) */
+} edge_t;
 
 struct _cfg_t
 {
 	instr_t *instruction; /* Pointer to instruction */
+  uint32_t id; /* Index of the node in its hashtable */
 	uint16_t nb_in; /* Number of predecessor */
 	uint16_t nb_out; /* Number of successor */
 	uint16_t name; /* Current function name */
-  char *str_graph; /* Address + opcodes + mnemonic + operand */
-	cfg_t **successor; /* Array of pointers to successor */
+  uint64_t hits; /* Number of times it was executed */
+  union
+  {
+    edge_t local[INLINE_SUCCESSORS]; /* Successors (nb_out <= 2) */
+    edge_t *spill; /* Successors in the arena (nb_out > 2) */
+  } successor;
 };
 
-/* Keep track of the number of different function called */
-uint16_t nb_name = 0;
+/* Nodes are allocated by the thousand, and one is touched at each step: 24
+ * bytes of fields, the hits and two inline edges fill 48 bytes (on 64 bits) */
+_Static_assert (sizeof (cfg_t) <= 48, "cfg_t outgrew 48 bytes");
+
+/* Number of nodes held by a chunk */
+#define NODES_PER_CHUNK \
+  ((NODE_CHUNK_SIZE - sizeof (node_chunk_t)) / sizeof (cfg_t))
 
 /* Compression function for Merkle-Damgard construction */
 #define mix(h)                                                                 \
@@ -174,6 +354,141 @@ hash_instr (const instr_t *instr)
   return fasthash64 (instr->opcodes, instr->size, instr->address);
 }
 
+/* Get the shard of the hashtable holding the given hash */
+static inline shard_t *
+hashtable_shard (hashtable_t *ht, uint64_t hash)
+{
+  return &(ht->shards[hash >> (64 - SHARD_BITS)]);
+}
+
+/* Get a bit mask of the slots of a group holding the given tag */
+static inline uint16_t
+group_match (const int8_t *tags, int8_t tag)
+{
+#ifdef __SSE2__
+  __m128i group = _mm_load_si128 ((const __m128i *) tags);
+  return _mm_movemask_epi8 (_mm_cmpeq_epi8 (group, _mm_set1_epi8 (tag)));
+#else
+  uint16_t mask = 0;
+  for (int i = 0; i < GROUP_SIZE; i++)
+    if (tags[i] == tag)
+      mask |= 1 << i;
+  return mask;
+#endif
+}
+
+/* Get the index of the slot holding the key, or of the empty slot where it
+ * goes. probe is set to the number of groups visited after the home one */
+static size_t
+shard_find (const shard_t *shard, uint64_t hash, uintptr_t address,
+            size_t *probe)
+{
+  size_t mask = shard->size / GROUP_SIZE - 1;
+  size_t group = (hash >> 7) & mask;
+  int8_t tag = hash & 0x7F;
+
+  for (size_t i = 0; ; i++)
+    {
+      const int8_t *tags = shard->tags + group * GROUP_SIZE;
+      for (uint16_t m = group_match (tags, tag); m; m &= m - 1)
+        {
+          size_t index = group * GROUP_SIZE + __builtin_ctz (m);
+          if (shard->slots[index].hash == hash
+              && shard->slots[index].address == address)
+            {
+              *probe = i;
+              return index;
+            }
+        }
+
+      uint16_t empty = group_match (tags, TAG_EMPTY);
+      if (empty)
+        {
+          *probe = i;
+          return group * GROUP_SIZE + __builtin_ctz (empty);
+        }
+
+      /* Triangular probing visits every group once */
+      group = (group + i + 1) & mask;
+    }
+}
+
+/* Allocate the slots of a table of the given size (power of 2) */
+static bool
+shard_alloc (shard_t *shard, size_t size)
+{
+  int8_t *tags = aligned_alloc (GROUP_SIZE, size);
+  slot_t *slots = malloc (size * sizeof (slot_t));
+  if (!tags || !slots)
+    {
+      free (tags);
+      free (slots);
+      return false;
+    }
+  memset (tags, TAG_EMPTY, size);
+
+  free (shard->tags);
+  free (shard->slots);
+  shard->tags = tags;
+  shard->slots = slots;
+  shard->size = size;
+  return true;
+}
+
+/* Store a new entry in the slot found for it */
+static void
+shard_store (shard_t *shard, slot_t *slot)
+{
+  size_t probe;
+  size_t index = shard_find (shard, slot->hash, slot->address, &probe);
+
+  shard->tags[index] = slot->hash & 0x7F;
+  shard->slots[index] = *slot;
+  shard->entries++;
+  if (probe > 0)
+    shard->collisions++;
+}
+
+/* Double the size of the shard, the keys are inline so nodes are not even
+ * read */
+static bool
+shard_grow (shard_t *shard)
+{
+  int8_t *tags = shard->tags;
+  slot_t *slots = shard->slots;
+  size_t size = shard->size;
+
+  shard->tags = NULL;
+  shard->slots = NULL;
+  if (!shard_alloc (shard, 2 * size))
+    {
+      shard->tags = tags;
+      shard->slots = slots;
+      shard->size = size;
+      return false;
+    }
+
+  shard->entries = 0;
+  shard->collisions = 0;
+  for (size_t i = 0; i < size; i++)
+    if (tags[i] != TAG_EMPTY)
+      shard_store (shard, &(slots[i]));
+
+  free (tags);
+  free (slots);
+  return true;
+}
+
+/* Register a new entry in the shard (locked), growing it if needed */
+static bool
+shard_insert (shard_t *shard, slot_t *slot)
+{
+  if (shard->entries + 1 > MAX_LOAD (shard->size) && !shard_grow (shard))
+    return false;
+  shard_store (shard, slot);
+  return true;
+}
+
 hashtable_t *
 hashtable_new (const size_t size)
 {
@@ -183,37 +498,50 @@ hashtable_new (const size_t size)
       return NULL;
     }
 
-  hashtable_t *ht = malloc (sizeof (hashtable_t) + size * sizeof (cfg_t *));
+  hashtable_t *ht = calloc (1, sizeof (hashtable_t));
   if (!ht)
     return NULL;
 
-  /* Initialize to zero */
-  *ht = (hashtable_t) {0};
-  ht->size = size;
-  ht->collisions = 0;
-  ht->entries = 0;
-  memset (ht->buckets, 0, size * sizeof (cfg_t *));
+  /* Round up to a power of 2, one group per shard at least */
+  size_t slots = GROUP_SIZE;
+  while (slots * NB_SHARDS < size)
+    slots *= 2;
 
+  pthread_mutex_init (&(ht->lock), NULL);
+  for (size_t i = 0; i < NB_SHARDS; i++)
+    {
+      shard_t *shard = &(ht->shards[i]);
+      pthread_mutex_init (&(shard->lock), NULL);
+      shard->nodes = calloc (MAX_CHUNKS, sizeof (node_chunk_t *));
+      if (!shard->nodes || !shard_alloc (shard, slots))
+        {
+          hashtable_delete (ht);
+          errno = ENOMEM;
+          return NULL;
+        }
+    }
   return ht;
 }
 
 void
 hashtable_delete (hashtable_t *ht)
 {
-  for (size_t i = 0; i < ht->size; i++)
-		{
-			size_t j = 0;
-			if (ht->buckets[i])
-				{
-					while (ht->buckets[i][j] != NULL)
-						cfg_delete (ht->buckets[i][j++]);
-					free (ht->buckets[i]);
-				}
-		}
+  for (size_t i = 0; i < NB_SHARDS; i++)
+    {
+      shard_t *shard = &(ht->shards[i]);
+      for (size_t j = 0; j < shard->nb_chunks; j++)
+        free (shard->nodes[j]);
+      free (shard->nodes);
+      arena_release (&(shard->arena));
+      free (shard->tags);
+      free (shard->slots);
+      pthread_mutex_destroy (&(shard->lock));
+    }
+  list_delete (ht->first_entry);
+  pthread_mutex_destroy (&(ht->lock));
   free (ht);
 }
 
-
 bool
 hashtable_insert (hashtable_t * ht, cfg_t *CFG)
 {
@@ -223,37 +551,19 @@ hashtable_insert (hashtable_t * ht, cfg_t *CFG)
       return false;
     }
 
-  size_t index = hash_instr (CFG->instruction) % ht->size;
-
-  /* Bucket is empty */
-  if (ht->buckets[index] == NULL)
-    {
-      ht->buckets[index] = calloc (2, sizeof (cfg_t *));
-      if (ht->buckets[index] == NULL)
-				return false;
-      ht->buckets[index][0] = CFG;
-      ht->entries++;
-      return true;
-    }
-
-  /* Bucket isn't NULL, scanning all entries to see if instr is already here */
-  size_t k = 0;
-  while (ht->buckets[index][k] != NULL)
-    if (ht->buckets[index][k++]->instruction->address
-        == CFG->instruction->address)
-			return true; /* No error but we need to delete the redundant one */
-  cfg_t **new_bucket = calloc (k + 2, sizeof (cfg_t *));
-  if (!new_bucket)
-		return false;
-
-  ht->collisions++;
-  ht->entries++;
-  memcpy (new_bucket, ht->buckets[index], k * sizeof (cfg_t *));
-  new_bucket[k] = CFG;
-  free (ht->buckets[index]);
-  ht->buckets[index] = new_bucket;
-
-  return true;
+  slot_t slot = { hash_instr (CFG->instruction), CFG->instruction->address,
+                  CFG };
+  shard_t *shard = hashtable_shard (ht, slot.hash);
+  bool ok = true;
+  size_t probe;
+
+  pthread_mutex_lock (&(shard->lock));
+  size_t index = shard_find (shard, slot.hash, slot.address, &probe);
+  /* No error if it is there but we need to delete the redundant one */
+  if (shard->tags[index] == TAG_EMPTY)
+    ok = shard_insert (shard, &slot);
+  pthread_mutex_unlock (&(shard->lock));
+  return ok;
 }
 
 cfg_t *
@@ -262,33 +572,120 @@ hashtable_lookup (hashtable_t *ht, instr_t *instr)
   if (!ht)
     return NULL;
 
-  size_t index = hash_instr (instr) % ht->size;
-
-  /* Bucket is empty */
-  if (ht->buckets[index] == NULL)
-    return NULL;
-
-  /* Bucket is not empty, scanning all entries to see if instr is here */
-  size_t k = 0;
-  while (ht->buckets[index][k] != NULL)
-		{
-	    if (ht->buckets[index][k]->instruction->address == instr->address)
-				return ht->buckets[index][k];
-			k++;
-		}
-  return NULL;
+  uint64_t hash = hash_instr (instr);
+  shard_t *shard = hashtable_shard (ht, hash);
+  cfg_t *CFG = NULL;
+  size_t probe;
+
+  pthread_mutex_lock (&(shard->lock));
+  size_t index = shard_find (shard, hash, instr->address, &probe);
+  if (shard->tags[index] != TAG_EMPTY)
+    CFG = shard->slots[index].cfg;
+  pthread_mutex_unlock (&(shard->lock));
+  return CFG;
 }
 
+/* Sum a counter over all the shards */
+#define SHARDS_SUM(ht, field)                                                  \
+  ({                                                                           \
+    size_t sum = 0;                                                            \
+    for (size_t i = 0; i < NB_SHARDS; i++)                                     \
+      {                                                                        \
+        pthread_mutex_lock (&((ht)->shards[i].lock));                          \
+        sum += (ht)->shards[i].field;                                          \
+        pthread_mutex_unlock (&((ht)->shards[i].lock));                        \
+      }                                                                        \
+    sum;                                                                       \
+  })
+
 size_t
 hashtable_entries (hashtable_t *ht)
 {
-  return ht->entries;
+  return SHARDS_SUM (ht, entries);
 }
 
 size_t
 hashtable_collisions (hashtable_t *ht)
 {
-  return ht->collisions;
+  return SHARDS_SUM (ht, collisions);
+}
+
+size_t
+hashtable_size (hashtable_t *ht)
+{
+  return SHARDS_SUM (ht, size);
+}
+
+size_t
+hashtable_probe_length (hashtable_t *ht, double *mean)
+{
+  size_t max = 0, total = 0, entries = 0;
+
+  for (size_t s = 0; s < NB_SHARDS; s++)
+    {
+      shard_t *shard = &(ht->shards[s]);
+      pthread_mutex_lock (&(shard->lock));
+      for (size_t i = 0; i < shard->size; i++)
+        if (shard->tags[i] != TAG_EMPTY)
+          {
+            size_t probe;
+            shard_find (shard, shard->slots[i].hash, shard->slots[i].address,
+                        &probe);
+            total += probe;
+            if (probe > max)
+              max = probe;
+          }
+      entries += shard->entries;
+      pthread_mutex_unlock (&(shard->lock));
+    }
+
+  if (mean)
+    *mean = entries ? (double) total / entries : 0.0;
+  return max;
+}
+
+bool
+hashtable_add_entry (hashtable_t *ht, cfg_t *CFG)
+{
+  bool ok;
+  pthread_mutex_lock (&(ht->lock));
+  if (!ht->first_entry)
+    ok = (ht->first_entry = ht->tail_entries = list_new (CFG)) != NULL;
+  else
+    {
+      list_t *tail = list_insert_after (ht->tail_entries, CFG);
+      ok = (tail != NULL);
+      if (ok)
+        {
+          ht->tail_entries = tail;
+          ht->nb_function++;
+        }
+    }
+  pthread_mutex_unlock (&(ht->lock));
+  return ok;
+}
+
+void
+hashtable_foreach (hashtable_t *ht, void (*fn) (cfg_t *, void *), void *data)
+{
+  for (size_t s = 0; s < NB_SHARDS; s++)
+    for (uint32_t i = 0; i < ht->shards[s].nb_nodes; i++)
+      fn (hashtable_get_node (ht, i * NB_SHARDS + s), data);
+}
+
+const uint8_t *
+hashtable_get_edge_map (hashtable_t *ht)
+{
+  return ht->edge_map;
+}
+
+list_t *
+hashtable_get_entries (hashtable_t *ht)
+{
+  pthread_mutex_lock (&(ht->lock));
+  list_t *entries = ht->first_entry;
+  pthread_mutex_unlock (&(ht->lock));
+  return entries;
 }
 
 /* Linked list implementation */
@@ -354,294 +751,514 @@ list_delete (list_t *l)
 }
 
 void *
-list_get_ith (list_t *l, unsigned int i)
+list_get_ith (list_t *l, size_t i)
 {
-  if (!l)
-    return NULL;
-  if (!i)
-    return l->data;
-  return list_get_ith(l->next, i - 1);
+  for (; l && i > 0; i--)
+    l = l->next;
+  return l ? l->data : NULL;
 }
 
-uint16_t
+size_t
 list_get_size (list_t *l)
 {
-  if (!l)
-    return 0;
-  if (!l->next)
-    return 1;
-  return 1 + list_get_size (l->next);
+  size_t size = 0;
+  for (; l; l = l->next)
+    size++;
+  return size;
+}
+
+void *
+list_get_data (list_t *l)
+{
+  return l ? l->data : NULL;
+}
+
+list_t *
+list_get_next (list_t *l)
+{
+  return l ? l->next : NULL;
 }
 
 /* Trace implementation */
 
+struct _trace_t
+{
+  uint32_t *ids;      /* Ids of the nodes run through, in order */
+  size_t size;        /* Number of ids */
+  size_t max;         /* Allocated size of ids */
+};
+
 trace_t *
-trace_new (instr_t *ins)
+trace_new (void)
 {
-	return list_new (ins);
+  return calloc (1, sizeof (trace_t));
 }
 
-trace_t *
-trace_insert (trace_t *t, instr_t *ins)
+bool
+trace_append (trace_t *t, uint32_t id)
+{
+  if (t->size == t->max)
+    {
+      size_t max = t->max ? 2 * t->max : 1024;
+      uint32_t *ids = realloc (t->ids, max * sizeof (uint32_t));
+      if (!ids)
+        return false;
+      t->ids = ids;
+      t->max = max;
+    }
+  t->ids[t->size++] = id;
+  return true;
+}
+
+size_t
+trace_get_size (const trace_t *t)
 {
-	return list_insert_after (t, ins);
+  return t->size;
+}
+
+const uint32_t *
+trace_get_ids (const trace_t *t)
+{
+  return t->ids;
 }
 
 void
 trace_delete (trace_t *t)
 {
-	list_delete (t);
-  return;
+  if (!t)
+    return;
+  free (t->ids);
+  free (t);
 }
 
-trace_t *
-trace_compare (trace_t *t1, trace_t *t2)
-{
-	trace_t *tmp1 = t1;
-	trace_t *tmp2 = t2;
-	while (((instr_t *) tmp1->data)->address == ((instr_t *) tmp2->data)->address)
-		{
-			tmp1 = tmp1->next;
-			tmp2 = tmp2->next;
-			if (!tmp1)
-				return tmp2;
-			if (!tmp2)
-				return NULL;
-		}
-		return tmp2;
+size_t
+trace_compare (const trace_t *t1, const trace_t *t2)
+{
+  size_t size = (t1->size < t2->size) ? t1->size : t2->size;
+  const uint32_t *ids1 = t1->ids, *ids2 = t2->ids;
+  size_t i = 0;
+
+#ifdef __SSE2__
+  /* Eight ids at a time, the mismatch is then looked for in the group */
+  for (; i + 8 <= size; i += 8)
+    {
+      __m128i lo = _mm_cmpeq_epi32 (_mm_loadu_si128 ((const __m128i *) (ids1 + i)),
+                                    _mm_loadu_si128 ((const __m128i *) (ids2 + i)));
+      __m128i hi = _mm_cmpeq_epi32 (_mm_loadu_si128 ((const __m128i *) (ids1 + i + 4)),
+                                    _mm_loadu_si128 ((const __m128i *) (ids2 + i + 4)));
+      if (_mm_movemask_epi8 (_mm_and_si128 (lo, hi)) != 0xFFFF)
+        break;
+    }
+#endif
+  while (i < size && ids1[i] == ids2[i])
+    i++;
+  return i;
+}
+
+uint64_t
+trace_hash (uint64_t hash, uint32_t id)
+{
+  return fasthash64 ((const uint8_t *) &id, sizeof (id), hash);
 }
 
 /* Stack implementation */
 
-stack_t *
-stack_new (void *d)
+struct _callstack_t
+{
+  void **items;       /* Elements, the top is the last one */
+  size_t size;        /* Number of elements */
+  size_t max;         /* Allocated size of items */
+};
+
+callstack_t *
+stack_new (void)
 {
-  return list_new (d);
+  return calloc (1, sizeof (callstack_t));
 }
 
-stack_t *
-stack_push (stack_t *s, void *d)
+bool
+stack_push (callstack_t *s, void *d)
 {
-  if (!s)
-    return list_new (d);
-  return list_insert_before (s, d);
+  if (s->size == s->max)
+    {
+      size_t max = s->max ? 2 * s->max : 64;
+      void **items = realloc (s->items, max * sizeof (void *));
+      if (!items)
+        return false;
+      s->items = items;
+      s->max = max;
+    }
+  s->items[s->size++] = d;
+  return true;
 }
 
-stack_t *
-stack_pop (stack_t *s)
+void *
+stack_pop (callstack_t *s)
 {
-  if (!s)
-    return NULL;
-  stack_t *tmp = s->next;
-  free (s);
-  return tmp;
+  return s->size ? s->items[--s->size] : NULL;
 }
 
 void *
-stack_get_top (stack_t *s)
+stack_get_top (const callstack_t *s)
 {
-  if (!s)
-    return NULL;
-  return s->data;
+  return s->size ? s->items[s->size - 1] : NULL;
+}
+
+size_t
+stack_get_size (const callstack_t *s)
+{
+  return s->size;
 }
 
 void
-stack_delete (stack_t *s)
+stack_clear (callstack_t *s)
 {
-  list_delete (s);
-  return;
+  s->size = 0;
+}
+
+void
+stack_delete (callstack_t *s)
+{
+  if (!s)
+    return;
+  free (s->items);
+  free (s);
 }
 
 /* CFG implementation */
 
+/* Get a new node of the shard (locked) with its id set, the rest is
+ * zeroed. Ids interleave the shards: the shard of a node is id % NB_SHARDS */
+static cfg_t *
+node_alloc (hashtable_t *ht, shard_t *shard)
+{
+  size_t index = shard->nb_nodes % NODES_PER_CHUNK;
+  if (index == 0)
+    {
+      if (shard->nb_chunks == MAX_CHUNKS)
+        {
+          errno = ENOMEM;
+          return NULL;
+        }
+      node_chunk_t *chunk = aligned_alloc (NODE_CHUNK_SIZE, NODE_CHUNK_SIZE);
+      if (!chunk)
+        return NULL;
+      chunk->ht = ht;
+      shard->nodes[shard->nb_chunks++] = chunk;
+    }
+
+  cfg_t *CFG = (cfg_t *) (shard->nodes[shard->nb_chunks - 1] + 1) + index;
+  *CFG = (cfg_t) { 0 };
+  CFG->id = shard->nb_nodes++ * NB_SHARDS + (shard - ht->shards);
+  return CFG;
+}
+
+/* Give back the last node allocated in shard (locked), nothing refers to
+ * it yet */
+static void
+node_unalloc (shard_t *shard)
+{
+  if (--shard->nb_nodes % NODES_PER_CHUNK == 0)
+    free (shard->nodes[--shard->nb_chunks]);
+}
+
 cfg_t *
-cfg_new (hashtable_t *ht, instr_t *ins, char *str, list_t **tail_entries)
+hashtable_get_node (hashtable_t *ht, uint32_t id)
 {
-  cfg_t *CFG = calloc (1, sizeof (cfg_t));
-	if (!CFG)
-		return NULL;
-  if (ins->type == BASIC)
-	/* If type is BASIC then we know for sure there can only be one successor */
-    CFG->successor = calloc (1, sizeof (cfg_t));
+  /* The directory of chunks never moves, no need to lock the shard */
+  shard_t *shard = &(ht->shards[id % NB_SHARDS]);
+  uint32_t index = id / NB_SHARDS;
+  return (cfg_t *) (shard->nodes[index / NODES_PER_CHUNK] + 1)
+    + index % NODES_PER_CHUNK;
+}
+
+/* Get the node of ins in ht, and set created if it is a new one. ins is
+ * moved in the arena of the shard or freed, in any case */
+static cfg_t *
+cfg_get (hashtable_t *ht, instr_t *ins, bool *created)
+{
+  size_t instr_size = sizeof (instr_t) + ins->size * sizeof (uint8_t);
+  slot_t slot = { hash_instr (ins), ins->address, NULL };
+  shard_t *shard = hashtable_shard (ht, slot.hash);
+  size_t probe;
+
+  /* The look-up and the insertion are done at once */
+  pthread_mutex_lock (&(shard->lock));
+  size_t index = shard_find (shard, slot.hash, slot.address, &probe);
+  *created = (shard->tags[index] == TAG_EMPTY);
+  if (!*created)
+    slot.cfg = shard->slots[index].cfg;
   else
-    CFG->successor = calloc (2, sizeof (cfg_t));
-  if (!CFG->successor)
     {
-      cfg_delete (CFG);
-      return NULL;
+      /* The instructions lie side by side in the arena. A node is only
+       * counted in the shard with its instruction, or walks would meet it */
+      instr_t *instr = arena_alloc (&(shard->arena), instr_size);
+      cfg_t *CFG = instr ? node_alloc (ht, shard) : NULL;
+      if (CFG)
+        {
+          memcpy (instr, ins, instr_size);
+          CFG->instruction = instr;
+          slot.cfg = CFG;
+          if (!shard_insert (shard, &slot))
+            {
+              node_unalloc (shard);
+              slot.cfg = NULL;
+            }
+        }
     }
-	/* Initializing the CFG structure */
-	CFG->instruction = ins;
-	CFG->nb_in = 0;
-	CFG->nb_out = 0;
-  CFG->str_graph = calloc ((strlen (str) + 1), sizeof (char));
-  if (!CFG->str_graph)
+  pthread_mutex_unlock (&(shard->lock));
+
+  instr_delete (ins);
+  return slot.cfg;
+}
+
+cfg_t *
+cfg_new (hashtable_t *ht, instr_t *ins)
+{
+  bool created;
+  cfg_t *CFG = cfg_get (ht, ins, &created);
+
+  /* The very first node is the entry of the first function */
+  if (CFG && created)
     {
-      cfg_delete (CFG);
-      return NULL;
+      pthread_mutex_lock (&(ht->lock));
+      if (!ht->first_entry)
+        {
+          ht->first_entry = ht->tail_entries = list_new (CFG);
+          if (!ht->first_entry)
+            CFG = NULL;
+        }
+      pthread_mutex_unlock (&(ht->lock));
+    }
+  return CFG;
+}
+
+/* Get the lock of the successors of CFG, the one of its shard */
+static inline pthread_mutex_t *
+cfg_lock (hashtable_t *ht, cfg_t *CFG)
+{
+  return &(ht->shards[CFG->id % NB_SHARDS].lock);
+}
+
+/* Get the array of the edges to the successors of CFG */
+static inline edge_t *
+cfg_successors (cfg_t *CFG)
+{
+  if (CFG->nb_out > INLINE_SUCCESSORS)
+    return CFG->successor.spill;
+  return CFG->successor.local;
+}
+
+/* Get the edge from CFG (locked) to new, NULL if there is none */
+static edge_t *
+cfg_find_successor (cfg_t *CFG, cfg_t *new)
+{
+  edge_t *edges = cfg_successors (CFG);
+  for (uint16_t i = 0; i < CFG->nb_out; i++)
+    if (edges[i].id == new->id)
+      return &(edges[i]);
+  return NULL;
+}
+
+/* Count hits more traversals of an edge */
+static inline void
+edge_hit (edge_t *edge, uint32_t hits)
+{
+  edge->hits = (edge->hits > UINT32_MAX - hits) ? UINT32_MAX
+    : edge->hits + hits;
+}
+
+/* Get the entry of the edge map for the edge from CFG to new */
+static inline uint8_t *
+edge_map_entry (hashtable_t *ht, const cfg_t *CFG, const cfg_t *new)
+{
+  return &(ht->edge_map[EDGE_INDEX (CFG->instruction->address,
+                                    new->instruction->address)]);
+}
+
+/* Count a traversal of the edge from CFG to new in the edge map. Entries
+ * are shared by the tracers, a count may be lost but never an edge */
+static inline void
+edge_map_hit (hashtable_t *ht, const cfg_t *CFG, const cfg_t *new)
+{
+  uint8_t *entry = edge_map_entry (ht, CFG, new);
+  uint8_t count = __atomic_load_n (entry, __ATOMIC_RELAXED);
+  if (count < UINT8_MAX)
+    __atomic_store_n (entry, count + 1, __ATOMIC_RELAXED);
+}
+
+/* Add the edge from CFG (locked) to new, taken hits times. Past the inline
+ * successors, they are moved to a spill array of the arena of its shard,
+ * doubled each time its size (a power of 2) is reached. new is not locked,
+ * its counter and name are updated atomically */
+static bool
+cfg_add_successor (hashtable_t *ht, cfg_t *CFG, cfg_t *new, uint32_t hits)
+{
+  uint16_t n = CFG->nb_out;
+
+  if (n >= INLINE_SUCCESSORS && !(n & (n - 1)))
+    {
+      arena_t *arena = &(ht->shards[CFG->id % NB_SHARDS].arena);
+      edge_t *spill = arena_alloc (arena, 2 * n * sizeof (edge_t));
+      if (!spill)
+        return false;
+      memcpy (spill, cfg_successors (CFG), n * sizeof (edge_t));
+      CFG->successor.spill = spill;
     }
-  strcpy (CFG->str_graph, str);
-	/* Initializing the nmae if it is the first function */
-	if (*tail_entries == NULL)
-    CFG->name = 0;
-	hashtable_insert (ht, CFG);
-	return CFG;
+
+  /* nb_out is updated last, cfg_successors() relies on it */
+  edge_t edge = { new->id, hits };
+  if (n + 1 > INLINE_SUCCESSORS)
+    CFG->successor.spill[n] = edge;
+  else
+    CFG->successor.local[n] = edge;
+  CFG->nb_out++;
+  __atomic_fetch_add (&(new->nb_in), 1, __ATOMIC_RELAXED);
+  __atomic_store_n (&(new->name), __atomic_load_n (&(CFG->name),
+                                                   __ATOMIC_RELAXED),
+                    __ATOMIC_RELAXED);
+  return true;
 }
 
+/* Add the edge from CFG (locked) to new, which is not one of its successors,
+ * as the type of CFG allows it: a branch has two successors at most, and
+ * the other instructions but jumps and returns only one. Returns true if it
+ * is added or left out, false if an error occured */
 static bool
-is_power_2 (uint16_t n)
+cfg_add_new_successor (hashtable_t *ht, cfg_t *CFG, cfg_t *new,
+                       instr_type_t type)
 {
-	if (n == 0)
-		return false;
-	while (n % 2 == 0)
-		{
-			if (n == 2)
-				return true;
-			n = n / 2;
-		}
-	return false;
+  switch (type)
+    {
+    case BRANCH:
+      return (CFG->nb_out < 2) && cfg_add_successor (ht, CFG, new, 1);
+    case JUMP:
+    case RET:
+      return cfg_add_successor (ht, CFG, new, 1);
+    default:
+      /* Checking if the parent already has a successor */
+      if (CFG->nb_out == 0)
+        return cfg_add_successor (ht, CFG, new, 1);
+      return true;
+    }
 }
 
 cfg_t *
-aux_cfg_insert (cfg_t *CFG, cfg_t *new, stack_t **stack)
+aux_cfg_insert (hashtable_t *ht, cfg_t *CFG, cfg_t *new, callstack_t *stack)
 {
 	if (!new)
 		return NULL;
-	/* Checking if the parent already has a successor */
-  if (CFG->instruction->type != RET && !CFG->successor[0])
-	  {
-		  CFG->successor[0] = new;
-			CFG->nb_out++;
-			new->nb_in++;
-			new->name = CFG->name;
-		}
-  else
-    {
-      cfg_t *top = NULL;
-			/* Inserting the new node in the parent's successors */
-      switch (CFG->instruction->type)
-        {
-        case BRANCH:
-          if (CFG->nb_out >= 2)
-            return NULL;
-          if (!CFG->successor)
-            {
-              cfg_delete (CFG);
-              return NULL;
-            }
-          CFG->successor[1] = new;
-          CFG->nb_out++;
-          new->nb_in++;
-          new->name = CFG->name;
-          break;
-        case JUMP:
-          if (is_power_2 (CFG->nb_out))
-            CFG->successor = realloc (CFG->successor, 2 * CFG->nb_out * sizeof (cfg_t *));
-          if (!CFG->successor)
-            {
-              cfg_delete (CFG);
-              return NULL;
-            }
-          CFG->successor[CFG->nb_out] = new;
-          CFG->nb_out++;
-          new->nb_in++;
-          new->name = CFG->name;
-          break;
-        case RET:
-					/* Checking the call on the top of the stack */
-          if (*stack)
-            {
-              top = (cfg_t *) stack_get_top (*stack);
-              if (new->instruction->address
-    						== top->instruction->address + top->instruction->size)
-                  {
-                    CFG = top;
-                    *stack = stack_pop (*stack);
-                    bool flag = false;
-        						/* Check if new is already a successor of CFG */
-                    for (size_t i = 0; i < CFG->nb_out; i++)
-                			{
-                				if (CFG->successor[i]->instruction->address
-                					 == new->instruction->address)
-                					{
-                            flag = true;
-                            break;
-                          }
-                			}
-                    if (flag)
-                      break;
-      				    }
-            }
-          if (is_power_2 (CFG->nb_out))
-            CFG->successor = realloc (CFG->successor, 2 * CFG->nb_out * sizeof (cfg_t *));
 
-          if (!CFG->successor)
-            {
-              cfg_delete (CFG);
-              return NULL;
-            }
-          CFG->successor[CFG->nb_out] = new;
-          CFG->nb_out++;
-          new->nb_in++;
-          new->name = CFG->name;
-          break;
-        }
+  /* A return is linked from the call on the top of the stack, if it goes
+   * back right after it */
+  bool returned = false;
+  cfg_t *top = (CFG->instruction->type == RET) ? stack_get_top (stack) : NULL;
+  if (top && new->instruction->address
+      == top->instruction->address + top->instruction->size)
+    {
+      CFG = top;
+      stack_pop (stack);
+      returned = true;
     }
-  return new;
+
+  /* Other tracers may add successors to CFG at the same time */
+  bool ok = true;
+  pthread_mutex_lock (cfg_lock (ht, CFG));
+  edge_t *edge = cfg_find_successor (CFG, new);
+  if (edge)
+    edge_hit (edge, 1);
+  else
+    ok = cfg_add_new_successor (ht, CFG, new, returned ? RET
+                                : CFG->instruction->type);
+  pthread_mutex_unlock (cfg_lock (ht, CFG));
+  return ok ? new : NULL;
 }
 
 cfg_t *
-cfg_insert (hashtable_t *ht, cfg_t *CFG, instr_t *ins, char *str, stack_t **stack, list_t **tail_entries, uint16_t *nb_function)
+cfg_insert (hashtable_t *ht, cfg_t *CFG, instr_t *ins, callstack_t *stack)
 {
 	if (!CFG)
 		return NULL;
-	cfg_t *new = hashtable_lookup (ht, ins);
-	/* First time seeing this instruction */
-	if (!new)
-		{
-  		new = cfg_new (ht, ins, str, tail_entries);
-  		/* Pushing the call on the stack */
-  		if (CFG->instruction->type == CALL)
-        {
-          *tail_entries = list_insert_after (*tail_entries, new);
-          *stack = stack_push (*stack, CFG);
-          *nb_function = (*nb_function) + 1;
-          new->name = *nb_function;
-        }
-  		return aux_cfg_insert(CFG, new, stack);
-		}
-  else
-	  {
-      instr_delete (ins);
-		  /* Checking if new is already a successor of old */
-      if (CFG->instruction->type == CALL)
+  bool created;
+	cfg_t *new = cfg_get (ht, ins, &created);
+  if (!new)
+    return NULL;
+	/* Not the first time seeing this instruction */
+  if (!created)
+    return cfg_link (ht, CFG, new, stack);
+
+  /* Pushing the call on the stack, new is the entry of a new function */
+  if (CFG->instruction->type == CALL)
+    {
+      pthread_mutex_lock (&(ht->lock));
+      list_t *tail = list_insert_after (ht->tail_entries, new);
+      if (tail)
         {
-          *stack = stack_push (*stack, CFG);
+          ht->tail_entries = tail;
+          ht->nb_function++;
+          __atomic_store_n (&(new->name), ht->nb_function, __ATOMIC_RELAXED);
         }
-		  for (size_t i = 0; i < CFG->nb_out; i++)
-				  if (CFG->successor[i]->instruction->address
-					    == new->instruction->address)
-					  return new;
-		  return aux_cfg_insert(CFG, new, stack);
-	  }
+      pthread_mutex_unlock (&(ht->lock));
+      if (!tail)
+        return NULL;
+      if (!stack_push (stack, CFG))
+        return NULL;
+    }
+  edge_map_hit (ht, CFG, new);
+  return aux_cfg_insert(ht, CFG, new, stack);
 }
 
-void
-cfg_delete (cfg_t *CFG)
-{
-	if (CFG)
-		{
-			if (CFG->instruction)
-  			{
-  				instr_delete (CFG->instruction);
-  			}
-			if (CFG->successor)
-				free (CFG->successor);
-      if (CFG->str_graph)
-        free (CFG->str_graph);
-			free (CFG);
-		}
-	return;
+cfg_t *
+cfg_link (hashtable_t *ht, cfg_t *CFG, cfg_t *new, callstack_t *stack)
+{
+  if (!CFG || !new)
+    return NULL;
+  if (CFG->instruction->type == CALL && !stack_push (stack, CFG))
+    return NULL;
+
+  /* Every edge is counted in the edge map before it is added under the lock
+   * of its source (but the ones of a call to its return address, added by
+   * returns): with the lock held, an entry at 0 means the edge is new for
+   * sure, it is added without looking for it */
+  const instr_type_t type = CFG->instruction->type;
+  pthread_mutex_lock (cfg_lock (ht, CFG));
+  bool fresh = !__atomic_load_n (edge_map_entry (ht, CFG, new),
+                                 __ATOMIC_RELAXED);
+  edge_map_hit (ht, CFG, new);
+  if (fresh && type != CALL && type != RET)
+    {
+      bool ok = cfg_add_new_successor (ht, CFG, new, type);
+      pthread_mutex_unlock (cfg_lock (ht, CFG));
+      return ok ? new : NULL;
+    }
+
+  /* Checking if new is already a successor of old */
+  edge_t *edge = fresh ? NULL : cfg_find_successor (CFG, new);
+  if (edge)
+    edge_hit (edge, 1);
+  pthread_mutex_unlock (cfg_lock (ht, CFG));
+  if (edge)
+    return new;
+  return aux_cfg_insert(ht, CFG, new, stack);
+}
+
+cfg_t *
+cfg_link_return (hashtable_t *ht, cfg_t *CFG, cfg_t *new)
+{
+  if (!CFG || !new)
+    return NULL;
+
+  /* The same edge as the return of the callee would make */
+  bool ok = true;
+  edge_map_hit (ht, CFG, new);
+  pthread_mutex_lock (cfg_lock (ht, CFG));
+  edge_t *edge = cfg_find_successor (CFG, new);
+  if (edge)
+    edge_hit (edge, 1);
+  else
+    ok = cfg_add_successor (ht, CFG, new, 1);
+  pthread_mutex_unlock (cfg_lock (ht, CFG));
+  return ok ? new : NULL;
 }
 
 instr_t *
@@ -659,7 +1276,7 @@ cfg_get_nb_out (cfg_t *CFG)
 uint16_t
 cfg_get_nb_in (cfg_t *CFG)
 {
-  return CFG->nb_in;
+  return __atomic_load_n (&(CFG->nb_in), __ATOMIC_RELAXED);
 }
 
 instr_type_t
@@ -671,23 +1288,65 @@ cfg_get_type (cfg_t *CFG)
 uint16_t
 cfg_get_name (cfg_t *CFG)
 {
-  return CFG->name;
+  return __atomic_load_n (&(CFG->name), __ATOMIC_RELAXED);
 }
 
-cfg_t **
-cfg_get_successor (cfg_t *CFG)
+cfg_t *
+cfg_get_successor_i (cfg_t *CFG, uint16_t i)
 {
-  return CFG->successor;
+  /* The chunk holding CFG knows the hashtable the ids refer to */
+  node_chunk_t *chunk =
+    (node_chunk_t *) ((uintptr_t) CFG & ~((uintptr_t) NODE_CHUNK_SIZE - 1));
+  return hashtable_get_node (chunk->ht, cfg_successors (CFG)[i].id);
 }
 
-cfg_t *
-cfg_get_successor_i (cfg_t *CFG, uint16_t i)
+uint32_t
+cfg_get_hits_i (cfg_t *CFG, uint16_t i)
 {
-  return CFG->successor[i];
+  return cfg_successors (CFG)[i].hits;
+}
+
+uint64_t
+cfg_get_hits (cfg_t *CFG)
+{
+  return __atomic_load_n (&(CFG->hits), __ATOMIC_RELAXED);
+}
+
+void
+cfg_hit (cfg_t *CFG)
+{
+  __atomic_fetch_add (&(CFG->hits), 1, __ATOMIC_RELAXED);
+}
+
+void
+cfg_set_name (cfg_t *CFG, uint16_t name)
+{
+  __atomic_store_n (&(CFG->name), name, __ATOMIC_RELAXED);
+}
+
+bool
+cfg_add_edge (hashtable_t *ht, cfg_t *CFG, cfg_t *new, uint32_t hits)
+{
+  if (!ht || !CFG || !new)
+    {
+      errno = EINVAL;
+      return false;
+    }
+
+  bool ok = true;
+  edge_map_hit (ht, CFG, new);
+  pthread_mutex_lock (cfg_lock (ht, CFG));
+  edge_t *edge = cfg_find_successor (CFG, new);
+  if (edge)
+    edge_hit (edge, hits);
+  else
+    ok = cfg_add_successor (ht, CFG, new, hits);
+  pthread_mutex_unlock (cfg_lock (ht, CFG));
+  return ok;
 }
 
-char *
-cfg_get_str (cfg_t *CFG)
+uint32_t
+cfg_get_id (cfg_t *CFG)
 {
-  return CFG->str_graph;
+  return CFG->id;
 }
@@ -10,11 +10,18 @@
  * This software is released under a 3-clause BSD license (see COPYING file).
  */
 
-#include "tracker.h"
-#include <graphviz/cgraph.h>
-
 #define _POSIX_C_SOURCE 200809L
 
+#include "backend.h"
+#include "block.h"
+#include "cfgdb.h"
+#include "export.h"
+#include "image.h"
+#include "predecode.h"
+#include "profile.h"
+#include "tlog.h"
+#include "tracker.h"
+
 #include <inttypes.h>
 
 #include <stdbool.h>
@@ -22,10 +29,14 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <elf.h>
 #include <err.h>
+#include <errno.h>
 #include <getopt.h>
 #include <libgen.h>
+#include <pthread.h>
 #include <string.h>
+#include <time.h>
 
 #include <sys/personality.h>
 #include <sys/ptrace.h>
@@ -38,67 +49,69 @@
 
 #include <trace.h>
 
-/* Platform architecture arch_t type */
-typedef enum
-  {
-   unknown_arch,
-   x86_32_arch,
-   x86_64_arch
-} arch_t;
+/* Number of mutated inputs run by default (fuzz) */
+#define FUZZ_DEFAULT_RUNS 1000
 
-/* In amd64, maximum bytes for an opcode is 15 */
-#define MAX_OPCODE_BYTES 16
+/* Runs of mutated inputs are given up after that many instructions */
+#define FUZZ_MAX_COUNT 1000000
 
-/* Maximum length of a line in input */
-#define MAX_LEN 1024
+/* Snapshot point of the runs of mutated inputs, unless -f is given */
+#define FUZZ_SNAPSHOT "main"
 
 /* Global variables for this module */
 static bool debug = false;      /* 'debug' option flag */
 static bool verbose = false;    /* 'verbose' option flag */
 static FILE *output = NULL;     /* output file (default: stdout) */
+static bool listing = false;    /* list the instructions in output */
+static tlog_t *tlog = NULL;     /* binary trace log (if any) */
+static bool intel = false;      /* 'intel' option flag */
+static bool block = false;      /* 'block' option flag */
+static bool ahead = false;      /* 'ahead' option flag */
+static bool pipeline = false;   /* 'pipeline' option flag */
+/* snapshot point of the fork server (-f), NULL to execve() each run */
+static const char *snapshot = NULL;
+/* ranges of addresses traced (-r) or not (-x) */
+static filter_t filter = { 0 };
+static const char *program_name = NULL;
+/* backend tracing the runs, falls back to ptrace if unavailable */
+static const backend_t *backend = &ptrace_backend;
+static pthread_mutex_t backend_lock = PTHREAD_MUTEX_INITIALIZER;
 /* input file containing executable's name and argument */
 static FILE *input = NULL;
 
-static FILE *fp = NULL;
-
-/* Get the architecture of the executable */
+/* counters of the runs written as JSON (-s), NULL if they are not */
+static FILE *stats_file = NULL;
+/* counters of all the runs, and their number of instructions */
+static stats_t session = { 0 };
+static size_t session_count = 0;
+/* file the cfg is exported to (-g), NULL if it is not */
+static FILE *graph = NULL;
+static const char *graph_path = NULL;
+/* number of blocks, functions and edges in the profile (-p), 0 if none */
+static size_t profile = 0;
+/* paths of the runs, to fast-forward the runs along them (-u), or NULL */
+static paths_t *paths = NULL;
+
+/* Get the architecture of the executable, and its image */
 static arch_t
-check_execfile (char *execfilename)
+check_execfile (char *execfilename, const image_t **image)
 {
-  struct stat exec_stats;
-  if (stat (execfilename, &exec_stats) == -1)
-    err (EXIT_FAILURE, "error: '%s'", execfilename);
-
-  if (!S_ISREG (exec_stats.st_mode) || !(exec_stats.st_mode & S_IXUSR))
+  const image_t *img = image_get (execfilename);
+  if (!img && errno == EACCES)
     errx (EXIT_FAILURE, "error: '%s' is not an executable file", execfilename);
-
-  /* Check if given file is an executable and discover its architecture */
-  FILE *execfile = fopen (execfilename, "r");
-  if (!execfile)
-    err (EXIT_FAILURE, "error: '%s'", execfilename);
-
-  /* Open file */
-  char buf[4] = { 0 };
-  if (fread (&buf, 4, 1, execfile) != 1)
-    errx (EXIT_FAILURE, "error: cannot read '%s'", execfilename);
-
-  /* Check ELF magic number (first 4 bytes: 0x7f "ELF") */
-  if (buf[0] != 0x7F || strncmp (&(buf[1]), "ELF", 3))
+  if (!img && errno == ENOEXEC)
     errx (EXIT_FAILURE, "error: '%s' is not an ELF binary", execfilename);
-
-  /* Extract executable architecture (byte at 0x12) */
-  fseek (execfile, 0x12, SEEK_SET);
-  if (fread (&buf, 1, 1, execfile) != 1)
-    errx (EXIT_FAILURE, "error: cannot read '%s'", execfilename);
+  if (!img)
+    err (EXIT_FAILURE, "error: '%s'", execfilename);
 
   arch_t exec_arch = unknown_arch;
-  switch (buf[0])
+  switch (img->machine)
     {
-    case 0x03:
+    case EM_386:
       exec_arch = x86_32_arch;
       break;
 
-    case 0x3E:
+    case EM_X86_64:
       exec_arch = x86_64_arch;
       break;
 
@@ -106,250 +119,1256 @@ check_execfile (char *execfilename)
       errx (EXIT_FAILURE, "error: '%s' unsupported architecture", execfilename);
     }
 
-  /* Closing file after verifications */
-  fclose (execfile);
-
+  *image = img;
   return exec_arch;
 }
 
-/* Get current instruction pointer address */
-static uintptr_t
-get_current_ip (struct user_regs_struct *regs)
+/* Maximum length of a line of the listing of an instruction */
+#define MAX_INSN_TEXT 512
+
+/* Slot of the decode cache for address ip */
+#define DECODE_INDEX(ip) (((ip) ^ ((ip) >> 16)) & (DECODE_CACHE_SIZE - 1))
+
+/* Get the epoch a decoded instruction at ip stays valid in: code in a
+ * writable mapping, or out of the known ones, is checked at each use */
+static uint32_t
+decode_epoch (tracer_t *tracer, const uintptr_t ip)
 {
-#if defined(__x86_64__) /* amd64 architecture */
-      return regs->rip;
-#elif defined(__i386__) /* i386 architecture */
-      return regs->eip;
-#else
-#error Cannot build, we only support: x86-64 and i386 architectures
-#endif
+  const region_t *region = mem_find (tracer->mem, ip);
+  if (!region || region->writable)
+    return 0;
+  return tracer->epoch;
 }
 
+/* Free the text of a cache entry and mark it empty */
 static void
-get_text_info (const char *execfilename, uint64_t *text_addr, uint64_t *text_size)
-{
-  FILE *execfile = fopen (execfilename, "r");
-  unsigned char buf[8];
-  fseek (execfile, 0x28, SEEK_SET);
-  fread (&buf, 8, 1, execfile);
-  uint64_t e_shoff = 0;
-  for (int i = 7; i >= 0; i--) {
-    e_shoff = e_shoff << 8;
-    e_shoff += buf[i];
-  }
-  fseek (execfile, 0x3A, SEEK_SET);
-  fread (&buf, 2, 1, execfile);
-  uint64_t e_shentsize = 0;
-  for (int i = 1; i >= 0; i--) {
-    e_shentsize = e_shentsize << 8;
-    e_shentsize += buf[i];
-  }
-  fseek (execfile, 0x3C, SEEK_SET);
-  fread (&buf, 2, 1, execfile);
-  uint64_t e_shnum = 0;
-  for (int i = 1; i >= 0; i--) {
-    e_shnum = e_shnum << 8;
-    e_shnum += buf[i];
-  }
-  fseek (execfile, 0x3E, SEEK_SET);
-  fread (&buf, 2, 1, execfile);
-  uint64_t e_shstrndx = 0;
-  for (int i = 1; i >= 0; i--) {
-    e_shstrndx = e_shstrndx << 8;
-    e_shstrndx += buf[i];
-  }
-  fseek (execfile, e_shoff + (e_shentsize * e_shstrndx) + 0x18, SEEK_SET);
-  fread (&buf, 8, 1, execfile);
-  uint64_t shstrtab = 0;
-  for (int i = 7; i >= 0; i--) {
-    shstrtab = shstrtab << 8;
-    shstrtab += buf[i];
-  }
-  uint64_t index = 0;
-  while (true) {
-    uint64_t var = 0;
-    fseek (execfile, e_shoff + (e_shentsize * index), SEEK_SET);
-    fread (&buf, 4, 1, execfile);
-    for (int i = 3; i >= 0; i--) {
-      var = var << 8;
-      var += buf[i];
-    }
-    fseek (execfile, shstrtab + var, SEEK_SET);
-    fread (&buf, 5, 1, execfile);
-    if (buf[0] == '.' && buf[1] == 't' && buf[2] == 'e' && buf[3] == 'x' && buf[4] == 't')
-      break;
-    index++;
-  }
-  fseek (execfile, e_shoff + (e_shentsize * index) + 0x18, SEEK_SET);
-  fread (&buf, 8, 1, execfile);
-  *text_addr = 0;
-  for (int i = 7; i >= 0; i--) {
-    *text_addr = *text_addr << 8;
-    *text_addr += buf[i];
-  }
-  fseek (execfile, e_shoff + (e_shentsize * index) + 0x20, SEEK_SET);
-  fread (&buf, 8, 1, execfile);
-  *text_size = 0;
-  for (int i = 7; i >= 0; i--) {
-    *text_size = *text_size << 8;
-    *text_size += buf[i];
-  }
-  fclose (execfile);
-  return;
-}
-
-static char *
-concat_str (char *dest, char *follow)
-{
-	if (!dest)
-	{
-		dest = calloc ((strlen (follow) + 1), sizeof (char));
-		sprintf (dest, "%s", follow);
-		return dest;
-	}
-	dest = realloc (dest,
-                  (strlen (dest) + 1 + strlen (follow) + 1) * sizeof (char));
-	sprintf (dest + strlen(dest), "\n%s", follow);
-	return dest;
-}
-
-static Agraph_t *
-graph_create_function (Agraph_t *g, cfg_t *entry, Agnode_t *n)
-{
-  Agnode_t *m = NULL;
-  cfg_t *old = entry;
-	cfg_t *new = NULL;
-  char *str_bb = NULL;
-  while (cfg_get_type (old) == BASIC || cfg_get_type (old) == CALL)
-    {
-      /* Not the begining of the function + more than 1 parent --> basic block */
-      if (old != entry && cfg_get_nb_in (old) > 1)
+decode_clear (decoded_t *insn)
+{
+  free (insn->line);
+  *insn = (decoded_t) { 0 };
+}
+
+/* Set the line of the listing of the instruction at ip in insn */
+static void
+decode_line (decoded_t *insn, const uintptr_t ip, const byte_t *buf,
+             size_t size, const char *mnemonic, const char *op_str)
+{
+  char line[MAX_INSN_TEXT];
+  int len = tlog_format (line, MAX_INSN_TEXT, ip, buf, size, mnemonic, op_str);
+  insn->line = strndup (line, len);
+  if (!insn->line)
+    err (EXIT_FAILURE, "error: cannot decode instruction");
+  insn->line_len = len;
+}
+
+/* Get the instruction at ip, whose opcodes are buf, from the decode cache
+ * if they did not change, or else decode it in its entry (the epoch of
+ * which is left to the caller). Returns NULL if it cannot be decoded */
+static decoded_t *
+decode_opcodes (tracer_t *tracer, const uintptr_t ip, const byte_t *buf)
+{
+  decoded_t *insn = &(tracer->cache[DECODE_INDEX (ip)]);
+  if (insn->ip == ip && !memcmp (buf, insn->opcodes, insn->size))
+    {
+      tracer->stats.decode_hits++;
+      return insn;
+    }
+  decode_clear (insn);
+  tracer->stats.decode_misses++;
+
+  /* Decoded ahead (-a), if the child runs .text as it is in the file */
+  uint64_t start = stats_ticks ();
+  const uintptr_t addr = ip - tracer->text_bias;
+  const ahead_t *ahead = predecode_find (tracer->predecoded, addr);
+  if (ahead && predecode_match (tracer->predecoded, addr, ahead, buf))
+    {
+      if (listing)
         {
-          m = agnode (g, str_bb, TRUE);
-          free(str_bb);
-          str_bb = NULL;
-          if (n)
-            if (!agedge (g, n, m, NULL, FALSE))
-              agedge (g, n, m, NULL, TRUE);
-          graph_create_function (g, old, m);
-          return g;
+          const char *mnemonic = predecode_mnemonic (tracer->predecoded,
+                                                     addr, ahead);
+          decode_line (insn, ip, buf, ahead->size, mnemonic,
+                       mnemonic + strlen (mnemonic) + 1);
         }
-      if (cfg_get_type (old) == CALL)
+      stats_add (&(tracer->stats), PHASE_DECODE, start);
+      tracer->stats.decode_ahead++;
+      insn->size = ahead->size;
+      insn->type = ahead->type;
+    }
+  else
+    {
+      /* Get the mnemonic from decoder */
+      cs_insn *cs;
+      size_t count = cs_disasm (tracer->handle, buf, MAX_OPCODE_BYTES, 0x1000,
+                                1, &cs);
+      if (count == 0)
         {
-          /* Searching for a RET following the CALL */
-          uint16_t i = 0;
-          while (i < cfg_get_nb_out (old))
-            {
-              new = cfg_get_successor_i (old, i);
-              if (instr_get_addr (cfg_get_instr (old)) + instr_get_size (cfg_get_instr (old))
-        		      == instr_get_addr (cfg_get_instr (new)))
-                break;
-              new = NULL;
-              i++;
-            }
-          str_bb = concat_str (str_bb, cfg_get_str(old));
-          if (!new)
-            {
-              m = agnode (g, str_bb, TRUE);
-              free(str_bb);
-              str_bb = NULL;
-              if (n)
-								if (!agedge (g, n, m, NULL, FALSE))
-                  agedge (g, n, m, NULL, TRUE);
-              return g;
-            }
-          else
-            {
-              old = new;
-              new = NULL;
-            }
+          stats_add (&(tracer->stats), PHASE_DECODE, start);
+          return NULL;
         }
-      else
+
+      size_t size = cs[0].size;
+      if (listing)
+        decode_line (insn, ip, buf, size, cs[0].mnemonic, cs[0].op_str);
+      cs_free (cs, count);
+      stats_add (&(tracer->stats), PHASE_DECODE, start);
+      insn->size = size;
+      insn->type = instr_classify (size, buf);
+    }
+
+  insn->ip = ip;
+  memcpy (insn->opcodes, buf, MAX_OPCODE_BYTES);
+  return insn;
+}
+
+decoded_t *
+tracer_decode (tracer_t *tracer, const uintptr_t ip)
+{
+  decoded_t *insn = &(tracer->cache[DECODE_INDEX (ip)]);
+  if (insn->ip == ip && insn->epoch && insn->epoch == tracer->epoch)
+    {
+      tracer->stats.decode_hits++;
+      return insn;
+    }
+
+  /* The code may have changed since it was decoded */
+  byte_t buf[MAX_OPCODE_BYTES];
+  fetch_opcodes (tracer, ip, buf);
+  insn = decode_opcodes (tracer, ip, buf);
+  if (insn)
+    insn->epoch = decode_epoch (tracer, ip);
+  return insn;
+}
+
+/* Log and insert in the cfg insn, the instruction decoded at address ip (or
+ * NULL if it cannot be). Returns insn */
+static const decoded_t *
+tracer_record (tracer_t *tracer, const uintptr_t ip, decoded_t *insn)
+{
+  /* Edge from the previous instruction, in the coverage of the run. It is
+   * the one the cfg counts in its edge map */
+  if (tracer->coverage)
+    {
+      uint8_t *hits = &(tracer->coverage[EDGE_INDEX (tracer->last_ip, ip)]);
+      if (tracer->last_ip && *hits < UINT8_MAX)
+        (*hits)++;
+      tracer->last_ip = ip;
+    }
+  if (tracer->probe)
+    {
+      tracer->instr_count += (insn != NULL);
+      return insn;
+    }
+
+  if (!insn)
+    {
+      /* Listed as tracker-dump renders it: with no opcodes, as (bad) */
+      if (listing)
+        {
+          uint64_t start = stats_ticks ();
+          char line[MAX_INSN_TEXT];
+          int len = tlog_format (line, MAX_INSN_TEXT, ip, NULL, 0, "(bad)",
+                                 "");
+          fwrite (line, 1, len, tracer->output);
+          stats_add (&(tracer->stats), PHASE_LISTING, start);
+        }
+      if (tracer->tlog)
+        tlog_step (tracer->tlog, tlog_define (tracer->tlog, ip, 0,
+                                              (const uint8_t *) ""));
+      return NULL;
+    }
+
+  /* Display address, bytes, mnemonic and operand */
+  if (listing)
+    {
+      uint64_t start = stats_ticks ();
+      fwrite (insn->line, 1, insn->line_len, tracer->output);
+      stats_add (&(tracer->stats), PHASE_LISTING, start);
+    }
+
+  /* The binary log refers to the instructions it defined */
+  if (tracer->tlog)
+    {
+      if (!insn->log_id)
+        insn->log_id = tlog_define (tracer->tlog, ip, insn->size,
+                                    insn->opcodes);
+      tlog_step (tracer->tlog, insn->log_id);
+    }
+
+  uint64_t start = stats_ticks ();
+  if (insn->node)
+    tracer->stats.node_hits++;
+  else
+    tracer->stats.node_lookups++;
+
+  if (!tracer->cfg)
+    {
+      /* Starting or restarting after a hole, the node is not linked to
+       * anything but the call it returns to, if the callee was skipped (it
+       * may call back traced code before) */
+      cfg_t *node = insn->node;
+      if (!node)
+        {
+          instr_t *instr = instr_new (ip, insn->size, insn->opcodes);
+          if (!instr)
+            err (EXIT_FAILURE, "error: cannot create instruction");
+          node = cfg_new (tracer->ht, instr);
+        }
+      instr_t *call = tracer->call ? cfg_get_instr (tracer->call) : NULL;
+      if (node && call
+          && ip == instr_get_addr (call) + instr_get_size (call))
+        {
+          node = cfg_link_return (tracer->ht, tracer->call, node);
+          tracer->call = NULL;
+        }
+      tracer->cfg = node;
+    }
+  else if (insn->node)
+    {
+      /* Already in the cfg, only the edge may be new */
+      tracer->cfg = cfg_link (tracer->ht, tracer->cfg, insn->node,
+                              tracer->stack);
+    }
+  else
+    {
+      /* Create the instr_t structure */
+      instr_t *instr = instr_new (ip, insn->size, insn->opcodes);
+      if (!instr)
+        err (EXIT_FAILURE, "error: cannot create instruction");
+
+      /* Insert a new element in the cfg and update cfg to hold
+       * the new node */
+      tracer->cfg = cfg_insert (tracer->ht, tracer->cfg, instr,
+                                tracer->stack);
+    }
+  if (!tracer->cfg)
+    err (EXIT_FAILURE, "error: cannot create a control flow graph");
+  stats_add (&(tracer->stats), PHASE_CFG, start);
+
+  insn->node = tracer->cfg;
+
+  /* Updating counters */
+  cfg_hit (tracer->cfg);
+  tracer->instr_count++;
+
+  /* The path of the run, once it is the one of a previous run of the same
+   * command line (as far as it went) the rest of it is taken as known */
+  uint32_t id = cfg_get_id (tracer->cfg);
+  tracer->stats.path = trace_hash (tracer->stats.path, id);
+  if (tracer->trace)
+    {
+      if (!trace_append (tracer->trace, id))
+        err (EXIT_FAILURE, "error: cannot record the path of the run");
+      if (!tracer->ahead.trace
+          && paths_checkpoint (trace_get_size (tracer->trace)))
+        paths_find (tracer->paths, tracer->trace, tracer->stats.path,
+                    tracer->command, &(tracer->ahead));
+    }
+  return insn;
+}
+
+const decoded_t *
+tracer_step (tracer_t *tracer, const uintptr_t ip)
+{
+  return tracer_record (tracer, ip, tracer_decode (tracer, ip));
+}
+
+const decoded_t *
+tracer_step_opcodes (tracer_t *tracer, const uintptr_t ip,
+                     const byte_t *opcodes)
+{
+  /* Opcodes read already are the ones run, whatever the epoch */
+  decoded_t *insn = decode_opcodes (tracer, ip, opcodes);
+  if (insn && insn->epoch != tracer->epoch)
+    insn->epoch = decode_epoch (tracer, ip);
+  return tracer_record (tracer, ip, insn);
+}
+
+/* Drop the path of the run of tracer, it is not the one of its trace */
+static void
+tracer_drop_path (tracer_t *tracer)
+{
+  trace_delete (tracer->trace);
+  tracer->trace = NULL;
+  tracer->ahead.trace = NULL;
+}
+
+/* Insert in the cfg the rest of the known path the run of tracer was
+ * given up along, as if it was traced up to its end. Returns false if the
+ * run left the path before */
+static bool
+tracer_forward (tracer_t *tracer)
+{
+  const uint32_t *ids = trace_get_ids (tracer->ahead.trace);
+  size_t size = trace_get_size (tracer->ahead.trace);
+  size_t from = trace_get_size (tracer->trace);
+  if (from >= size || trace_compare (tracer->trace, tracer->ahead.trace) < from)
+    return false;
+
+  uint64_t start = stats_ticks ();
+  for (size_t i = from; i < size; i++)
+    {
+      cfg_t *node = hashtable_get_node (tracer->ht, ids[i]);
+      tracer->cfg = cfg_link (tracer->ht, tracer->cfg, node, tracer->stack);
+      if (!tracer->cfg)
+        err (EXIT_FAILURE, "error: cannot create a control flow graph");
+      cfg_hit (node);
+    }
+  stats_add (&(tracer->stats), PHASE_CFG, start);
+
+  tracer->instr_count += size - from;
+  tracer->stats.forwarded = size - from;
+  tracer->stats.path = tracer->ahead.hash;
+  tracer->stats.known_paths = 1;
+  if (!tracer->probe)
+    fprintf (tracer->output, "%s: fast-forwarded %zu instructions along a "
+             "known path\n", program_name, size - from);
+  return true;
+}
+
+void
+tracer_resync (tracer_t *tracer)
+{
+  tracer_drop_path (tracer);
+  tracer->cfg = NULL;
+  tracer->call = NULL;
+  tracer->last_ip = 0;
+}
+
+bool
+tracer_traced (tracer_t *tracer, const uintptr_t ip)
+{
+  if (!tracer->filter)
+    return true;
+
+  /* Libraries are mapped as the child runs, the mapping may be new */
+  const region_t *region = mem_find (tracer->mem, ip);
+  if (!region && tracer->mem)
+    {
+      tracer_invalidate (tracer);
+      region = mem_find (tracer->mem, ip);
+    }
+  return filter_match (tracer->filter, ip, region ? region->path : NULL,
+                       tracer->text_start, tracer->text_end);
+}
+
+void
+tracer_skip (tracer_t *tracer)
+{
+  tracer_drop_path (tracer);
+  if (tracer->cfg && cfg_get_type (tracer->cfg) == CALL)
+    tracer->call = tracer->cfg;
+  tracer->cfg = NULL;
+}
+
+/* Start a new epoch: every cached instruction is checked against memory
+ * before being reused */
+static void
+tracer_new_epoch (tracer_t *tracer)
+{
+  /* Epoch 0 is never current, reset the entries before wrapping to it */
+  if (++tracer->epoch == 0)
+    {
+      for (size_t i = 0; i < DECODE_CACHE_SIZE; i++)
+        tracer->cache[i].epoch = 0;
+      tracer->epoch = 1;
+    }
+}
+
+void
+tracer_invalidate (tracer_t *tracer)
+{
+  tracer_new_epoch (tracer);
+  if (tracer->mem && !mem_update (tracer->mem))
+    {
+      warn ("warning: cannot read the mappings of the child");
+      mem_delete (tracer->mem);
+      tracer->mem = NULL;
+    }
+}
+
+/* Get the id of the process of thread pid, from /proc. Returns -1 otherwise */
+static pid_t
+get_process (pid_t pid)
+{
+  char path[64], line[256];
+  snprintf (path, sizeof (path), "/proc/%d/status", (int) pid);
+  FILE *status = fopen (path, "re");
+  if (!status)
+    return -1;
+
+  pid_t tgid = -1;
+  while (tgid == -1 && fgets (line, sizeof (line), status))
+    if (!strncmp (line, "Tgid:", 5))
+      tgid = strtol (line + 5, NULL, 10);
+  fclose (status);
+  return tgid;
+}
+
+/* Store the fields of the current thread of tracer in it */
+static void
+tracer_save (tracer_t *tracer)
+{
+  thread_t *t = &(tracer->threads[tracer->current]);
+  t->cfg = tracer->cfg;
+  t->call = tracer->call;
+  t->stack = tracer->stack;
+  t->last_ip = tracer->last_ip;
+  tracer->processes[t->process].mem = tracer->mem;
+}
+
+bool
+tracer_attach (tracer_t *tracer, pid_t pid)
+{
+  for (size_t i = 0; i < tracer->nb_threads; i++)
+    if (tracer->threads[i].pid == pid)
+      return true;
+
+  /* The instructions captured before are recorded in the current thread */
+  if (tracer->ring)
+    ring_drain (tracer->ring);
+
+  /* The child gets the call stack and the mappings of tracer */
+  bool first = (tracer->nb_threads == 0);
+  pid_t process = first ? pid : get_process (pid);
+  if (process == -1)
+    return false;
+
+  if (tracer->nb_threads == tracer->max_threads)
+    {
+      size_t max = tracer->max_threads ? 2 * tracer->max_threads : 16;
+      thread_t *threads = realloc (tracer->threads, max * sizeof (thread_t));
+      if (!threads)
+        return false;
+      tracer->threads = threads;
+      tracer->max_threads = max;
+    }
+  if (tracer->nb_processes == tracer->max_processes)
+    {
+      size_t max = tracer->max_processes ? 2 * tracer->max_processes : 16;
+      process_t *processes = realloc (tracer->processes,
+                                      max * sizeof (process_t));
+      if (!processes)
+        return false;
+      tracer->processes = processes;
+      tracer->max_processes = max;
+    }
+
+  size_t p = 0;
+  while (p < tracer->nb_processes && tracer->processes[p].pid != process)
+    p++;
+  if (p == tracer->nb_processes)
+    {
+      mem_t *mem = first ? tracer->mem : mem_new (process);
+      if (!mem && !first)
+        warn ("warning: cannot read the mappings of process %d",
+              (int) process);
+      tracer->processes[tracer->nb_processes++] = (process_t) { process, mem };
+    }
+
+  callstack_t *stack = first ? tracer->stack : stack_new ();
+  if (!stack)
+    return false;
+  tracer->threads[tracer->nb_threads++] = (thread_t) {
+    pid, p, NULL, NULL, stack, 0, first };
+  tracer->nb_alive++;
+  tracer->stats.threads++;
+
+  /* The threads interleave as they please, the run has no path anymore */
+  if (!first)
+    tracer_drop_path (tracer);
+  return true;
+}
+
+bool
+tracer_switch (tracer_t *tracer, pid_t pid)
+{
+  size_t i = 0;
+  while (i < tracer->nb_threads && tracer->threads[i].pid != pid)
+    i++;
+  if (i == tracer->nb_threads)
+    return false;
+  if (i == tracer->current)
+    return true;
+
+  if (tracer->threads[tracer->current].pid)
+    tracer_save (tracer);
+  const thread_t *t = &(tracer->threads[i]);
+  tracer->child = pid;
+  tracer->cfg = t->cfg;
+  tracer->call = t->call;
+  tracer->stack = t->stack;
+  tracer->last_ip = t->last_ip;
+
+  /* Another process may have other code at the same addresses */
+  mem_t *mem = tracer->processes[t->process].mem;
+  if (mem != tracer->mem)
+    tracer_new_epoch (tracer);
+  tracer->mem = mem;
+  tracer->current = i;
+  return true;
+}
+
+void
+tracer_detach (tracer_t *tracer)
+{
+  if (tracer->ring)
+    ring_drain (tracer->ring);
+  tracer_save (tracer);
+  tracer->threads[tracer->current].pid = 0;
+  tracer->nb_alive--;
+}
+
+/* Forget the threads of the run of tracer, it gets back the call stack and
+ * the mappings of the child */
+static void
+tracer_detach_all (tracer_t *tracer)
+{
+  if (!tracer->nb_threads)
+    return;
+  if (tracer->threads[tracer->current].pid)
+    tracer_save (tracer);
+
+  tracer->child = tracer->processes[0].pid;
+  tracer->cfg = tracer->threads[0].cfg;
+  tracer->call = tracer->threads[0].call;
+  tracer->stack = tracer->threads[0].stack;
+  tracer->last_ip = tracer->threads[0].last_ip;
+  tracer->mem = tracer->processes[0].mem;
+  for (size_t i = 1; i < tracer->nb_threads; i++)
+    stack_delete (tracer->threads[i].stack);
+  for (size_t i = 1; i < tracer->nb_processes; i++)
+    mem_delete (tracer->processes[i].mem);
+  tracer->nb_threads = tracer->nb_alive = tracer->current = 0;
+  tracer->nb_processes = 0;
+}
+
+/* Split the command line str in exec_argv (of strlen (str) + 1 entries at
+ * least), returns the number of arguments */
+static int
+split_command (char *str, char *exec_argv[])
+{
+  char *saveptr;
+  char *token = strtok_r (str, " ", &saveptr);
+  int index = 0;
+  while (token != NULL)
+    {
+      size_t token_length = strlen (token);
+      if (token[token_length - 1] == '\n')
+        token[token_length - 1] = '\0'; /* Formatting trick */
+      exec_argv[index] = token;
+      index++;
+      token = strtok_r (NULL, " ", &saveptr);
+    }
+  exec_argv[index] = NULL;
+  return index;
+}
+
+/* Start exec_argv in a new traced child reading input_fd (unless -1),
+ * returns it stopped right after its execve() */
+static pid_t
+spawn (char *exec_argv[], char *envp[], int input_fd)
+{
+  /* Forking and tracing */
+  pid_t child = fork ();
+  if (child == -1)
+    errx (EXIT_FAILURE, "error: fork failed!");
+
+  /* Initialized and start the child */
+  if (child == 0)
+    {
+      /* Disabling ASLR */
+      personality (ADDR_NO_RANDOMIZE);
+
+      /* Standard input of the run */
+      if (input_fd != -1 && input_fd != STDIN_FILENO)
         {
-          str_bb = concat_str (str_bb, cfg_get_str(old));
-          if (cfg_get_nb_out (old) == 0)
-            {
-              m = agnode (g, str_bb, TRUE);
-              free(str_bb);
-              str_bb = NULL;
-              if (!agedge (g, n, m, NULL, FALSE))
-                agedge (g, n, m, NULL, TRUE);
-              return g;
-            }
-          old = cfg_get_successor_i (old, 0);
-          /* Ugly trick to avoid infite loops if a instruction is its own parent */
-          if (old == entry)
-            {
-              m = agnode (g, str_bb, TRUE);
-              free(str_bb);
-              str_bb = NULL;
-              if (!agedge (g, n, m, NULL, FALSE))
-                agedge (g, n, m, NULL, TRUE);
-              Agnode_t *tmp = agnode (g, cfg_get_str (old), TRUE);
-              agedge (g, m, tmp, NULL, TRUE);
-              agedge (g, tmp, tmp, NULL, TRUE);
-              return g;
-            }
+          dup2 (input_fd, STDIN_FILENO);
+          close (input_fd);
         }
+
+      /* Start tracing the process */
+      if (ptrace (PTRACE_TRACEME, 0, NULL, NULL) == -1)
+        errx (EXIT_FAILURE,
+              "error: cannot operate from inside a ptrace() call!");
+
+      /* Starting the traced executable */
+      execve (exec_argv[0], exec_argv, envp);
     }
-  /* Enf of a basic block */
-  str_bb = concat_str (str_bb, cfg_get_str(old));
-  m = agnode (g, str_bb, TRUE);
-  free(str_bb);
-  str_bb = NULL;
-  if (n)
+
+  /* Parent process */
+  int status;
+  waitpid (child, &status, 0);
+  if (WIFEXITED (status) || WIFSIGNALED (status))
+    errx (EXIT_FAILURE, "error: cannot trace '%s'", exec_argv[0]);
+  return child;
+}
+
+/* Trace a run of exec_argv in a new child, in the cfg of tracer. Returns
+ * the mode it was decoded in */
+static cs_mode
+trace_command (tracer_t *tracer, int exec_argc, char *exec_argv[],
+               char *envp[])
+{
+  stats_start (&(tracer->stats));
+  tracer->command[0] = '\0';
+  for (int i = 0, len = 0; i < exec_argc && len < MAX_LEN; i++)
+    len += snprintf (tracer->command + len, MAX_LEN - len, "%s%s",
+                     i ? " " : "", exec_argv[i]);
+
+  /* Perfom various checks on the executable file */
+  const image_t *img;
+  arch_t exec_arch = check_execfile (exec_argv[0], &img);
+
+  /* Display the traced command */
+  if (!tracer->probe)
+    {
+      fprintf (tracer->output, "%s: starting to trace '", program_name);
+      for (int i = 0; i < exec_argc - 1; i++)
+        fprintf (tracer->output, "%s ", exec_argv[i]);
+      fprintf (tracer->output, "%s'\n\n", exec_argv[exec_argc - 1]);
+    }
+
+  /* Start the run from the fork server of the executable */
+  pid_t child;
+  forksrv_t *srv = NULL;
+  const char *where = (tracer->probe && !snapshot) ? FUZZ_SNAPSHOT : snapshot;
+  if (where && (exec_arch == x86_64_arch) == FORKSRV_WIDE)
     {
-      if (!agedge (g, n, m, NULL, FALSE))
+      srv = &(tracer->server);
+      if (!srv->pid || strcmp (srv->exec, exec_argv[0]))
         {
-          agedge (g, n, m, NULL, TRUE);
-          if (cfg_get_type (old) == BRANCH || cfg_get_type (old) == JUMP)
-            {
-              for (uint16_t i = 0; i < cfg_get_nb_out (old); i++)
-                graph_create_function (g, cfg_get_successor_i (old, i), m);
-            }
+          pid_t server = spawn (exec_argv, envp, tracer->input_fd);
+          if (!forksrv_start (srv, server, exec_argv[0], where))
+            err (EXIT_FAILURE, "error: cannot stop '%s' at '%s'",
+                 exec_argv[0], where);
         }
+      child = forksrv_fork (srv, exec_argc, exec_argv);
+      if (child == -1)
+        err (EXIT_FAILURE, "error: cannot fork '%s' from its snapshot",
+             exec_argv[0]);
+    }
+  else
+    {
+      if (where && !tracer->probe)
+        warnx ("warning: no fork server for '%s' (not of the architecture "
+               "of tracker)", exec_argv[0]);
+      child = spawn (exec_argv, envp, tracer->input_fd);
+    }
+
+  /* Initializing Capstone disassembler */
+  csh handle;
+
+  cs_mode exec_mode = 0;
+  switch (exec_arch)
+    {
+    case x86_32_arch:
+      exec_mode = CS_MODE_32;
+      break;
+
+    case x86_64_arch:
+      exec_mode = CS_MODE_64;
+      break;
+
+    default:
+      errx (EXIT_FAILURE, "error: '%s' unsupported architecture",
+            exec_argv[0]);
     }
+
+  /* Initialize the assembly decoder */
+  if (cs_open (CS_ARCH_X86, exec_mode, &handle) != CS_ERR_OK)
+    errx (EXIT_FAILURE, "error: cannot start capstone disassembler");
+
+  /* Set syntax flavor output */
+  if (intel)
+    cs_option (handle, CS_OPT_SYNTAX, CS_OPT_SYNTAX_INTEL);
   else
+    cs_option (handle, CS_OPT_SYNTAX, CS_OPT_SYNTAX_ATT);
+
+  /* Start the run in the binary log */
+  if (tracer->tlog && !tracer->probe)
+    tlog_begin (tracer->tlog, exec_mode, intel ? TLOG_INTEL : 0,
+                tracer->command);
+
+  /* Main disassembling loop */
+  tracer->child = child;
+  tracer->arch = exec_arch;
+  tracer->handle = handle;
+  /* Runs are not linked together, the exit of one is not followed by the
+   * start of the next */
+  tracer->cfg = NULL;
+  tracer->call = NULL;
+  tracer->last_ip = 0;
+  tracer->instr_count = 0;
+  tracer->block = block;
+  tracer->pipeline = pipeline;
+
+  /* Runs along the known paths of their command line are fast-forwarded
+   * (-u), as long as the command line is all the input they get */
+  if (tracer->paths && !tracer->probe && tracer->input_fd == -1)
+    {
+      tracer->trace = trace_new ();
+      if (!tracer->trace)
+        err (EXIT_FAILURE, "error: cannot record the path of the run");
+    }
+
+  /* A new process: cached instructions have to be checked */
+  tracer->mem = mem_new (child);
+  if (!tracer->mem)
+    warn ("warning: cannot read the mappings of '%s'", exec_argv[0]);
+  tracer_invalidate (tracer);
+
+  /* Where .text is loaded in the child, from its entry point */
+  bool text = (tracer->filter && tracer->filter->text);
+  tracer->text_bias = 0;
+  if (text || ahead)
+    tracer->text_bias = mem_get_entry (child, exec_arch == x86_64_arch)
+      - img->entry;
+  if (text)
+    {
+      if (!img->has_text)
+        errx (EXIT_FAILURE, "error: cannot find the .text section of '%s'",
+              exec_argv[0]);
+      tracer->text_start = img->text_addr + tracer->text_bias;
+      tracer->text_end = img->text_addr + img->text_size + tracer->text_bias;
+    }
+
+  /* Instructions of .text are decoded once for all the runs (-a) */
+  tracer->predecoded = NULL;
+  if (ahead)
+    {
+      tracer->predecoded = predecode_get (img, exec_mode, intel, listing);
+      if (!tracer->predecoded && errno != ENOENT)
+        err (EXIT_FAILURE, "error: cannot decode '%s' ahead", exec_argv[0]);
+    }
+
+  /* Threads and processes the child creates are followed (ptrace) */
+  if (!tracer_attach (tracer, child))
+    err (EXIT_FAILURE, "error: cannot follow '%s'", exec_argv[0]);
+
+  /* The first run to find the backend unavailable switches to ptrace */
+  pthread_mutex_lock (&backend_lock);
+  const backend_t *run = backend;
+  pthread_mutex_unlock (&backend_lock);
+  bool ran = run->run (tracer);
+  if (!ran && errno == ECHILD)
+    warnx ("warning: '%s' exited before its trace could be rebuilt",
+           exec_argv[0]);
+  else if (!ran)
+    {
+      pthread_mutex_lock (&backend_lock);
+      if (backend == run)
+        {
+          warnx ("warning: '%s' backend unavailable, using '%s'",
+                 run->name, ptrace_backend.name);
+          backend = &ptrace_backend;
+        }
+      pthread_mutex_unlock (&backend_lock);
+      ptrace_backend.run (tracer);
+    }
+
+  if (srv)
+    forksrv_reap (srv, child);
+  if (tracer->tlog && !tracer->probe)
+    tlog_end (tracer->tlog, tracer->instr_count);
+
+  /* Given up along a known path, or along a path to keep */
+  bool forwarded = (tracer->ahead.trace && tracer_forward (tracer));
+  if (!forwarded && tracer->trace)
+    {
+      bool known;
+      if (!paths_add (tracer->paths, tracer->trace, tracer->stats.path,
+                      tracer->command, &known))
+        err (EXIT_FAILURE, "error: cannot record the path of the run");
+      tracer->stats.known_paths = known;
+      tracer->trace = NULL;
+    }
+  tracer_drop_path (tracer);
+  tracer_detach_all (tracer);
+  stack_clear (tracer->stack);
+  mem_delete (tracer->mem);
+  tracer->mem = NULL;
+  cs_close (&handle);
+  stats_stop (&(tracer->stats));
+  return exec_mode;
+}
+
+/* Display the statistics of a run of command, of instr_count instructions
+ * and counted in stats, ht holding the cfg it was inserted in. They are
+ * also written as JSON with -s */
+static void
+print_stats (FILE *out, const char *command, size_t instr_count,
+             const stats_t *stats, hashtable_t *ht)
+{
+  double mean_probe;
+  size_t max_probe = hashtable_probe_length (ht, &mean_probe);
+  fprintf (out,
+           "\n"
+           "\tStatistics about this run\n"
+           "\t=========================\n"
+           "* #instructions executed: %zu\n"
+           "* #unique instructions:   %zu\n"
+           "* #hashtable buckets:     %zu\n"
+           "* #hashtable collisions:  %zu\n"
+           "* #hashtable probes:      %.2f (max: %zu)\n",
+           instr_count, hashtable_entries (ht),
+           hashtable_size (ht), hashtable_collisions (ht),
+           mean_probe, max_probe);
+  stats_print (out, stats, instr_count);
+  fputs ("\n\n", out);
+
+  if (stats_file)
+    stats_json (stats_file, stats, command, instr_count);
+  stats_merge (&session, stats);
+  session_count += instr_count;
+}
+
+/* Initialize tracer to insert its runs in the cfg of ht, they are listed
+ * in out and logged in log (if not NULL) */
+static void
+tracer_init (tracer_t *tracer, hashtable_t *ht, FILE *out, tlog_t *log)
+{
+  *tracer = (tracer_t) { 0 };
+  tracer->ht = ht;
+  tracer->output = out;
+  tracer->tlog = log;
+  tracer->filter = filter.nb_ranges ? &filter : NULL;
+  tracer->input_fd = -1;
+  tracer->paths = paths;
+
+  tracer->cache = calloc (DECODE_CACHE_SIZE, sizeof (decoded_t));
+  if (!tracer->cache)
+    err (EXIT_FAILURE, "error: cannot create the decode cache");
+  tracer->stack = stack_new ();
+  if (!tracer->stack)
+    err (EXIT_FAILURE, "error: cannot create the call stack");
+}
+
+/* Free the decode cache and the call stack of tracer, and stop its fork
+ * server (its cfg is left in its hashtable) */
+static void
+tracer_fini (tracer_t *tracer)
+{
+  for (size_t i = 0; i < DECODE_CACHE_SIZE; i++)
+    free (tracer->cache[i].line);
+  free (tracer->cache);
+  stack_delete (tracer->stack);
+  free (tracer->threads);
+  free (tracer->processes);
+  forksrv_stop (&(tracer->server));
+}
+
+/* A command line of the input file, traced by a worker (-j) */
+typedef struct
+{
+  char line[MAX_LEN];       /* Command line */
+  cs_mode mode;             /* Mode the command was decoded in */
+  size_t instr_count;       /* Number of instructions traced */
+  char command[MAX_LEN];    /* Command line traced */
+  stats_t stats;            /* Counters of the run */
+  FILE *listing;            /* Listing of the run, until it is written */
+  FILE *log;                /* Binary trace of the run (if any) */
+  bool done;                /* Set when the run is over */
+} job_t;
+
+/* Jobs shared by the workers, main() writes their output in order */
+typedef struct
+{
+  job_t *jobs;              /* Command lines of the input file */
+  size_t nb_jobs;           /* Number of jobs */
+  size_t next;              /* Next job to start */
+  size_t written;           /* Number of jobs written */
+  size_t window;            /* Jobs started ahead of the output, at most */
+  hashtable_t *ht;          /* Cfg every worker inserts in */
+  char **envp;              /* Environment of the children */
+  pthread_mutex_t lock;     /* Lock of next, written and jobs[].done */
+  pthread_cond_t changed;   /* Signaled when a job is over or written */
+} pool_t;
+
+/* Trace a job with the tracer of a worker, straight in the cfg of its
+ * hashtable. The listing and log are kept aside until main() writes them */
+static void
+job_run (job_t *job, tracer_t *tracer, char *envp[])
+{
+  job->listing = tmpfile ();
+  if (!job->listing)
+    err (EXIT_FAILURE, "error: cannot store the listing of a run");
+
+  tlog_t *log = NULL;
+  if (tlog)
+    {
+      job->log = tmpfile ();
+      int fd = job->log ? dup (fileno (job->log)) : -1;
+      if (fd == -1 || !(log = tlog_open (fd)))
+        err (EXIT_FAILURE, "error: cannot store the trace of a run");
+    }
+
+  tracer->output = job->listing;
+  tracer->tlog = log;
+
+  /* Cached instructions were defined in the log of the previous job */
+  for (size_t i = 0; i < DECODE_CACHE_SIZE; i++)
+    tracer->cache[i].log_id = 0;
+
+  char *exec_argv[strlen (job->line) + 1];
+  int exec_argc = split_command (job->line, exec_argv);
+  job->mode = trace_command (tracer, exec_argc, exec_argv, envp);
+  job->instr_count = tracer->instr_count;
+  memcpy (job->command, tracer->command, MAX_LEN);
+  job->stats = tracer->stats;
+
+  tracer->tlog = NULL;
+  tlog_delete (log);
+}
+
+/* Write the listing, log and statistics of a job as if it was traced
+ * alone, ht holding the cfg */
+static void
+job_write (job_t *job, hashtable_t *ht)
+{
+  char buf[BUFSIZ];
+  size_t n;
+  rewind (job->listing);
+  while ((n = fread (buf, 1, BUFSIZ, job->listing)) > 0)
+    fwrite (buf, 1, n, output);
+  if (ferror (job->listing))
+    err (EXIT_FAILURE, "error: cannot read the listing of a run");
+  fclose (job->listing);
+
+  if (job->log)
+    {
+      rewind (job->log);
+      tlog_reader_t *reader = tlog_reader_open (job->log);
+      if (!reader || !tlog_copy (tlog, reader))
+        err (EXIT_FAILURE, "error: cannot read the trace of a run");
+      tlog_reader_delete (reader);
+    }
+
+  print_stats (output, job->command, job->instr_count, &(job->stats), ht);
+}
+
+/* Start the jobs of the pool one after the other, until none is left. The
+ * decode cache and the fork server of the worker are kept from a job to
+ * the next */
+static void *
+worker (void *arg)
+{
+  pool_t *pool = arg;
+  tracer_t tracer;
+  tracer_init (&tracer, pool->ht, NULL, NULL);
+
+  pthread_mutex_lock (&(pool->lock));
+  while (pool->next < pool->nb_jobs)
+    {
+      /* Runs waiting to be written hold temporary files, keep them few */
+      if (pool->next - pool->written >= pool->window)
+        {
+          pthread_cond_wait (&(pool->changed), &(pool->lock));
+          continue;
+        }
+      job_t *job = &(pool->jobs[pool->next++]);
+      pthread_mutex_unlock (&(pool->lock));
+
+      job_run (job, &tracer, pool->envp);
+
+      pthread_mutex_lock (&(pool->lock));
+      job->done = true;
+      pthread_cond_broadcast (&(pool->changed));
+    }
+  pthread_mutex_unlock (&(pool->lock));
+  tracer_fini (&tracer);
+  return NULL;
+}
+
+/* Trace the command lines of input with nb_workers workers, all of them
+ * inserting in the cfg of ht. The runs are written in the order of the
+ * input. Returns the mode of the last command */
+static cs_mode
+trace_parallel (hashtable_t *ht, size_t nb_workers, char *envp[])
+{
+  pool_t pool = { .ht = ht, .envp = envp, .window = 2 * nb_workers };
+  pthread_mutex_init (&(pool.lock), NULL);
+  pthread_cond_init (&(pool.changed), NULL);
+
+  size_t max_jobs = 0;
+  char str[MAX_LEN];
+  while (fgets (str, MAX_LEN, input) != NULL)
+    {
+      if (str[0] == '\n')
+        continue;
+      if (pool.nb_jobs == max_jobs)
+        {
+          max_jobs = max_jobs ? 2 * max_jobs : 64;
+          job_t *jobs = realloc (pool.jobs, max_jobs * sizeof (job_t));
+          if (!jobs)
+            err (EXIT_FAILURE, "error: cannot read the input file");
+          pool.jobs = jobs;
+        }
+      pool.jobs[pool.nb_jobs] = (job_t) { 0 };
+      strcpy (pool.jobs[pool.nb_jobs].line, str);
+      pool.nb_jobs++;
+    }
+
+  /* Nothing to trace, and no worker to start */
+  if (pool.nb_jobs == 0)
+    {
+      pthread_cond_destroy (&(pool.changed));
+      pthread_mutex_destroy (&(pool.lock));
+      free (pool.jobs);
+      return CS_MODE_64;
+    }
+
+  if (nb_workers > pool.nb_jobs)
+    nb_workers = pool.nb_jobs;
+  pthread_t threads[nb_workers];
+  for (size_t i = 0; i < nb_workers; i++)
+    if ((errno = pthread_create (&threads[i], NULL, worker, &pool)))
+      err (EXIT_FAILURE, "error: cannot start a worker");
+
+  cs_mode mode = CS_MODE_64;
+  for (size_t i = 0; i < pool.nb_jobs; i++)
+    {
+      pthread_mutex_lock (&(pool.lock));
+      while (!pool.jobs[i].done)
+        pthread_cond_wait (&(pool.changed), &(pool.lock));
+      pthread_mutex_unlock (&(pool.lock));
+
+      job_write (&(pool.jobs[i]), ht);
+      mode = pool.jobs[i].mode;
+
+      pthread_mutex_lock (&(pool.lock));
+      pool.written++;
+      pthread_cond_broadcast (&(pool.changed));
+      pthread_mutex_unlock (&(pool.lock));
+    }
+
+  for (size_t i = 0; i < nb_workers; i++)
+    pthread_join (threads[i], NULL);
+  pthread_cond_destroy (&(pool.changed));
+  pthread_mutex_destroy (&(pool.lock));
+  free (pool.jobs);
+  return mode;
+}
+
+/* Read the seeds of the fuzzer in input: command lines, ending with
+ * '< FILE' to give FILE as standard input */
+static void
+fuzz_read_seeds (fuzzer_t *f)
+{
+  char str[MAX_LEN];
+  while (fgets (str, MAX_LEN, input) != NULL)
+    {
+      if (str[0] == '\n')
+        continue;
+
+      char *exec_argv[strlen (str) + 1];
+      int exec_argc = split_command (str, exec_argv);
+      uint8_t *data = NULL;
+      size_t size = 0;
+      bool piped = (exec_argc > 2 && !strcmp (exec_argv[exec_argc - 2], "<"));
+      if (piped)
+        {
+          const char *path = exec_argv[exec_argc - 1];
+          FILE *file = fopen (path, "r");
+          data = malloc (FUZZ_MAX_DATA);
+          if (!file || !data)
+            err (EXIT_FAILURE, "error: cannot read '%s'", path);
+          size = fread (data, 1, FUZZ_MAX_DATA, file);
+          if (ferror (file))
+            err (EXIT_FAILURE, "error: cannot read '%s'", path);
+          if (!feof (file))
+            warnx ("warning: '%s' truncated to %d bytes", path,
+                   FUZZ_MAX_DATA);
+          fclose (file);
+          exec_argc -= 2;
+          exec_argv[exec_argc] = NULL;
+        }
+      if (exec_argc > 0
+          && !fuzzer_add (f, exec_argc, exec_argv, data, size, piped))
+        err (EXIT_FAILURE, "error: cannot store the seeds");
+      free (data);
+    }
+  if (f->nb_inputs == 0)
+    errx (EXIT_FAILURE, "error: no command line to fuzz in the input file");
+}
+
+/* Trace the input in with tracer, feeding it its standard input */
+static cs_mode
+fuzz_run (tracer_t *tracer, fuzz_input_t *in, char *envp[])
+{
+  /* Every run shares the same file, and its offset */
+  if (ftruncate (tracer->input_fd, 0) == -1
+      || pwrite (tracer->input_fd, in->data, in->size, 0) != (ssize_t) in->size
+      || lseek (tracer->input_fd, 0, SEEK_SET) == -1)
+    err (EXIT_FAILURE, "error: cannot write the standard input of a run");
+  return trace_command (tracer, in->argc, in->argv, envp);
+}
+
+/* Fuzz the command lines of input: nb_runs mutated inputs are run, with
+ * only their coverage recorded (from a fork server), and the ones reaching
+ * new edges are traced in the cfg of ht as the seeds. Returns the mode of
+ * the last command traced */
+static cs_mode
+fuzz (hashtable_t *ht, size_t nb_runs, char *envp[])
+{
+  fuzzer_t *f = fuzzer_new (time (NULL) ^ getpid (), MAX_LEN - 1);
+  uint8_t *map = malloc (EDGE_MAP_SIZE);
+  FILE *data = tmpfile ();
+  if (!f || !map || !data)
+    err (EXIT_FAILURE, "error: cannot start the fuzzer");
+  fuzz_read_seeds (f);
+
+  /* Edges already in the cfg (-c) are not new */
+  fuzzer_know (f, hashtable_get_edge_map (ht));
+
+  tracer_t tracer;
+  tracer_init (&tracer, ht, output, tlog);
+  tracer.input_fd = fileno (data);
+  tracer.coverage = map;
+
+  /* The seeds are traced before anything else */
+  cs_mode mode = CS_MODE_64;
+  size_t nb_seeds = f->nb_inputs;
+  for (size_t i = 0; i < nb_seeds; i++)
     {
-      if (cfg_get_type (old) == BRANCH || cfg_get_type (old) == JUMP)
+      memset (map, 0, EDGE_MAP_SIZE);
+      mode = fuzz_run (&tracer, &(f->inputs[i]), envp);
+      print_stats (output, tracer.command, tracer.instr_count,
+                   &(tracer.stats), ht);
+      fuzzer_update (f, map);
+    }
+
+  size_t nb_hangs = 0;
+  for (size_t run = 0; run < nb_runs; run++)
+    {
+      fuzz_input_t in;
+      if (!fuzzer_mutate (f, &in))
+        err (EXIT_FAILURE, "error: cannot mutate an input");
+
+      memset (map, 0, EDGE_MAP_SIZE);
+      tracer.probe = true;
+      tracer.max_count = FUZZ_MAX_COUNT;
+      fuzz_run (&tracer, &in, envp);
+      tracer.probe = false;
+      tracer.max_count = 0;
+
+      if (tracer.instr_count >= FUZZ_MAX_COUNT)
+        nb_hangs++;
+      else if (fuzzer_update (f, map) > 0)
         {
-          for (uint16_t i = 0; i < cfg_get_nb_out (old); i++)
-            graph_create_function (g, cfg_get_successor_i (old, i), m);
+          /* Some new coverage, worth a full trace */
+          mode = fuzz_run (&tracer, &in, envp);
+          print_stats (output, tracer.command, tracer.instr_count,
+                       &(tracer.stats), ht);
+          if (!fuzzer_keep (f, &in))
+            err (EXIT_FAILURE, "error: cannot store an input");
         }
+      fuzz_input_clear (&in);
     }
-  return g;
+
+  fprintf (output,
+           "\tStatistics about this fuzzing session\n"
+           "\t=====================================\n"
+           "* #inputs run:            %zu\n"
+           "* #inputs traced:         %zu (%zu seeds)\n"
+           "* #inputs given up:       %zu\n"
+           "* #edges covered:         %zu\n\n\n",
+           nb_seeds + nb_runs, f->nb_inputs, nb_seeds, nb_hangs, f->nb_edges);
+
+  tracer_fini (&tracer);
+  fclose (data);
+  free (map);
+  fuzzer_delete (f);
+  return mode;
 }
 
 int
 main (int argc, char *argv[], char *envp[])
 {
   /* Getting program name */
-  const char *program_name = basename (argv[0]);
+  program_name = basename (argv[0]);
 
   /* Initializing output to its default */
   output = stdout;
 
+  /* 'fuzz' mutates the command lines of the input file */
+  bool fuzzing = (argc > 1 && !strcmp (argv[1], "fuzz"));
+  if (fuzzing)
+    {
+      argv[1] = argv[0];
+      argc--;
+      argv++;
+    }
+
   /* Options parser settings */
   opterr = 0; /* Mute error message from getopt() */
-  const char *opts = "dio:vVh";
+  const char *opts = "ab:Bc:df:g:ij:n:o:p:Pr:s:t:uvx:Vh";
 
-  bool intel = false;
+  size_t nb_workers = 1;
+  size_t nb_runs = FUZZ_DEFAULT_RUNS;
+  const char *cfgdb_path = NULL;
 
    const struct option long_opts[] = {
+    {"ahead",          no_argument, NULL, 'a'},
+    {"backend",  required_argument, NULL, 'b'},
+    {"block",          no_argument, NULL, 'B'},
+    {"cfg",      required_argument, NULL, 'c'},
     {"debug",          no_argument, NULL, 'd'},
+    {"fork-server", required_argument, NULL, 'f'},
+    {"graph",    required_argument, NULL, 'g'},
     {"intel",          no_argument, NULL, 'i'},
+    {"jobs",     required_argument, NULL, 'j'},
+    {"runs",     required_argument, NULL, 'n'},
     {"output",   required_argument, NULL, 'o'},
+    {"profile",  required_argument, NULL, 'p'},
+    {"pipeline",       no_argument, NULL, 'P'},
+    {"range",    required_argument, NULL, 'r'},
+    {"stats",    required_argument, NULL, 's'},
+    {"trace",    required_argument, NULL, 't'},
+    {"unique",         no_argument, NULL, 'u'},
     {"verbose",        no_argument, NULL, 'v'},
+    {"exclude",  required_argument, NULL, 'x'},
     {"version",        no_argument, NULL, 'V'},
     {"help",           no_argument, NULL, 'h'},
     {NULL,                       0, NULL,   0}
   };
 
    const char *usage_msg =
-     "Usage: %1$s [-o FILE|-i|-v|-d|-V|-h] [--] EXEC [ARGS]\n"
+     "Usage: %1$s [fuzz] [-a|-b NAME|-B|-c FILE|-f WHERE|-g FILE|-j N|-n N|-o FILE|-p N|-P|-r RANGE|-x RANGE|-s FILE|-t FILE|-u|-i|-v|-d|-V|-h] [--] EXEC [ARGS]\n"
      "Trace the execution of EXEC on the given arguments ARGS\n"
      "\n"
-     " -o FILE,--output FILE  write result to FILE\n"
+     " fuzz                   mutate the command lines of the input file (and\n"
+     "                        their stdin, given as '< FILE'), run them from a\n"
+     "                        fork server at main (or -f), and trace the ones\n"
+     "                        reaching new edges\n"
+     " -a,--ahead             decode .text of EXEC once, in parallel, before\n"
+     "                        the runs (it is checked against what they run)\n"
+     " -b NAME,--backend NAME trace with NAME: ptrace, perf (default: ptrace),\n"
+     "                        perf is faster but its counts are approximate\n"
+     " -B,--block             run basic blocks at once (ptrace backend)\n"
+     " -c FILE,--cfg FILE     grow the cfg stored in FILE (created if needed),\n"
+     "                        read back at start in a time linear in its size\n"
+     " -f WHERE,--fork-server WHERE\n"
+     "                        fork the runs from a snapshot of EXEC taken at\n"
+     "                        WHERE: main, a function or an address\n"
+     " -g FILE,--graph FILE   write the cfg of the functions to FILE, in DOT\n"
+     "                        (or JSON if FILE ends with '.json')\n"
+     " -j N,--jobs N          trace N command lines at once (default: 1)\n"
+     " -n N,--runs N          run N mutated inputs with fuzz (default: 1000)\n"
+     " -o FILE,--output FILE  write the listing of the trace to FILE\n"
+     " -p N,--profile N       report the N hottest blocks and functions, and\n"
+     "                        the N rarest edges of all the runs\n"
+     " -P,--pipeline          record the steps in another thread while the\n"
+     "                        child runs (ptrace backend)\n"
+     " -r RANGE,--range RANGE trace only RANGE (and the other ones given): text,\n"
+     "                        START-END (hex) or a shared object (libc...)\n"
+     " -x RANGE,--exclude RANGE\n"
+     "                        do not trace RANGE, calls to it run at full speed\n"
+     " -s FILE,--stats FILE   write the statistics of the runs to FILE, in JSON\n"
+     "                        (one line per run, the session last)\n"
+     " -t FILE,--trace FILE   write the trace to FILE in binary (tracker-dump)\n"
+     " -u,--unique            give up the runs following the path of a previous\n"
+     "                        run of their command line, the rest of it is\n"
+     "                        taken as their own\n"
      " -i,--intel             switch to intel syntax (default: at&t)\n"
      " -v,--verbose           verbose output\n"
      " -d,--debug             debug output\n"
@@ -365,12 +1384,101 @@ main (int argc, char *argv[], char *envp[])
         output = fopen (optarg, "we");
         if (!output)
 	  			err (EXIT_FAILURE, "error: cannot open file '%s'", optarg);
+        listing = true;
+        break;
+
+      case 't':         /* Binary trace file */
+        tlog = tlog_new (optarg);
+        if (!tlog)
+          err (EXIT_FAILURE, "error: cannot open file '%s'", optarg);
+        break;
+
+      case 's':         /* Statistics in JSON */
+        stats_file = fopen (optarg, "we");
+        if (!stats_file)
+          err (EXIT_FAILURE, "error: cannot open file '%s'", optarg);
+        break;
+
+      case 'r':         /* Range traced */
+      case 'x':         /* Range not traced */
+        if (!filter_add (&filter, optarg, optc == 'x'))
+          err (EXIT_FAILURE, "error: invalid range '%s'", optarg);
+        break;
+
+      case 'a':         /* Decode .text ahead */
+        ahead = true;
+        break;
+
+      case 'b':         /* Trace backend */
+        backend = backend_get (optarg);
+        if (!backend)
+          errx (EXIT_FAILURE, "error: unknown backend '%s'", optarg);
+        break;
+
+      case 'B':         /* Basic-block stepping mode */
+        block = true;
+        break;
+
+      case 'c':         /* Cfg database */
+        cfgdb_path = optarg;
+        break;
+
+      case 'f':         /* Fork server */
+        snapshot = optarg;
+        break;
+
+      case 'g':         /* Cfg export */
+        graph = fopen (optarg, "we");
+        if (!graph)
+          err (EXIT_FAILURE, "error: cannot open file '%s'", optarg);
+        graph_path = optarg;
+        break;
+
+      case 'u':         /* Fast-forward along known paths */
+        if (!paths)
+          paths = paths_new ();
+        if (!paths)
+          err (EXIT_FAILURE, "error: cannot keep the paths of the runs");
         break;
 
       case 'i':         /* intel syntax mode */
         intel = true;
         break;
 
+      case 'j':         /* Number of workers */
+        {
+          char *end;
+          long n = strtol (optarg, &end, 10);
+          if (*optarg == '\0' || *end != '\0' || n < 1)
+            errx (EXIT_FAILURE, "error: invalid number of jobs '%s'", optarg);
+          nb_workers = n;
+        }
+        break;
+
+      case 'n':         /* Number of mutated inputs */
+        {
+          char *end;
+          long n = strtol (optarg, &end, 10);
+          if (*optarg == '\0' || *end != '\0' || n < 0)
+            errx (EXIT_FAILURE, "error: invalid number of runs '%s'", optarg);
+          nb_runs = n;
+        }
+        break;
+
+      case 'p':         /* Profile report */
+        {
+          char *end;
+          long n = strtol (optarg, &end, 10);
+          if (*optarg == '\0' || *end != '\0' || n < 1)
+            errx (EXIT_FAILURE, "error: invalid profile length '%s'", optarg);
+          profile = n;
+        }
+        break;
+
+      case 'P':         /* Record the steps in another thread */
+        pipeline = true;
+        break;
+
       case 'd':         /* Debug mode */
         debug = true;
         break;
@@ -404,255 +1512,106 @@ main (int argc, char *argv[], char *envp[])
   if (input == NULL)
     errx (EXIT_FAILURE, "error: can't open the input file");
 
-	int nb_line = 0;
-  char str[MAX_LEN];
-	while (fgets (str, MAX_LEN, input) != NULL)
+  /* The recording thread would only take turns with the child */
+  if (pipeline && sysconf (_SC_NPROCESSORS_ONLN) < 2)
     {
-			if (str[0] != '\n')
-				nb_line++;
-		}
-	rewind (input);
-
-	cfg_t *cfg = NULL;
-	cfg_t *cfg_entry = NULL;
-  list_t *first_entry = NULL;
-  list_t *tail_entries = NULL;
-  uint16_t nb_function = 0;
+      warnx ("warning: a single processor, -P is ignored");
+      pipeline = false;
+    }
 
+  stats_start (&session);
+  cs_mode label_mode = CS_MODE_64;
 	hashtable_t *ht = hashtable_new (DEFAULT_HASHTABLE_SIZE);
-
-  fp = fopen("toto.gv", "w+");
-  char name_node[128];
-  Agraph_t *g;
-  g = agopen ("G", Agstrictdirected, NULL);
-	Agsym_t *sym;
-	sym = agattr (g, AGNODE, "shape", "box");
-
 	if (ht == NULL)
 		err (EXIT_FAILURE, "error: cannot create hashtable");
 
-	while (fgets (str, MAX_LEN, input) != NULL)
-		{
-			if (str[0] != '\n')
-				{
-					size_t line_length = strlen (str);
-					char *exec_argv[line_length];
-					char *token = strtok (str, " ");
-					int index = 0;
-					while (token != NULL)
-						{
-							size_t token_length = strlen (token);
-							if (token[token_length - 1] == '\n')
-								token[token_length - 1] = '\0'; /* Formatting trick */
-							exec_argv[index] = token;
-							index++;
-							token = strtok (NULL, " ");
-						}
-					exec_argv[index] = NULL;
-					int exec_argc = index;
-
-				  /* Perfom various checks on the executable file */
-				  arch_t exec_arch = check_execfile (exec_argv[0]);
-
-				  /* Display the traced command */
-				  fprintf (output, "%s: starting to trace '", program_name);
-				  for (int i = 0; i < exec_argc - 1; i++)
-				    fprintf (output, "%s ", exec_argv[i]);
-				  fprintf (output, "%s'\n\n", exec_argv[exec_argc - 1]);
-
-				  /* Forking and tracing */
-				  pid_t child = fork ();
-				  if (child == -1)
-				    errx (EXIT_FAILURE, "error: fork failed!");
-
-				  /* Initialized and start the child */
-				  if (child == 0)
-				    {
-				      /* Disabling ASLR */
-				      personality (ADDR_NO_RANDOMIZE);
-
-				      /* Start tracing the process */
-				      if (ptrace (PTRACE_TRACEME, 0, NULL, NULL) == -1)
-								errx (EXIT_FAILURE,
-					      			"error: cannot operate from inside a ptrace() call!");
-
-				      /* Starting the traced executable */
-				      execve (exec_argv[0], exec_argv, envp);
-
-				    }
-
-				  /* Parent process */
-				  int status;
-				  byte_t buf[MAX_OPCODE_BYTES];
-				  uintptr_t ip;
-				  struct user_regs_struct regs;
-
-				  /* Initializing Capstone disassembler */
-				  csh handle;
-				  cs_insn *insn;
-				  size_t count;
-
-				  cs_mode exec_mode = 0;
-				  switch (exec_arch)
-				    {
-				    case x86_32_arch:
-				      exec_mode = CS_MODE_32;
-				      break;
-
-				    case x86_64_arch:
-				      exec_mode = CS_MODE_64;
-				      break;
-
-				    default:
-				      errx (EXIT_FAILURE,
-										"error: '%s' unsupported architecture", exec_argv[0]);
-				    }
-
-				  /* Initialize the assembly decoder */
-				  if (cs_open (CS_ARCH_X86, exec_mode, &handle) != CS_ERR_OK)
-				    errx (EXIT_FAILURE, "error: cannot start capstone disassembler");
-
-				  /* Set syntax flavor output */
-				  if (intel)
-				    cs_option (handle, CS_OPT_SYNTAX, CS_OPT_SYNTAX_INTEL);
-				  else
-				    cs_option (handle, CS_OPT_SYNTAX, CS_OPT_SYNTAX_ATT);
-
-				  /* Main disassembling loop */
-				  size_t instr_count = 0;
-          stack_t *stack = NULL;
-
-				  while (true)
-				    {
-				      /* Waiting for child process */
-				      wait (&status);
-				      if (WIFEXITED (status))
-								break;
-
-				      /* Get instruction pointer */
-				      ptrace (PTRACE_GETREGS, child, NULL, &regs);
-
-				      /* Printing instruction pointer */
-				      ip = get_current_ip (&regs);
-				      fprintf (output, "0x%" PRIxPTR "  ", ip);
-
-				      /* Get the opcode from memory */
-				      for (size_t i = 0; i < MAX_OPCODE_BYTES; i += 8)
-								{
-					  			long *ptr = (long *) &(buf[i]);
-					  			*ptr = ptrace (PTRACE_PEEKDATA, child, ip + i, NULL);
-								}
-
-				      /* Get the mnemonic from decoder */
-				      count = cs_disasm (handle, &(buf[0]), MAX_OPCODE_BYTES, 0x1000, 0, &insn);
-
-							if (count > 0)
-								{
-					  			/* Display the bytes */
-					  			for (size_t i = 0; i < insn[0].size; i++)
-					    		       fprintf (output, " %02x", buf[i]);
-
-					  			/* Pretty printing and formating */
-					  			if (insn[0].size != 8 && insn[0].size != 11)
-					    			fprintf (output, "\t");
-
-					  			for (int i = 0; i < 4 - (insn[0].size / 3); i++)
-					    			fprintf (output, "\t");
-
-					  			/* Display mnemonic and operand */
-					  			fprintf (output, "%s  %s", insn[0].mnemonic, insn[0].op_str);
-					  			fprintf (output, "\n");
-
-
-
-                  sprintf(name_node,"0x%" PRIxPTR  "  ", ip);
-                  for (size_t i = 0; i < insn[0].size; i++)
-                    sprintf(name_node + strlen(name_node), "%02x ", buf[i]);
-                  sprintf(name_node + strlen(name_node), " %s ",insn[0].mnemonic);
-                  sprintf(name_node + strlen(name_node), "%s",insn[0].op_str);
-
-					  			/* Create the instr_t structure */
-					  			instr_t *instr = instr_new (ip, insn[0].size, buf);
-					  			if (!instr)
-									{
-										hashtable_delete (ht);
-										cs_free (insn, count);
-										cs_close (&handle);
-										fclose (input);
-										fclose (output);
-					    			err (EXIT_FAILURE, "error: cannot create instruction");
-									}
-								cs_free (insn, count);
-
-									if (!cfg)
-									 	{
-											/* Create a new trace and store it */
-											cfg = cfg_new (ht, instr, name_node, &tail_entries);
-
-											if (!cfg)
-  											{
-  												hashtable_delete (ht);
-  												cs_close (&handle);
-  												fclose (input);
-  												fclose (output);
-  									 			err (EXIT_FAILURE, "error: cannot create a control flow graph");
-  											}
-									 		cfg_entry = cfg;
-                      first_entry = list_new (cfg);
-                      tail_entries = first_entry;
-										}
-									else
-										{
-											/* Insert a new element in the cfg and update cfg to hold
-											 * the new node */
-
-											cfg = cfg_insert (ht, cfg, instr, name_node, &stack, &tail_entries, &nb_function);
-
-											if (!cfg)
-  											{
-  												hashtable_delete (ht);
-  												cs_close (&handle);
-  												fclose (input);
-  												fclose (output);
-  												err (EXIT_FAILURE, "error: cannot create a control flow graph");
-  											}
-										}
-
-					  			/* Updating counters */
-					  			instr_count++;
-								}
-
-				      /* Continue to next instruction... */
-				      /* Note that, sometimes, ptrace(PTRACE_SINGLESTEP) returns '-1'
-				       * to notify that the child process did not respond quick enough,
-				       * we have to wait for ptrace() to return '0'. */
-				      while (ptrace(PTRACE_SINGLESTEP, child, NULL, NULL));
-				    }
-          stack_delete (stack);
-          stack = NULL;
-					cs_close (&handle);
-				  fprintf(output,
-					  "\n"
-					  "\tStatistics about this run\n"
-					  "\t=========================\n"
-					  "* #instructions executed: %zu\n"
-					  "* #unique instructions:   %zu\n"
-					  "* #hashtable buckets:     %zu\n"
-					  "* #hashtable collisions:  %zu\n\n\n",
-					  instr_count, hashtable_entries (ht),
-					  (size_t) DEFAULT_HASHTABLE_SIZE, hashtable_collisions (ht));
-				}
-		}
-
-  g = graph_create_function(g, (cfg_t *) list_get_ith (first_entry, 90), NULL);
+  /* Runs only add their new coverage to the stored cfg */
+  cfgdb_t *db = NULL;
+  if (cfgdb_path)
+    {
+      db = cfgdb_open (cfgdb_path, ht);
+      if (!db)
+        err (EXIT_FAILURE, "error: cannot open the cfg database '%s'",
+             cfgdb_path);
+    }
+
+  if (fuzzing)
+    {
+      if (nb_workers > 1)
+        warnx ("warning: fuzz runs one input at a time, -j is ignored");
+      label_mode = fuzz (ht, nb_runs, envp);
+    }
+  else if (nb_workers > 1)
+    label_mode = trace_parallel (ht, nb_workers, envp);
+  else
+    {
+      tracer_t tracer;
+      tracer_init (&tracer, ht, output, tlog);
+
+      char str[MAX_LEN];
+      while (fgets (str, MAX_LEN, input) != NULL)
+        {
+          if (str[0] == '\n')
+            continue;
+
+          char *exec_argv[strlen (str) + 1];
+          int exec_argc = split_command (str, exec_argv);
+          label_mode = trace_command (&tracer, exec_argc, exec_argv, envp);
+          print_stats (output, tracer.command, tracer.instr_count,
+                       &(tracer.stats), ht);
+        }
+      tracer_fini (&tracer);
+    }
+
+  if (db && !cfgdb_sync (db, ht))
+    err (EXIT_FAILURE, "error: cannot write the cfg database '%s'",
+         cfgdb_path);
+  cfgdb_close (db);
+
+  blocks_t *blocks = NULL;
+  if (graph || profile)
+    {
+      blocks = blocks_new (ht);
+      if (!blocks)
+        err (EXIT_FAILURE, "error: cannot split the cfg in basic blocks");
+    }
+
+  if (profile && !profile_report (output, ht, blocks, profile))
+    err (EXIT_FAILURE, "error: cannot build the profile");
+
+  /* Instructions are rendered as the last executable traced was decoded */
+  if (graph)
+    {
+      csh handle;
+      if (cs_open (CS_ARCH_X86, label_mode, &handle) != CS_ERR_OK)
+        errx (EXIT_FAILURE, "error: cannot start capstone disassembler");
+      cs_option (handle, CS_OPT_SYNTAX,
+                 intel ? CS_OPT_SYNTAX_INTEL : CS_OPT_SYNTAX_ATT);
+
+      uint64_t start = stats_ticks ();
+      if (!export_cfg (graph, export_format (graph_path), ht, blocks, handle)
+          || fclose (graph) == EOF)
+        err (EXIT_FAILURE, "error: cannot write the cfg to '%s'", graph_path);
+      stats_add (&session, PHASE_EXPORT, start);
+      cs_close (&handle);
+    }
+  blocks_delete (blocks);
+
+  stats_stop (&session);
+  if (stats_file)
+    {
+      stats_json (stats_file, &session, NULL, session_count);
+      if (fclose (stats_file) == EOF)
+        err (EXIT_FAILURE, "error: cannot write the statistics");
+    }
 
   fclose (input);
 	fclose (output);
-
-  list_delete (first_entry);
+  tlog_delete (tlog);
+  filter_clear (&filter);
+  paths_delete (paths);
+  predecode_flush ();
+  image_flush ();
 	hashtable_delete (ht);
-  agwrite(g, fp);
-  agclose(g);
-	fclose (fp);
   return EXIT_SUCCESS;
 }
@@ -13,6 +13,170 @@
 #ifndef _TRACKER_H
 #define _TRACKER_H
 
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include <sys/types.h>
+
+#include <capstone/capstone.h>
+
+#include <trace.h>
+
+#include "filter.h"
+#include "forksrv.h"
+#include "fuzz.h"
+#include "mem.h"
+#include "paths.h"
+#include "predecode.h"
+#include "ring.h"
+#include "stats.h"
+#include "tlog.h"
+
 #define VERSION "1.0.0"
 
+/* Maximum length of a line in input (a command line) */
+#define MAX_LEN 1024
+
+/* In amd64, maximum bytes for an opcode is 15 */
+#define MAX_OPCODE_BYTES 16
+
+/* Platform architecture arch_t type */
+typedef enum
+  {
+   unknown_arch,
+   x86_32_arch,
+   x86_64_arch
+} arch_t;
+
+/* Number of entries of the decode cache (must be a power of 2) */
+#define DECODE_CACHE_SIZE 65536 /* 2^16 */
+
+/* An instruction of the child as decoded once, cached by address */
+typedef struct
+{
+  uintptr_t ip;             /* Address of the instruction (0 if empty) */
+  uint32_t epoch;           /* Epoch it was last checked in (0: always check) */
+  uint8_t size;             /* Size of the instruction */
+  instr_type_t type;        /* Type of the instruction (instr_classify) */
+  byte_t opcodes[MAX_OPCODE_BYTES]; /* Opcodes read at ip */
+  char *line;               /* Line of the listing (NULL without listing) */
+  size_t line_len;          /* Length of line */
+  cfg_t *node;              /* Node in the cfg (NULL until it is executed) */
+  uint32_t log_id;          /* Id in the binary trace log (0 if undefined) */
+} decoded_t;
+
+/* A process followed in a run: the child, or one it forked */
+typedef struct
+{
+  pid_t pid;                /* Id of the process */
+  mem_t *mem;               /* Its executable mappings (or NULL) */
+} process_t;
+
+/* A thread followed in a run. Each one goes its own way in the cfg, the
+ * fields of the current one are those of tracer_t */
+typedef struct
+{
+  pid_t pid;                /* Id of the thread (0 once it exited) */
+  size_t process;           /* Index of its process in processes */
+  cfg_t *cfg;               /* Last node it inserted in the cfg */
+  cfg_t *call;              /* Call whose callee runs untraced (or NULL) */
+  callstack_t *stack;       /* Its call stack */
+  uintptr_t last_ip;        /* Last instruction in coverage (0 if none) */
+  bool started;             /* It stopped once since it was created */
+} thread_t;
+
+/* State of a tracing session, shared by main() and the trace backends */
+typedef struct
+{
+  pid_t child;              /* Traced process (stopped after execve, or at
+                             * the snapshot point of the fork server), then
+                             * its thread that stopped last */
+  arch_t arch;              /* Architecture of the child */
+  csh handle;               /* Capstone handle for the child architecture */
+  hashtable_t *ht;          /* Hashtable holding every cfg node (shared) */
+  cfg_t *cfg;               /* Last node inserted in the cfg (NULL if none) */
+  cfg_t *call;              /* Call whose callee runs untraced (or NULL) */
+  callstack_t *stack;       /* Call stack of the current run */
+  size_t instr_count;       /* Number of instructions traced in this run */
+  bool block;               /* Run whole basic blocks instead of stepping */
+  bool pipeline;            /* Record the steps in another thread (-P) */
+  ring_t *ring;             /* Steps captured, not recorded yet (NULL if
+                             * they are recorded as the child stops) */
+  decoded_t *cache;         /* Decode cache, indexed by address */
+  uint32_t epoch;           /* Bumped each time the mappings may change */
+  mem_t *mem;               /* Executable mappings of the child */
+  FILE *output;             /* Listing of the runs */
+  tlog_t *tlog;             /* Binary trace log of the runs (if any) */
+  forksrv_t server;         /* Fork server the runs start from (-f) */
+  const filter_t *filter;   /* Instructions traced (NULL: all of them) */
+  uintptr_t text_start;     /* First address of .text in the child */
+  uintptr_t text_end;       /* Address following .text in the child */
+  uintptr_t text_bias;      /* Load bias of the executable in the child */
+  const predecode_t *predecoded; /* .text decoded ahead (or NULL) */
+  int input_fd;             /* Standard input of the children (-1: inherit) */
+  uint8_t *coverage;        /* Edge map of the run (or NULL) */
+  uintptr_t last_ip;        /* Last instruction in coverage (0 if none) */
+  bool probe;               /* Only the coverage of the run is recorded */
+  size_t max_count;         /* The child is killed once that many instructions
+                             * are traced (0: never, ptrace backend only) */
+  char command[MAX_LEN];    /* Command line of the current run */
+  stats_t stats;            /* Counters of the current run */
+  paths_t *paths;           /* Paths of the runs so far (NULL: not kept) */
+  trace_t *trace;           /* Path of the current run, as long as it has
+                             * no hole (or NULL) */
+  path_t ahead;             /* Known path the run follows, it is given up
+                             * and fast-forwarded (trace NULL if none) */
+  thread_t *threads;        /* Threads of the run, the first is the child */
+  size_t nb_threads;        /* Number of threads (exited ones included) */
+  size_t max_threads;       /* Allocated size of threads */
+  size_t nb_alive;          /* Number of threads that did not exit */
+  size_t current;           /* Index of the thread in the fields above */
+  process_t *processes;     /* Processes of the threads */
+  size_t nb_processes;      /* Number of processes */
+  size_t max_processes;     /* Allocated size of processes */
+} tracer_t;
+
+/* Get the instruction at address ip from the decode cache, reading and
+ * decoding it only when it is not there or may have changed. Returns NULL
+ * if it cannot be decoded */
+decoded_t *tracer_decode (tracer_t *tracer, const uintptr_t ip);
+
+/* Log and insert in the cfg the instruction at address ip. Returns the
+ * decoded instruction, or NULL if it cannot be decoded */
+const decoded_t *tracer_step (tracer_t *tracer, const uintptr_t ip);
+
+/* The same as tracer_step(), the opcodes at address ip being read already.
+ * The child is not read at all (it may run meanwhile) */
+const decoded_t *tracer_step_opcodes (tracer_t *tracer, const uintptr_t ip,
+                                      const byte_t *opcodes);
+
+/* Notify that the code of the child may have changed: every cached
+ * instruction is checked against memory before being reused */
+void tracer_invalidate (tracer_t *tracer);
+
+/* Notify a hole in the trace: the next instruction is not linked to the
+ * previous one in the cfg (and the path of the run is not kept) */
+void tracer_resync (tracer_t *tracer);
+
+/* Tell if the instruction at address ip is traced (see filter_t) */
+bool tracer_traced (tracer_t *tracer, const uintptr_t ip);
+
+/* Notify that the child runs an instruction that is not traced. If the
+ * last one traced is a call, the next one is linked to it as a return */
+void tracer_skip (tracer_t *tracer);
+
+/* Follow the new thread pid (of a process followed already, or else of a
+ * new process), it starts at the root of the cfg. The first one of a run
+ * is the child, the ones followed already are left as they are. Returns
+ * false if an error occured */
+bool tracer_attach (tracer_t *tracer, pid_t pid);
+
+/* Make the thread pid the current one. Returns false if it is not followed */
+bool tracer_switch (tracer_t *tracer, pid_t pid);
+
+/* Notify that the current thread exited, there is no current thread until
+ * the next tracer_switch() */
+void tracer_detach (tracer_t *tracer);
+
 #endif /* _TRACKER_H */
@@ -0,0 +1,23 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+int foo (int x)
+{
+	return x + 42;
+}
+
+int main (int argc, char *argv[])
+{
+	/* Both processes run traced code once the other one is there */
+	pid_t pid = fork ();
+	FILE *out = fopen (argv[1], "a");
+	if (pid > 0)
+		waitpid (pid, NULL, 0);
+	fprintf (out, "%s %d\n", pid ? "parent" : "child", foo (argc));
+	fclose (out);
+	return EXIT_SUCCESS;
+}
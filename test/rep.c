@@ -0,0 +1,22 @@
+#include <stdlib.h>
+#include <string.h>
+
+int main (int argc, char *argv[])
+{
+	char src[256], dst[256];
+	size_t n = atoi(argv[1]) % sizeof (src);
+	memset (src, 'x', sizeof (src));
+#if defined(__x86_64__) || defined(__i386__)
+	/* rep movsb, and rep stosb, n times each */
+	char *d = dst, *s = src;
+	size_t c = n;
+	__asm__ volatile ("rep movsb" : "+D" (d), "+S" (s), "+c" (c) : : "memory");
+	d = dst;
+	c = n;
+	__asm__ volatile ("rep stosb" : "+D" (d), "+c" (c) : "a" (0) : "memory");
+#else
+	memcpy (dst, src, n);
+	memset (dst, 0, n);
+#endif
+	return dst[0];
+}